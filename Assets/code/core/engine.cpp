@@ -1,9 +1,12 @@
 #include "stdafx.h"
 #include "engine.h"
+#include <random>
 
 #define APP_NAME "Deferred Decals App"
 
-#pragma region ӿ
+static EngineStartupOptions s_startup_options;
+
+#pragma region 接口
 unique_ptr<Engine>& Engine::Instance()
 {
     static std::unique_ptr<Engine> instance = nullptr;
@@ -40,6 +43,20 @@ PipelineLayout* Engine::getPineLine(int id)
         return compute_pipeline_manager_ptr->get_pipeline_layout(m_picking_compute_pipeline_id);
     case 5:
         return compute_pipeline_manager_ptr->get_pipeline_layout(m_deferred_compute_pipeline_id);
+    case 6:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_decal_culling_compute_pipeline_id);
+    case 7:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_cluster_binning_compute_pipeline_id);
+    case 8:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_tile_depth_bounds_compute_pipeline_id);
+    case 9:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_cluster_compaction_compute_pipeline_id);
+    case 10:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_cluster_occupancy_compute_pipeline_id);
+    case 11:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_tile_classification_compute_pipeline_id);
+    case 12:
+        return compute_pipeline_manager_ptr->get_pipeline_layout(m_light_binning_compute_pipeline_id);
     }
 
 }
@@ -58,15 +75,99 @@ float Engine::getAspect()
 {
     return (float)m_width / m_height;
 }
+
+void Engine::set_startup_options(const EngineStartupOptions& options)
+{
+    s_startup_options = options;
+    s_startup_options.num_lights = std::min(options.num_lights, uint(MAX_LIGHTS));
+}
+
+const char* Engine::get_cluster_binning_name(ClusterBinning binning)
+{
+    switch (binning)
+    {
+    case ClusterBinning::COMPUTE:
+        return "compute";
+    case ClusterBinning::CPU:
+        return "cpu";
+    default:
+        return "raster";
+    }
+}
+
+const char* Engine::get_cluster_occupancy_name(ClusterOccupancy mode)
+{
+    switch (mode)
+    {
+    case ClusterOccupancy::STATS:
+        return "stats";
+    case ClusterOccupancy::HEATMAP:
+        return "heatmap";
+    default:
+        return "off";
+    }
+}
 #pragma endregion
 
-#pragma region ʼ
+#pragma region 初始化
 Engine::Engine()
     :m_n_last_semaphore_used           (0),
      m_is_full_screen                  (false),
+     m_gpu_decal_culling               (GPU_DECAL_CULLING),
+     m_subgroup_cluster_atomics        (false),
+     m_conservative_cluster_raster     (false),
+     m_deferred_decal_cache            (s_startup_options.deferred_decal_cache),
+     m_deferred_decal_cache_active     (false),
+     m_scalarized_decal_loop           (false),
+     m_tile_classification             (s_startup_options.tile_classification),
+     m_num_lights                      (s_startup_options.num_lights),
+     m_cluster_binning                 (s_startup_options.cluster_binning),
+     m_cluster_decal_generation        (0),
+     m_cluster_state_valid             (false),
+     m_reuse_clusters                  (false),
+     m_cluster_occupancy               (s_startup_options.cluster_occupancy),
+     m_cluster_autotune_active         (false),
+     m_cluster_autotune_index          (0),
+     m_cluster_autotune_frame          (0),
+     m_cluster_autotune_camera_position(0.0f),
+     m_cluster_autotune_camera_yaw     (0.0f),
+     m_cluster_autotune_camera_pitch   (0.0f),
+     m_tile_size                       (Tile_Size),
+     m_num_z_tiles                     (NUM_Z_TILES),
+     m_cluster_config_generation       (0),
+     m_title_elapsed                   (0.0f),
+     m_title_frames                    (0),
+     m_title_reused_frames             (0),
+     m_title_gpu_ms                    (0.0),
+     m_title_gpu_samples               (0),
+     m_title_total_evicted             (0),
+     m_title_generation                (0),
+     m_gpu_timer                       (nullptr),
+     m_z_slicing                       (Z_SLICING),
+     m_tile_depth_bounds               (TILE_DEPTH_BOUNDS),
+     m_n_frame                         (0),
+     m_picking_age                     (0),
+     m_cluster_buffer_size             (0),
+     m_cluster_buffer_capacity         (0),
+     m_cluster_reference               (nullptr),
+     m_cluster_upload_buffer_capacity  (0),
+     m_tile_depth_bounds_buffer_size   (0),
+     m_tile_depth_bounds_buffer_capacity(0),
+     m_cluster_headers_buffer_size     (0),
+     m_cluster_headers_buffer_capacity (0),
+     m_cluster_indices_buffer_size     (0),
+     m_cluster_indices_buffer_capacity (0),
+     m_cluster_occupancy_buffer_size   (0),
+     m_tile_classification_buffer_size (0),
+     m_tile_classification_buffer_capacity(0),
+     m_light_buffer_size               (0),
+     m_light_cluster_buffer_size       (0),
+     m_light_cluster_buffer_capacity   (0),
      m_width                           (1280),
      m_height                          (720),
-     m_n_decal                         (0)
+     m_render_width                    (1280),
+     m_render_height                   (720),
+     m_render_scale                    (RENDER_SCALE)
 {
     // ..
 }
@@ -80,12 +181,31 @@ void Engine::init()
     m_appsettings = AppSettings();
     
     init_vulkan();
+    m_gpu_timer = new GpuTimer(m_device_ptr.get());
     init_window();
     init_swapchain();
 
 
     m_model = make_shared<Model>("assets/models/Sponza/Sponza.fbx");
+    m_decals = make_shared<DecalStore>();
+    update_max_decals();
+    load_startup_decals();
     make_box(2);
+
+    //启动参数都在第一次记录指令缓冲之前生效：自动调优的第一组配置直接写入，不再等待设备空闲后重建
+    if (s_startup_options.autotune_clusters ? collect_cluster_autotune_configs() : s_startup_options.compare_deferred_variants && collect_deferred_variant_configs())
+    {
+        const ClusterAutotuneResult& config = m_cluster_autotune_results[0];
+        begin_cluster_autotune();
+        m_tile_size = config.tile_size;
+        m_num_z_tiles = config.num_z_tiles;
+        m_num_x_tiles = (m_render_width + m_tile_size - 1) / m_tile_size;
+        m_num_y_tiles = (m_render_height + m_tile_size - 1) / m_tile_size;
+        update_max_decals();
+        m_deferred_decal_cache = config.deferred_decal_cache;
+        m_scalarized_decal_loop = config.scalarized_decal_loop;
+    }
+
     init_buffers();
     init_image();
     init_sampler();
@@ -138,6 +258,40 @@ void Engine::init_vulkan()
 
         m_device_ptr = SGPUDevice::create(move(create_info_ptr));
     }
+
+    m_subgroup_cluster_atomics = SUBGROUP_CLUSTER_ATOMICS && is_subgroup_supported(
+        ShaderStageFlagBits::FRAGMENT_BIT,
+        SubgroupFeatureFlagBits::BASIC_BIT | SubgroupFeatureFlagBits::BALLOT_BIT | SubgroupFeatureFlagBits::ARITHMETIC_BIT);
+    m_scalarized_decal_loop = s_startup_options.scalarized_decal_loop && is_subgroup_supported(
+        ShaderStageFlagBits::COMPUTE_BIT,
+        SubgroupFeatureFlagBits::BASIC_BIT | SubgroupFeatureFlagBits::ARITHMETIC_BIT);
+    if (s_startup_options.scalarized_decal_loop && !m_scalarized_decal_loop)
+    {
+        cout << "Scalarized decal loop is not supported on this device" << endl;
+    }
+    //扩展默认在可用时启用；不支持时tile分辨率下会漏掉不覆盖tile中心的小三角形，只能退回全分辨率光栅化
+    m_conservative_cluster_raster = CONSERVATIVE_CLUSTER_RASTER && m_device_ptr->get_extension_info()->ext_conservative_rasterization();
+}
+
+bool Engine::is_subgroup_supported(ShaderStageFlagBits stage, SubgroupFeatureFlags required_operations)
+{
+    //子组操作与SPIR-V 1.3都要求实例和设备均为Vulkan 1.1
+    if (m_instance_ptr->get_api_version() != APIVersion::_1_1 ||
+        m_device_ptr->get_physical_device_properties().core_vk1_0_properties_ptr->api_version < VK_MAKE_VERSION(1, 1, 0))
+    {
+        return false;
+    }
+
+    //子组属性属于Vulkan 1.1，1.0的设备上为空
+    const auto* vk11_properties_ptr = m_device_ptr->get_physical_device_properties().core_vk1_1_properties_ptr;
+    if (vk11_properties_ptr == nullptr)
+    {
+        return false;
+    }
+
+    const SubgroupProperties& subgroup_properties = vk11_properties_ptr->subgroup_properties;
+    return (subgroup_properties.supported_stages & stage) == stage
+        && (subgroup_properties.supported_operations & required_operations) == required_operations;
 }
 
 void Engine::init_window()
@@ -226,14 +380,16 @@ void Engine::init_swapchain()
         Format::B8G8R8A8_UNORM,
         ColorSpaceKHR::SRGB_NONLINEAR_KHR,
         PresentModeKHR::FIFO_KHR,
-        ImageUsageFlagBits::COLOR_ATTACHMENT_BIT | ImageUsageFlagBits::STORAGE_BIT,
+        ImageUsageFlagBits::COLOR_ATTACHMENT_BIT | ImageUsageFlagBits::STORAGE_BIT | ImageUsageFlagBits::TRANSFER_DST_BIT,
         N_SWAPCHAIN_IMAGES);
 
     m_swapchain_ptr->set_name("Main swapchain");
     m_width = m_swapchain_ptr->get_width();
     m_height = m_swapchain_ptr->get_height();
-    m_num_x_tiles = (m_width + Tile_Size - 1) / Tile_Size;
-    m_num_y_tiles = (m_height + Tile_Size - 1) / Tile_Size;
+    m_render_width = std::max(1, static_cast<int>(m_width * m_render_scale + 0.5f));
+    m_render_height = std::max(1, static_cast<int>(m_height * m_render_scale + 0.5f));
+    m_num_x_tiles = (m_render_width + m_tile_size - 1) / m_tile_size;
+    m_num_y_tiles = (m_render_height + m_tile_size - 1) / m_tile_size;
 
     /* Cache the queue we are going to use for presentation */
     const vector<uint32_t>* present_queue_fams_ptr = nullptr;
@@ -257,7 +413,7 @@ void Engine::init_buffers()
     const auto ub_data_alignment_requirement = 
         m_device_ptr->get_physical_device_properties().core_vk1_0_properties_ptr->limits.min_uniform_buffer_offset_alignment;
     
-    #pragma region texture_indices
+    #pragma region 创建texture_indices缓冲
     {
         auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
 
@@ -286,83 +442,264 @@ void Engine::init_buffers()
     }
     #pragma endregion
 
-    #pragma region decal
+    #pragma region 创建cluster缓冲
+    init_cluster_buffer();
+    #pragma endregion
+
+    #pragma region 创建picking缓冲
     {
         auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
 
-        m_decals_buffer_size = Utils::round_up(
-            sizeof(Decal) * N_MAX_STORED_DECALS,
-            ub_data_alignment_requirement);
+        m_picking_buffer_size = Utils::round_up(sizeof(PickingStorage), ub_data_alignment_requirement);
+
         auto create_info_ptr = BufferCreateInfo::create_no_alloc(
             m_device_ptr.get(),
-            m_decals_buffer_size,
+            m_picking_buffer_size,
             QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
             SharingMode::EXCLUSIVE,
             BufferCreateFlagBits::NONE,
-            BufferUsageFlagBits::UNIFORM_BUFFER_BIT);
-        m_decals_uniform_buffer_ptr = Buffer::create(move(create_info_ptr));
-        m_decals_uniform_buffer_ptr->set_name_formatted("Decal unfiorm buffer");
+            BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_SRC_BIT);
+        m_picking_storage_buffer_ptr = Buffer::create(move(create_info_ptr));
+        m_picking_storage_buffer_ptr->set_name("Picking storage buffer");
 
         allocator_ptr->add_buffer(
-            m_decals_uniform_buffer_ptr.get(),
+            m_picking_storage_buffer_ptr.get(),
             MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
+
+        //每帧把结果拷贝到读回环中，CPU取已完成的最新一帧，不再同步读取
+        m_picking_readback = new ReadbackRing<PickingStorage>(m_device_ptr.get(), "Picking");
     }
     #pragma endregion
 
-    #pragma region cluster
+    #pragma region 创建cluster占用统计缓冲
     {
         auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
 
-        m_cluster_buffer_size = Utils::round_up(sizeof(ClusterStorage), ub_data_alignment_requirement);
+        m_cluster_occupancy_buffer_size = Utils::round_up(sizeof(ClusterOccupancyStats), ub_data_alignment_requirement);
 
         auto create_info_ptr = BufferCreateInfo::create_no_alloc(
             m_device_ptr.get(),
-            m_cluster_buffer_size,
+            m_cluster_occupancy_buffer_size,
             QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
             SharingMode::EXCLUSIVE,
             BufferCreateFlagBits::NONE,
-            BufferUsageFlagBits::STORAGE_BUFFER_BIT);
-        m_cluster_storage_buffer_ptr = Buffer::create(move(create_info_ptr));
-        m_cluster_storage_buffer_ptr->set_name("Cluster storage buffer");
+            BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_SRC_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT);
+        m_cluster_occupancy_buffer_ptr = Buffer::create(move(create_info_ptr));
+        m_cluster_occupancy_buffer_ptr->set_name("Cluster occupancy buffer");
 
         allocator_ptr->add_buffer(
-            m_cluster_storage_buffer_ptr.get(),
+            m_cluster_occupancy_buffer_ptr.get(),
             MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
+
+        //与picking一样经读回环取回，统计关闭时不记录拷贝
+        m_cluster_occupancy_readback = new ReadbackRing<ClusterOccupancyStats>(m_device_ptr.get(), "Cluster occupancy");
     }
     #pragma endregion
 
-    #pragma region picking
+    #pragma region 创建灯光缓冲
     {
         auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
 
-        m_picking_buffer_size = Utils::round_up(sizeof(PickingStorage), ub_data_alignment_requirement);
+        //按上限分配，灯光数写在缓冲开头
+        m_light_buffer_size = sizeof(LightStorage);
 
         auto create_info_ptr = BufferCreateInfo::create_no_alloc(
             m_device_ptr.get(),
-            m_picking_buffer_size,
+            m_light_buffer_size,
             QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
             SharingMode::EXCLUSIVE,
             BufferCreateFlagBits::NONE,
             BufferUsageFlagBits::STORAGE_BUFFER_BIT);
-        m_picking_storage_buffer_ptr = Buffer::create(move(create_info_ptr));
-        m_picking_storage_buffer_ptr->set_name("Picking storage buffer");
+        m_light_buffer_ptr = Buffer::create(move(create_info_ptr));
+        m_light_buffer_ptr->set_name("Light storage buffer");
 
         allocator_ptr->add_buffer(
-            m_picking_storage_buffer_ptr.get(),
+            m_light_buffer_ptr.get(),
             MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
+
+        init_lights();
     }
     #pragma endregion
 
-    #pragma region ̬
+    #pragma region 创建动态缓冲
     m_mvp_dynamic_buffer_helper = new DynamicBufferHelper<MVPUniform>(m_device_ptr.get(), "MVP");
     m_sunLight_dynamic_buffer_helper = new DynamicBufferHelper<SunLightUniform>(m_device_ptr.get(), "SunLight");
     m_camera_dynamic_buffer_helper = new DynamicBufferHelper<CameraUniform>(m_device_ptr.get(), "Camera");
     m_cursor_decal_dynamic_buffer_helper = new DynamicBufferHelper<CursorDecal>(m_device_ptr.get(), "CursorDecal");
-    m_decal_indices_dynamic_buffer_helper = new DynamicBufferHelper<IndexUniform>(m_device_ptr.get(), "Decal Indices", false);
-    m_decal_ZBounds_dynamic_buffer_helper = new DynamicBufferHelper<ZBoundsUniform>(m_device_ptr.get(), "Decal ZBounds", false);
+    m_decal_indices_dynamic_buffer_helper = new DynamicBufferHelper<uint>(m_device_ptr.get(), "Decal Indices", false, m_decals->get_capacity() + 1, BufferUsageFlagBits::TRANSFER_DST_BIT);
+    m_decal_ZBounds_dynamic_buffer_helper = new DynamicBufferHelper<uvec2>(m_device_ptr.get(), "Decal ZBounds", false, m_decals->get_capacity());
+    m_cluster_draw_commands_dynamic_buffer_helper = new DynamicBufferHelper<VkDrawIndexedIndirectCommand>(
+        m_device_ptr.get(),
+        "Cluster Draw Commands",
+        false,
+        3, /* n_elements：三个cluster子流程各一个 */
+        BufferUsageFlagBits::INDIRECT_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT);
+    m_decal_culling_dynamic_buffer_helper = new DynamicBufferHelper<DecalCullingUniform>(m_device_ptr.get(), "Decal Culling");
     #pragma endregion
 }
 
+void Engine::init_cluster_buffer()
+{
+    //按渲染分辨率的tile数和贴花容量计算所需大小，只有超过已分配的大小时才重新分配，
+    //分辨率变小或切换回较小的窗口时沿用原缓冲，只清空和绑定实际使用的部分
+    //调用前需确保设备空闲
+    const auto ub_data_alignment_requirement =
+        m_device_ptr->get_physical_device_properties().core_vk1_0_properties_ptr->limits.min_uniform_buffer_offset_alignment;
+
+    m_elements_per_cluster = (m_decals->get_capacity() + 31) / 32;
+
+    m_cluster_constants.near_clip = m_camera->GetNearZ();
+    m_cluster_constants.far_clip = m_camera->GetFarZ();
+    m_cluster_constants.num_x_tiles = m_num_x_tiles;
+    m_cluster_constants.num_y_tiles = m_num_y_tiles;
+    m_cluster_constants.num_z_tiles = m_num_z_tiles;
+    m_cluster_constants.elements_per_cluster = m_elements_per_cluster;
+    m_cluster_constants.tile_size = m_tile_size;
+    m_cluster_constants.z_slicing = uint(m_z_slicing);
+
+    m_tile_depth_bounds_buffer_size = Utils::round_up(VkDeviceSize(sizeof(uvec2) * m_num_x_tiles * m_num_y_tiles), ub_data_alignment_requirement);
+    reserve_storage_buffer(m_tile_depth_bounds_buffer_ptr, m_tile_depth_bounds_buffer_size, m_tile_depth_bounds_buffer_capacity,
+        BufferUsageFlagBits::STORAGE_BUFFER_BIT, "Tile depth bounds buffer");
+
+    m_cluster_buffer_size = Utils::round_up(ClusterStorage::get_size(m_elements_per_cluster, m_num_x_tiles, m_num_y_tiles, m_num_z_tiles), ub_data_alignment_requirement);
+    //超过绑定范围或显存预算时不分配；放置、加载贴花与切换cluster划分之前都按get_max_cluster_decals检查过，这里只会在窗口变大时触发
+    if (m_cluster_buffer_size > get_cluster_storage_limit())
+    {
+        throw runtime_error("cluster storage exceeds maxStorageBufferRange or the memory budget, use a larger tile size or fewer decals");
+    }
+    reserve_storage_buffer(m_cluster_storage_buffer_ptr, m_cluster_buffer_size, m_cluster_buffer_capacity,
+        BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_SRC_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT, "Cluster storage buffer");
+
+    //CPU分组：每张交换链图像一段主机可见的上传区，update_data写入位掩码，指令缓冲再拷贝到cluster缓冲
+    if (m_cluster_binning == ClusterBinning::CPU)
+    {
+        delete m_cluster_reference;
+        m_cluster_reference = new ClusterReference(m_cluster_constants, m_render_width, m_render_height);
+
+        if (m_cluster_upload_buffer_ptr == nullptr || m_cluster_buffer_size * N_SWAPCHAIN_IMAGES > m_cluster_upload_buffer_capacity)
+        {
+            m_cluster_upload_buffer_capacity = m_cluster_buffer_size * N_SWAPCHAIN_IMAGES;
+
+            auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
+            auto create_info_ptr = BufferCreateInfo::create_no_alloc(
+                m_device_ptr.get(),
+                m_cluster_upload_buffer_capacity,
+                QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
+                SharingMode::EXCLUSIVE,
+                BufferCreateFlagBits::NONE,
+                BufferUsageFlagBits::TRANSFER_SRC_BIT);
+            m_cluster_upload_buffer_ptr = Buffer::create(move(create_info_ptr));
+            m_cluster_upload_buffer_ptr->set_name_formatted("Cluster upload buffer (%llu bytes)", static_cast<unsigned long long>(m_cluster_upload_buffer_capacity));
+
+            allocator_ptr->add_buffer(
+                m_cluster_upload_buffer_ptr.get(),
+                MemoryFeatureFlagBits::MAPPABLE_BIT | MemoryFeatureFlagBits::HOST_COHERENT_BIT); /* in_required_memory_features */
+        }
+    }
+
+    m_cluster_headers_buffer_size = Utils::round_up(ClusterStorage::get_headers_size(m_num_x_tiles, m_num_y_tiles, m_num_z_tiles), ub_data_alignment_requirement);
+    reserve_storage_buffer(m_cluster_headers_buffer_ptr, m_cluster_headers_buffer_size, m_cluster_headers_buffer_capacity,
+        BufferUsageFlagBits::STORAGE_BUFFER_BIT, "Cluster headers buffer");
+
+    //绑定大小不按对齐取整，clusterCompaction.comp用.length()得到的容量与实际分配的索引数一致
+    m_cluster_indices_buffer_size = ClusterStorage::get_indices_size(m_num_x_tiles, m_num_y_tiles, m_num_z_tiles);
+    reserve_storage_buffer(m_cluster_indices_buffer_ptr, m_cluster_indices_buffer_size, m_cluster_indices_buffer_capacity,
+        BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT, "Cluster indices buffer");
+
+    m_tile_classification_buffer_size = Utils::round_up(TileClassificationStorage::get_size(m_num_x_tiles, m_num_y_tiles), ub_data_alignment_requirement);
+    reserve_storage_buffer(m_tile_classification_buffer_ptr, m_tile_classification_buffer_size, m_tile_classification_buffer_capacity,
+        BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::INDIRECT_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT, "Tile classification buffer");
+
+    //灯光位掩码的大小与贴花容量无关，只随tile数和z分片数变化
+    m_light_cluster_buffer_size = Utils::round_up(ClusterStorage::get_size(LightStorage::ELEMENTS_PER_CLUSTER, m_num_x_tiles, m_num_y_tiles, m_num_z_tiles), ub_data_alignment_requirement);
+    reserve_storage_buffer(m_light_cluster_buffer_ptr, m_light_cluster_buffer_size, m_light_cluster_buffer_capacity,
+        BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT, "Light cluster buffer");
+}
+
+void Engine::init_lights()
+{
+    //在Sponza中庭与两侧回廊的范围内随机放置，固定种子保证每次启动的灯光相同；每4盏中有1盏朝下的聚光灯
+    mt19937 random_engine(1234);
+    uniform_real_distribution<float> random_x(-13.0f, 12.0f);
+    uniform_real_distribution<float> random_y(0.3f, 9.0f);
+    uniform_real_distribution<float> random_z(-5.5f, 5.0f);
+    uniform_real_distribution<float> random_color(0.2f, 1.0f);
+    uniform_real_distribution<float> random_intensity(2.0f, 6.0f);
+    uniform_real_distribution<float> random_range(1.5f, 4.0f);
+    uniform_real_distribution<float> random_tilt(-0.3f, 0.3f);
+    uniform_real_distribution<float> random_angle(0.35f, 0.8f);
+
+    unique_ptr<LightStorage> storage(new LightStorage());
+    storage->num_lights = m_num_lights;
+    for (uint32_t n = 0; n < m_num_lights; n++)
+    {
+        Light& light = storage->lights[n];
+        const LightType type = n % 4 == 3 ? LightType::SPOT : LightType::POINT;
+        const vec3 color = vec3(random_color(random_engine), random_color(random_engine), random_color(random_engine)) * random_intensity(random_engine);
+
+        light.position = vec4(random_x(random_engine), random_y(random_engine), random_z(random_engine), random_range(random_engine));
+        light.color = vec4(color, float(type));
+        light.direction = vec4(0.0f, -1.0f, 0.0f, 1.0f);
+        light.cone = vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        if (type == LightType::SPOT)
+        {
+            const float outer_angle = random_angle(random_engine);
+            light.position.w *= 2.0f;
+            light.direction = vec4(normalize(vec3(random_tilt(random_engine), -1.0f, random_tilt(random_engine))), cos(outer_angle));
+            light.cone.x = cos(outer_angle * 0.7f);
+        }
+    }
+
+    m_light_buffer_ptr->write(
+        0, /* start_offset */
+        m_light_buffer_size,
+        storage.get(),
+        m_device_ptr->get_universal_queue(0));
+}
+
+void Engine::reserve_storage_buffer(BufferUniquePtr& buffer_ptr, VkDeviceSize size, VkDeviceSize& capacity, BufferUsageFlags usage, const char* name)
+{
+    //只有超过已分配的大小时才重新分配，调用前需确保设备空闲
+    if (buffer_ptr != nullptr && size <= capacity)
+    {
+        return;
+    }
+    capacity = size;
+
+    auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
+    auto create_info_ptr = BufferCreateInfo::create_no_alloc(
+        m_device_ptr.get(),
+        capacity,
+        QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
+        SharingMode::EXCLUSIVE,
+        BufferCreateFlagBits::NONE,
+        usage);
+    buffer_ptr = Buffer::create(move(create_info_ptr));
+    buffer_ptr->set_name_formatted("%s (%llu bytes)", name, static_cast<unsigned long long>(capacity));
+
+    allocator_ptr->add_buffer(
+        buffer_ptr.get(),
+        MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
+}
+
+void Engine::add_cluster_specialization_constants(ComputePipelineCreateInfo* create_info_ptr)
+{
+    const uint32_t* data_ptr = reinterpret_cast<const uint32_t*>(&m_cluster_constants);
+    for (uint32_t i = 0; i < ClusterConstants::CONSTANT_COUNT; i++)
+    {
+        create_info_ptr->add_specialization_constant(ClusterConstants::CONSTANT_ID_BASE + i, 4, data_ptr + i);
+    }
+}
+
+void Engine::add_cluster_specialization_constants(GraphicsPipelineCreateInfo* create_info_ptr, ShaderStage stage)
+{
+    const uint32_t* data_ptr = reinterpret_cast<const uint32_t*>(&m_cluster_constants);
+    for (uint32_t i = 0; i < ClusterConstants::CONSTANT_COUNT; i++)
+    {
+        create_info_ptr->add_specialization_constant(stage, ClusterConstants::CONSTANT_ID_BASE + i, 4, data_ptr + i);
+    }
+}
+
 void Engine::init_image()
 {
     auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr.get());
@@ -378,6 +715,55 @@ void Engine::init_image()
     create_image_source(m_uv_and_depth_gradient_image_ptr, m_uv_and_depth_gradient_image_view_ptr, "UV and Depth Gradient", Format::R16G16B16A16_SNORM);
     create_image_source(m_uv_gradient_image_ptr, m_uv_gradient_image_view_ptr, "UV Gradient", Format::R16G16B16A16_SNORM);
     create_image_source(m_material_id_image_ptr, m_material_id_image_view_ptr, "Material ID", Format::R8_UINT);
+
+    #pragma region 渲染分辨率与交换链不同时，deferred先写入场景颜色图像
+    if (is_render_scaled())
+    {
+        auto image_create_info_ptr = ImageCreateInfo::create_no_alloc(
+            m_device_ptr.get(),
+            ImageType::_2D,
+            Format::R8G8B8A8_UNORM,
+            ImageTiling::OPTIMAL,
+            ImageUsageFlagBits::STORAGE_BIT | ImageUsageFlagBits::TRANSFER_SRC_BIT,
+            m_render_width,
+            m_render_height,
+            1,
+            1,
+            SampleCountFlagBits::_1_BIT,
+            QueueFamilyFlagBits::COMPUTE_BIT | QueueFamilyFlagBits::GRAPHICS_BIT,
+            SharingMode::EXCLUSIVE,
+            false,
+            ImageCreateFlagBits::NONE,
+            ImageLayout::GENERAL);
+
+        m_scene_color_image_ptr = Image::create(move(image_create_info_ptr));
+        m_scene_color_image_ptr->set_name("Scene Color Image");
+
+        allocator_ptr->add_image_whole(
+            m_scene_color_image_ptr.get(),
+            MemoryFeatureFlagBits::DEVICE_LOCAL_BIT);
+
+        auto image_view_create_info_ptr = ImageViewCreateInfo::create_2D(
+            m_device_ptr.get(),
+            m_scene_color_image_ptr.get(),
+            0,
+            0,
+            1,
+            ImageAspectFlagBits::COLOR_BIT,
+            Format::R8G8B8A8_UNORM,
+            ComponentSwizzle::R,
+            ComponentSwizzle::G,
+            ComponentSwizzle::B,
+            ComponentSwizzle::A);
+
+        m_scene_color_image_view_ptr = ImageView::create(move(image_view_create_info_ptr));
+    }
+    #pragma endregion
+}
+
+bool Engine::is_render_scaled()
+{
+    return m_render_width != m_width || m_render_height != m_height;
 }
 
 void Engine::init_sampler()
@@ -404,10 +790,10 @@ void Engine::init_sampler()
 
 void Engine::init_dsgs()
 {
-    #pragma region Ⱥ
+    #pragma region 创建描述符集群
     auto dsg_create_info_ptrs = vector<DescriptorSetCreateInfoUniquePtr>(11);
 
-    #pragma region 0:
+    #pragma region 0:材质索引及其所有纹理
     dsg_create_info_ptrs[0] = DescriptorSetCreateInfo::create();
     dsg_create_info_ptrs[0]->add_binding(
         0, /* n_binding */
@@ -419,6 +805,16 @@ void Engine::init_dsgs()
         DescriptorType::COMBINED_IMAGE_SAMPLER,
         m_model->get_texture_num(), /* n_elements */
         ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[0]->add_binding(
+        2, /* n_binding：贴花albedo纹理数组 */
+        DescriptorType::COMBINED_IMAGE_SAMPLER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[0]->add_binding(
+        3, /* n_binding：贴花法线纹理数组 */
+        DescriptorType::COMBINED_IMAGE_SAMPLER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
 
     #pragma region 1:MVP
@@ -430,7 +826,7 @@ void Engine::init_dsgs()
         ShaderStageFlagBits::VERTEX_BIT | ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
 
-    #pragma region 2:deferredĲ
+    #pragma region 2:deferred所需的参数
     dsg_create_info_ptrs[2] = DescriptorSetCreateInfo::create();
     dsg_create_info_ptrs[2]->add_binding(
         0, /* n_binding */
@@ -459,7 +855,7 @@ void Engine::init_dsgs()
         ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
 
-    #pragma region 3:deferredȡGBuffer
+    #pragma region 3:用于deferred读取的GBuffer
     dsg_create_info_ptrs[3] = DescriptorSetCreateInfo::create();
     for (int i = 0; i < 5; i++)
     {
@@ -471,7 +867,7 @@ void Engine::init_dsgs()
     }
     #pragma endregion
 
-    #pragma region 4:ͼ
+    #pragma region 4:交换链图像
     for (int i = 4; i < 4 + N_SWAPCHAIN_IMAGES; i++)
     {
         dsg_create_info_ptrs[i] = DescriptorSetCreateInfo::create();
@@ -483,7 +879,7 @@ void Engine::init_dsgs()
     }
     #pragma endregion
 
-    #pragma region 5:pickingĲ
+    #pragma region 5:picking所需的参数
     dsg_create_info_ptrs[4 + N_SWAPCHAIN_IMAGES] = DescriptorSetCreateInfo::create();
     dsg_create_info_ptrs[4 + N_SWAPCHAIN_IMAGES]->add_binding(
         0, /* n_binding */
@@ -510,38 +906,88 @@ void Engine::init_dsgs()
         DescriptorType::COMBINED_IMAGE_SAMPLER,
         1, /* n_elements */
         ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[4 + N_SWAPCHAIN_IMAGES]->add_binding(
+        5, /* n_binding */
+        DescriptorType::UNIFORM_BUFFER_DYNAMIC,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
     
-    #pragma region 6:
+    #pragma region 6:贴花
     dsg_create_info_ptrs[5 + N_SWAPCHAIN_IMAGES] = DescriptorSetCreateInfo::create();
     dsg_create_info_ptrs[5 + N_SWAPCHAIN_IMAGES]->add_binding(
         0, /* n_binding */
-        DescriptorType::UNIFORM_BUFFER,
+        DescriptorType::STORAGE_BUFFER,
         1, /* n_elements */
         ShaderStageFlagBits::VERTEX_BIT | ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
 
-    #pragma region 7:cluster
+    #pragma region 7:cluster所需数据
     dsg_create_info_ptrs[6 + N_SWAPCHAIN_IMAGES] = DescriptorSetCreateInfo::create();
     dsg_create_info_ptrs[6 + N_SWAPCHAIN_IMAGES]->add_binding(
         0, /* n_binding */
         DescriptorType::STORAGE_BUFFER_DYNAMIC,
         1, /* n_elements */
-        ShaderStageFlagBits::VERTEX_BIT);
+        ShaderStageFlagBits::VERTEX_BIT | ShaderStageFlagBits::COMPUTE_BIT);
     dsg_create_info_ptrs[6 + N_SWAPCHAIN_IMAGES]->add_binding(
         1, /* n_binding */
         DescriptorType::STORAGE_BUFFER_DYNAMIC,
         1, /* n_elements */
-        ShaderStageFlagBits::FRAGMENT_BIT);
+        ShaderStageFlagBits::FRAGMENT_BIT | ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[6 + N_SWAPCHAIN_IMAGES]->add_binding(
+        2, /* n_binding */
+        DescriptorType::STORAGE_BUFFER_DYNAMIC,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[6 + N_SWAPCHAIN_IMAGES]->add_binding(
+        3, /* n_binding */
+        DescriptorType::UNIFORM_BUFFER_DYNAMIC,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
 
-    #pragma region 8:cluster
+    #pragma region 8:cluster结果
     dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES] = DescriptorSetCreateInfo::create();
     dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
         0, /* n_binding */
         DescriptorType::STORAGE_BUFFER,
         1, /* n_elements */
         ShaderStageFlagBits::FRAGMENT_BIT | ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        1, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        2, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        3, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        4, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        5, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        6, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
+    dsg_create_info_ptrs[7 + N_SWAPCHAIN_IMAGES]->add_binding(
+        7, /* n_binding */
+        DescriptorType::STORAGE_BUFFER,
+        1, /* n_elements */
+        ShaderStageFlagBits::COMPUTE_BIT);
     #pragma endregion
 
     m_dsg_ptr = DescriptorSetGroup::create(
@@ -549,26 +995,34 @@ void Engine::init_dsgs()
         dsg_create_info_ptrs);
     #pragma endregion
 
-    #pragma region Ϊ󶨾Դ
+    #pragma region 为描述符集绑定具体资源
 
-    #pragma region 0:
+    #pragma region 0:材质索引及其所有纹理
     m_dsg_ptr->set_binding_item(
-        0, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        0, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::UniformBufferBindingElement(
             m_texture_indices_uniform_buffer_ptr.get()));
     m_dsg_ptr->set_binding_array_items(
-        0, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        0, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         1, /* n_binding */
         BindingElementArrayRange(
             0,                                  /* StartBindingElementIndex */
             m_texture_combined_image_samplers_binding.size()),  /* NumberOfBindingElements  */
         m_texture_combined_image_samplers_binding.data());
+    m_dsg_ptr->set_binding_item(
+        0, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        2, /* n_binding */
+        m_model->get_decal_atlas()->get_albedo_binding());
+    m_dsg_ptr->set_binding_item(
+        0, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        3, /* n_binding */
+        m_model->get_decal_atlas()->get_normal_binding());
     #pragma endregion
 
     #pragma region 1:MVP
     m_dsg_ptr->set_binding_item(
-        1, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        1, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::DynamicUniformBufferBindingElement(
             m_mvp_dynamic_buffer_helper->getBuffer(),
@@ -576,16 +1030,16 @@ void Engine::init_dsgs()
             m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage()));
     #pragma endregion
 
-    #pragma region 2:deferredĲ
+    #pragma region 2:deferred所需的参数
     m_dsg_ptr->set_binding_item(
-        2, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        2, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::DynamicUniformBufferBindingElement(
             m_mvp_dynamic_buffer_helper->getBuffer(),
             0, /* in_start_offset */
             m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage()));
     m_dsg_ptr->set_binding_item(
-        2, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        2, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         1, /* n_binding */
         DescriptorSet::DynamicUniformBufferBindingElement(
             m_sunLight_dynamic_buffer_helper->getBuffer(),
@@ -593,7 +1047,7 @@ void Engine::init_dsgs()
             m_sunLight_dynamic_buffer_helper->getSizePerSwapchainImage()));
 
     m_dsg_ptr->set_binding_item(
-        2, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        2, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         2, /* n_binding */
         DescriptorSet::DynamicUniformBufferBindingElement(
             m_camera_dynamic_buffer_helper->getBuffer(),
@@ -601,7 +1055,7 @@ void Engine::init_dsgs()
             m_camera_dynamic_buffer_helper->getSizePerSwapchainImage()));
 
     m_dsg_ptr->set_binding_item(
-        2, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        2, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         3, /* n_binding */
         DescriptorSet::StorageBufferBindingElement(
             m_picking_storage_buffer_ptr.get(),
@@ -609,7 +1063,7 @@ void Engine::init_dsgs()
             m_picking_buffer_size));
 
     m_dsg_ptr->set_binding_item(
-        2, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        2, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         4, /* n_binding */
         DescriptorSet::DynamicUniformBufferBindingElement(
             m_cursor_decal_dynamic_buffer_helper->getBuffer(),
@@ -617,9 +1071,9 @@ void Engine::init_dsgs()
             m_cursor_decal_dynamic_buffer_helper->getSizePerSwapchainImage()));
     #pragma endregion
 
-    #pragma region 3:deferredȡGBuffer
+    #pragma region 3:用于deferred读取的GBuffer
     m_dsg_ptr->set_binding_item(
-        3, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        3, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
@@ -627,7 +1081,7 @@ void Engine::init_dsgs()
             m_sampler.get()));
     
     m_dsg_ptr->set_binding_item(
-        3, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        3, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         1, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
@@ -635,7 +1089,7 @@ void Engine::init_dsgs()
             m_sampler.get()));
 
     m_dsg_ptr->set_binding_item(
-        3, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        3, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         2, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
@@ -643,7 +1097,7 @@ void Engine::init_dsgs()
             m_sampler.get()));
 
     m_dsg_ptr->set_binding_item(
-        3, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        3, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         3, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
@@ -651,7 +1105,7 @@ void Engine::init_dsgs()
             m_sampler.get()));
 
     m_dsg_ptr->set_binding_item(
-        3, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        3, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         4, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
@@ -659,91 +1113,177 @@ void Engine::init_dsgs()
             m_sampler.get()));
     #pragma endregion
 
-    #pragma region 4:ͼ
+    #pragma region 4:交换链图像
     for (int i = 0; i < N_SWAPCHAIN_IMAGES; i++)
     {
         m_dsg_ptr->set_binding_item(
-            4 + i, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+            4 + i, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
             0, /* n_binding */
             DescriptorSet::StorageImageBindingElement(
                 ImageLayout::GENERAL,
-                m_swapchain_ptr->get_image_view(i)));
+                is_render_scaled() ? m_scene_color_image_view_ptr.get() : m_swapchain_ptr->get_image_view(i)));
     }
     #pragma endregion
     
-    #pragma region 5:pickingĲGBuffer
+    #pragma region 5:picking所需的参数和GBuffer
     m_dsg_ptr->set_binding_item(
-        4 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        4 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::StorageBufferBindingElement(
             m_picking_storage_buffer_ptr.get(),
             0, /* in_start_offset */
             m_picking_buffer_size));
     m_dsg_ptr->set_binding_item(
-        4 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        4 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         1, /* n_binding */
         DescriptorSet::DynamicUniformBufferBindingElement(
             m_camera_dynamic_buffer_helper->getBuffer(),
             0, /* in_start_offset */
             m_camera_dynamic_buffer_helper->getSizePerSwapchainImage()));
     m_dsg_ptr->set_binding_item(
-        4 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        4 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         2, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
             m_depth_image_view2_ptr.get(),
             m_sampler.get()));
     m_dsg_ptr->set_binding_item(
-        4 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        4 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         3, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
             m_tangent_frame_image_view_ptr.get(),
             m_sampler.get()));
     m_dsg_ptr->set_binding_item(
-        4 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        4 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         4, /* n_binding */
         DescriptorSet::CombinedImageSamplerBindingElement(
             ImageLayout::SHADER_READ_ONLY_OPTIMAL,
             m_material_id_image_view_ptr.get(),
             m_sampler.get()));
+    m_dsg_ptr->set_binding_item(
+        4 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        5, /* n_binding */
+        DescriptorSet::DynamicUniformBufferBindingElement(
+            m_cursor_decal_dynamic_buffer_helper->getBuffer(),
+            0, /* in_start_offset */
+            m_cursor_decal_dynamic_buffer_helper->getSizePerSwapchainImage()));
+    #pragma endregion
+
+    #pragma region 6~8:贴花、cluster所需数据及cluster结果
+    bind_decal_buffers();
+    #pragma endregion
+
     #pragma endregion
+}
 
-    #pragma region 6:
+void Engine::bind_decal_buffers()
+{
+    #pragma region 6:贴花
     m_dsg_ptr->set_binding_item(
-        5 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        5 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
-        DescriptorSet::UniformBufferBindingElement(
-            m_decals_uniform_buffer_ptr.get()));
+        DescriptorSet::StorageBufferBindingElement(
+            m_decals->get_buffer(),
+            0, /* in_start_offset */
+            m_decals->get_buffer_size()));
     #pragma endregion
 
-    #pragma region 7:cluster
+    #pragma region 7:cluster所需数据
     m_dsg_ptr->set_binding_item(
-        6 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        6 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::DynamicStorageBufferBindingElement(
             m_decal_indices_dynamic_buffer_helper->getBuffer(),
             0, /* in_start_offset */
             m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage()));
     m_dsg_ptr->set_binding_item(
-        6 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        6 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         1, /* n_binding */
         DescriptorSet::DynamicStorageBufferBindingElement(
             m_decal_ZBounds_dynamic_buffer_helper->getBuffer(),
             0, /* in_start_offset */
             m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage()));
+    m_dsg_ptr->set_binding_item(
+        6 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        2, /* n_binding */
+        DescriptorSet::DynamicStorageBufferBindingElement(
+            m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+            0, /* in_start_offset */
+            m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage()));
+    m_dsg_ptr->set_binding_item(
+        6 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        3, /* n_binding */
+        DescriptorSet::DynamicUniformBufferBindingElement(
+            m_decal_culling_dynamic_buffer_helper->getBuffer(),
+            0, /* in_start_offset */
+            m_decal_culling_dynamic_buffer_helper->getSizePerSwapchainImage()));
     #pragma endregion
 
-    #pragma region 8:cluster
+    #pragma region 8:cluster结果
     m_dsg_ptr->set_binding_item(
-        7 + N_SWAPCHAIN_IMAGES, /* n_set:dsgʶڲdsg_create_info_ptrs±һһӦshaderset޹*/
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
         0, /* n_binding */
         DescriptorSet::StorageBufferBindingElement(
             m_cluster_storage_buffer_ptr.get(),
             0, /* in_start_offset */
             m_cluster_buffer_size));
-    #pragma endregion
 
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        1, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_tile_depth_bounds_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_tile_depth_bounds_buffer_size));
+
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        2, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_cluster_headers_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_cluster_headers_buffer_size));
+
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        3, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_cluster_indices_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_cluster_indices_buffer_size));
+
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        4, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_cluster_occupancy_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_cluster_occupancy_buffer_size));
+
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        5, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_tile_classification_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_tile_classification_buffer_size));
+
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        6, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_light_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_light_buffer_size));
+
+    m_dsg_ptr->set_binding_item(
+        7 + N_SWAPCHAIN_IMAGES, /* n_set:用于dsg标识内部的描述符集，与dsg_create_info_ptrs下标一一对应，与shader里的set无关*/
+        7, /* n_binding */
+        DescriptorSet::StorageBufferBindingElement(
+            m_light_cluster_buffer_ptr.get(),
+            0, /* in_start_offset */
+            m_light_cluster_buffer_size));
     #pragma endregion
 }
 
@@ -753,7 +1293,7 @@ void Engine::init_render_pass()
 {
     RenderPassCreateInfoUniquePtr render_pass_create_info_ptr(new RenderPassCreateInfo(m_device_ptr.get()));
     
-    #pragma region Ӹ
+    #pragma region 添加附件描述
     RenderPassAttachmentID 
         depth_color_attachment_id, 
         tangent_frame_color_attachment_id, 
@@ -825,7 +1365,7 @@ void Engine::init_render_pass()
         &render_pass_depth_attachment_id);
     #pragma endregion
 
-    #pragma region ΪӸ
+    #pragma region 为子流程添加附件
     {
         render_pass_create_info_ptr->add_subpass(&m_render_pass_subpass_GBuffer_id);
 
@@ -897,11 +1437,72 @@ void Engine::init_render_pass()
 void Engine::init_shaders()
 {
     m_cluster_vs_ptr.reset(create_shader("Assets/code/shader/cluster.vert", ShaderStage::VERTEX, "Cluster Vertex"));
-    m_cluster_fs_ptr.reset(create_shader("Assets/code/shader/cluster.frag", ShaderStage::FRAGMENT, "Cluster Fragment"));
+    //不支持子组操作时编译原来的逐片元原子操作版本
+    vector<string> cluster_fs_definitions;
+    if (m_subgroup_cluster_atomics)
+    {
+        cluster_fs_definitions.push_back("USE_SUBGROUP_ATOMICS");
+    }
+    if (m_conservative_cluster_raster)
+    {
+        cluster_fs_definitions.push_back("CONSERVATIVE_TILE_RASTER");
+    }
+    //子组内置函数要求SPIR-V 1.3
+    m_cluster_fs_ptr.reset(create_shader(
+        "Assets/code/shader/cluster.frag",
+        ShaderStage::FRAGMENT,
+        "Cluster Fragment",
+        cluster_fs_definitions,
+        m_subgroup_cluster_atomics ? SpvVersion::_1_3 : SpvVersion::_1_0));
     m_GBuffer_vs_ptr.reset(create_shader("Assets/code/shader/GBuffer.vert", ShaderStage::VERTEX, "GBuffer Vertex"));
     m_GBuffer_fs_ptr.reset(create_shader("Assets/code/shader/GBuffer.frag", ShaderStage::FRAGMENT, "GBuffer Fragment"));
     m_picking_cs_ptr.reset(create_shader("Assets/code/shader/picking.comp", ShaderStage::COMPUTE, "Picking Compute"));
-    m_deferred_cs_ptr.reset(create_shader("Assets/code/shader/deferred.comp", ShaderStage::COMPUTE, "Deferred Compute"));
+    create_deferred_shaders();
+    m_decal_culling_cs_ptr.reset(create_shader("Assets/code/shader/decalCulling.comp", ShaderStage::COMPUTE, "Decal Culling Compute"));
+    m_cluster_binning_cs_ptr.reset(create_shader("Assets/code/shader/clusterBinning.comp", ShaderStage::COMPUTE, "Cluster Binning Compute"));
+    m_tile_depth_bounds_cs_ptr.reset(create_shader("Assets/code/shader/tileDepthBounds.comp", ShaderStage::COMPUTE, "Tile Depth Bounds Compute"));
+    m_cluster_compaction_cs_ptr.reset(create_shader("Assets/code/shader/clusterCompaction.comp", ShaderStage::COMPUTE, "Cluster Compaction Compute"));
+    m_cluster_occupancy_cs_ptr.reset(create_shader("Assets/code/shader/clusterOccupancy.comp", ShaderStage::COMPUTE, "Cluster Occupancy Compute"));
+    m_tile_classification_cs_ptr.reset(create_shader("Assets/code/shader/tileClassification.comp", ShaderStage::COMPUTE, "Tile Classification Compute"));
+    m_light_binning_cs_ptr.reset(create_shader("Assets/code/shader/lightBinning.comp", ShaderStage::COMPUTE, "Light Binning Compute"));
+}
+
+void Engine::create_deferred_shaders()
+{
+    //两个工作组划分的变体都按是否使用子组统一贴花循环编译，子组内置函数要求SPIR-V 1.3
+    vector<string> deferred_definitions;
+    if (m_scalarized_decal_loop)
+    {
+        deferred_definitions.push_back("SCALARIZED_DECAL_LOOP");
+    }
+    const SpvVersion deferred_spirv_version = m_scalarized_decal_loop ? SpvVersion::_1_3 : SpvVersion::_1_0;
+    m_deferred_cs_ptr.reset(create_shader("Assets/code/shader/deferred.comp", ShaderStage::COMPUTE, "Deferred Compute", deferred_definitions, deferred_spirv_version));
+
+    //tile分类的变体另按是否使用共享内存贴花缓存编译，工作组大小总是tile大小
+    m_deferred_decal_cache_active = m_deferred_decal_cache && is_deferred_decal_cache_supported();
+    if (m_deferred_decal_cache && !m_deferred_decal_cache_active)
+    {
+        cout << "Deferred decal cache exceeds maxComputeSharedMemorySize, using the uncached variant" << endl;
+    }
+    vector<string> tile_class_definitions = deferred_definitions;
+    tile_class_definitions.push_back("TILE_CLASSIFICATION");
+    if (m_deferred_decal_cache_active)
+    {
+        tile_class_definitions.push_back("SHARED_DECAL_CACHE");
+    }
+    m_deferred_tile_class_cs_ptr.reset(create_shader("Assets/code/shader/deferred.comp", ShaderStage::COMPUTE, "Deferred Tile Class Compute", tile_class_definitions, deferred_spirv_version));
+
+    deferred_definitions.push_back("SHARED_DECAL_CACHE");
+    m_deferred_decal_cache_cs_ptr.reset(create_shader("Assets/code/shader/deferred.comp", ShaderStage::COMPUTE, "Deferred Decal Cache Compute", deferred_definitions, deferred_spirv_version));
+}
+
+bool Engine::is_deferred_decal_cache_supported()
+{
+    //共享内存贴花缓存的用量：3个uint、合并后的位掩码与前缀和各ELEMENTS_PER_CLUSTER个uint、MAX_CACHED_DECALS个索引与贴花；
+    //位掩码随贴花容量增长，超过maxComputeSharedMemorySize(规范保证至少32KB)时不能使用该变体
+    const VkDeviceSize shared_size = sizeof(uint) * (3 + 2 * VkDeviceSize(m_elements_per_cluster) + DEFERRED_MAX_CACHED_DECALS) + sizeof(Decal) * DEFERRED_MAX_CACHED_DECALS;
+    const auto& limits = m_device_ptr->get_physical_device_properties().core_vk1_0_properties_ptr->limits;
+    return shared_size <= limits.max_compute_shared_memory_size;
 }
 
 void Engine::init_gfx_pipelines()
@@ -947,6 +1548,10 @@ void Engine::init_gfx_pipelines()
         gfx_pipeline_create_info_ptr->toggle_depth_test(true, CompareOp::LESS);
         gfx_pipeline_create_info_ptr->toggle_depth_writes(true);
 
+        //按渲染分辨率设置视口，未设置时Anvil默认使用交换链尺寸
+        gfx_pipeline_create_info_ptr->set_viewport_properties(0, 0.0f, 0.0f, static_cast<float>(m_render_width), static_cast<float>(m_render_height), 0.0f, 1.0f);
+        gfx_pipeline_create_info_ptr->set_scissor_box_properties(0, 0, 0, m_render_width, m_render_height);
+
         gfx_pipeline_create_info_ptr->set_color_blend_attachment_properties(
             0,     /* in_attachment_id    */
             false,  /* in_blending_enabled */
@@ -1003,49 +1608,32 @@ void Engine::init_compute_pipelines()
     #pragma endregion
 
     #pragma region deferred
-    {
-        ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+    create_deferred_pipeline(compute_pipeline_manager_ptr);
+    #pragma endregion
 
-        compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
-            PipelineCreateFlagBits::NONE,
-            *m_deferred_cs_ptr);
+    #pragma region 贴花剔除
+    create_decal_culling_pipeline(compute_pipeline_manager_ptr);
+    #pragma endregion
 
-        vector<const DescriptorSetCreateInfo*> m_desc_create_info;
-        m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(0));
-        m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(2));
-        m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(3));
-        m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(4));
-        m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(5 + N_SWAPCHAIN_IMAGES));
-        m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
-        compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
-        compute_pipeline_create_info_ptr->attach_push_constant_range(
-            0,
-            sizeof(m_deferred_constants),
-            ShaderStageFlagBits::COMPUTE_BIT);
+    #pragma region cluster分组(计算着色器)
+    create_tile_depth_bounds_pipeline(compute_pipeline_manager_ptr);
+    create_cluster_binning_pipeline(compute_pipeline_manager_ptr);
+    #pragma endregion
 
-        int SIZE = m_model->get_material_num();
-        int32 num_decals = N_MAX_STORED_DECALS;
-        float near_clip = m_camera->GetNearZ();
-        float far_clip = m_camera->GetFarZ();
-        uint num_x_tiles = m_num_x_tiles;
-        uint num_y_tiles = m_num_y_tiles;
-        uint num_z_tiles = NUM_Z_TILES;
-        uint elements_per_cluster = (N_MAX_STORED_DECALS + 31) / 32;
-        uint tile_size = Tile_Size;
-        compute_pipeline_create_info_ptr->add_specialization_constant(0, 4, &SIZE);
-        compute_pipeline_create_info_ptr->add_specialization_constant(1, 4, &num_decals);
-        compute_pipeline_create_info_ptr->add_specialization_constant(2, 4, &near_clip);
-        compute_pipeline_create_info_ptr->add_specialization_constant(3, 4, &far_clip);
-        compute_pipeline_create_info_ptr->add_specialization_constant(4, 4, &num_x_tiles);
-        compute_pipeline_create_info_ptr->add_specialization_constant(5, 4, &num_y_tiles);
-        compute_pipeline_create_info_ptr->add_specialization_constant(6, 4, &num_z_tiles);
-        compute_pipeline_create_info_ptr->add_specialization_constant(7, 4, &elements_per_cluster);
-        compute_pipeline_create_info_ptr->add_specialization_constant(8, 4, &tile_size);
+    #pragma region cluster压缩
+    create_cluster_compaction_pipeline(compute_pipeline_manager_ptr);
+    #pragma endregion
 
-        compute_pipeline_manager_ptr->add_pipeline(
-            move(compute_pipeline_create_info_ptr),
-            &m_deferred_compute_pipeline_id);
-    }
+    #pragma region cluster占用统计
+    create_cluster_occupancy_pipeline(compute_pipeline_manager_ptr);
+    #pragma endregion
+
+    #pragma region tile分类
+    create_tile_classification_pipeline(compute_pipeline_manager_ptr);
+    #pragma endregion
+
+    #pragma region 灯光分组
+    create_light_binning_pipeline(compute_pipeline_manager_ptr);
     #pragma endregion
 }
 
@@ -1058,8 +1646,8 @@ void Engine::init_framebuffers()
 
     auto create_info_ptr = FramebufferCreateInfo::create(
         m_device_ptr.get(),
-        m_width,
-        m_height,
+        m_render_width,
+        m_render_height,
         1 /* n_layers */);
             
     result = create_info_ptr->add_attachment(
@@ -1109,9 +1697,16 @@ void Engine::init_command_buffers()
     image_subresource_range.layer_count = 1;
     image_subresource_range.level_count = 1;
 
-    for (uint32_t n_command_buffer = 0; n_command_buffer < N_SWAPCHAIN_IMAGES; ++n_command_buffer)
+    //cluster缓冲可能已重新分配或改变了划分，第一帧总是重建
+    m_cluster_state_valid = false;
+
+    //每张交换链图像记录两份：前N_SWAPCHAIN_IMAGES份完整重建cluster，后N_SWAPCHAIN_IMAGES份沿用上一次提交的cluster结果
+    for (uint32_t n_recording = 0; n_recording < 2 * N_SWAPCHAIN_IMAGES; ++n_recording)
     {
-        #pragma region ʼ¼ָ
+        const uint32_t n_command_buffer = n_recording % N_SWAPCHAIN_IMAGES;
+        const bool rebuild_clusters = n_recording < N_SWAPCHAIN_IMAGES;
+
+        #pragma region 开始记录指令
         PrimaryCommandBufferUniquePtr cmd_buffer_ptr;
 
         cmd_buffer_ptr = m_device_ptr->
@@ -1121,9 +1716,10 @@ void Engine::init_command_buffers()
         /* Start recording commands */
         cmd_buffer_ptr->start_recording(false, /* one_time_submit          */
                                         true); /* simultaneous_use_allowed */
+        m_gpu_timer->record_begin(cmd_buffer_ptr.get(), n_command_buffer);
         #pragma endregion
 
-        #pragma region ı丽ͼ񲼾ƬԪɫ
+        #pragma region 改变附件图像布局用于片元着色器输出
         {
             vector<ImageBarrier> image_barriers;
             image_barriers.push_back(
@@ -1194,89 +1790,178 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
         
-        #pragma region ȷclusteruniformѾд
+        #pragma region 确保cluster所需的uniform缓冲已经写入
         {
-            BufferBarrier buffer_barrier1(
-                AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
-                AccessFlagBits::UNIFORM_READ_BIT,               /* in_destination_access_mask */
-                universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
-                universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
-                m_mvp_dynamic_buffer_helper->getBuffer(),
-                m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
-                m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage());
+            vector<BufferBarrier> buffer_barriers;
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
+                    AccessFlagBits::UNIFORM_READ_BIT,               /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_mvp_dynamic_buffer_helper->getBuffer(),
+                    m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
+                    m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage()));
             
-            BufferBarrier buffer_barrier2(
-                AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
-                AccessFlagBits::UNIFORM_READ_BIT,               /* in_destination_access_mask */
-                universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
-                universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
-                m_decals_uniform_buffer_ptr.get(),
-                0,                                                      /* in_offset */
-                m_decals_buffer_size);
-
-            BufferBarrier buffer_barrier3(
-                AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
-                AccessFlagBits::UNIFORM_READ_BIT,               /* in_destination_access_mask */
-                universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
-                universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
-                m_decal_indices_dynamic_buffer_helper->getBuffer(),
-                m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
-                m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage());
-
-            BufferBarrier buffer_barrier4(
-                AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
-                AccessFlagBits::UNIFORM_READ_BIT,               /* in_destination_access_mask */
-                universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
-                universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
-                m_decal_ZBounds_dynamic_buffer_helper->getBuffer(),
-                m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
-                m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage());
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_decals->get_buffer(),
+                    0,                                                      /* in_offset */
+                    m_decals->get_buffer_size()));
+
+            //贴花数量每帧上传，供GPU剔除和计算着色器分组使用
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
+                    AccessFlagBits::UNIFORM_READ_BIT,               /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_decal_culling_dynamic_buffer_helper->getBuffer(),
+                    m_decal_culling_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
+                    m_decal_culling_dynamic_buffer_helper->getSizePerSwapchainImage()));
+
+            //GPU剔除时索引、z范围与间接绘制参数由cull_decals写入，并已在其中做好同步
+            if (!m_gpu_decal_culling)
+            {
+                buffer_barriers.push_back(
+                    BufferBarrier(
+                        AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
+                        AccessFlagBits::SHADER_READ_BIT,                /* in_destination_access_mask */
+                        universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                        universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                        m_decal_indices_dynamic_buffer_helper->getBuffer(),
+                        m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
+                        m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage()));
+
+                buffer_barriers.push_back(
+                    BufferBarrier(
+                        AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
+                        AccessFlagBits::SHADER_READ_BIT,                /* in_destination_access_mask */
+                        universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                        universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                        m_decal_ZBounds_dynamic_buffer_helper->getBuffer(),
+                        m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
+                        m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage()));
+
+                buffer_barriers.push_back(
+                    BufferBarrier(
+                        AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
+                        AccessFlagBits::INDIRECT_COMMAND_READ_BIT,      /* in_destination_access_mask */
+                        universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                        universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                        m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+                        m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset                  */
+                        m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage()));
+            }
 
-            BufferBarrier buffer_barriers[4] = { buffer_barrier1 , buffer_barrier2, buffer_barrier3, buffer_barrier4 };
             cmd_buffer_ptr->record_pipeline_barrier(
                 PipelineStageFlagBits::HOST_BIT,
-                PipelineStageFlagBits::VERTEX_SHADER_BIT | PipelineStageFlagBits::FRAGMENT_SHADER_BIT,
+                PipelineStageFlagBits::DRAW_INDIRECT_BIT | PipelineStageFlagBits::VERTEX_SHADER_BIT | PipelineStageFlagBits::FRAGMENT_SHADER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
                 DependencyFlagBits::NONE,
                 0,               /* in_memory_barrier_count        */
                 nullptr,         /* in_memory_barriers_ptr         */
-                4,               /* in_buffer_memory_barrier_count */
-                buffer_barriers,
+                static_cast<uint32_t>(buffer_barriers.size()), /* in_buffer_memory_barrier_count */
+                buffer_barriers.data(),
                 0,               /* in_image_memory_barrier_count  */
                 nullptr);        /* in_image_memory_barriers_ptr   */
         }
         #pragma endregion
 
-        #pragma region cluster_storage ȷд
+        #pragma region 贴花剔除与分组
+        //计算着色器分组直接遍历全部贴花，不需要剔除结果
+        if (rebuild_clusters && m_gpu_decal_culling && m_cluster_binning == ClusterBinning::RASTER)
+        {
+            cull_decals(cmd_buffer_ptr.get(), n_command_buffer);
+        }
+        #pragma endregion
+
+        #pragma region 清空cluster_storage与灯光位掩码 并确保其可以写入
+        if (rebuild_clusters)
         {
+            //CPU分组的位掩码已由update_data写入本图像的上传区，拷贝代替清空
+            if (m_cluster_binning == ClusterBinning::CPU)
+            {
+                BufferBarrier upload_barrier(
+                    AccessFlagBits::HOST_WRITE_BIT,                      /* in_source_access_mask      */
+                    AccessFlagBits::TRANSFER_READ_BIT,                   /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_cluster_upload_buffer_ptr.get(),
+                    m_cluster_buffer_size * n_command_buffer,            /* in_offset                  */
+                    m_cluster_buffer_size);
+
+                cmd_buffer_ptr->record_pipeline_barrier(
+                    PipelineStageFlagBits::HOST_BIT,
+                    PipelineStageFlagBits::TRANSFER_BIT,
+                    DependencyFlagBits::NONE,
+                    0,               /* in_memory_barrier_count        */
+                    nullptr,         /* in_memory_barriers_ptr         */
+                    1,               /* in_buffer_memory_barrier_count */
+                    &upload_barrier,
+                    0,               /* in_image_memory_barrier_count  */
+                    nullptr);        /* in_image_memory_barriers_ptr   */
+
+                BufferCopy region;
+                region.src_offset = m_cluster_buffer_size * n_command_buffer;
+                region.dst_offset = 0;
+                region.size = ClusterStorage::get_size(m_elements_per_cluster, m_num_x_tiles, m_num_y_tiles, m_num_z_tiles);
+                cmd_buffer_ptr->record_copy_buffer(
+                    m_cluster_upload_buffer_ptr.get(),
+                    m_cluster_storage_buffer_ptr.get(),
+                    1, /* in_region_count */
+                    &region);
+            }
+            else
+            {
+                cmd_buffer_ptr->record_fill_buffer(
+                    m_cluster_storage_buffer_ptr.get(),
+                    0,
+                    m_cluster_buffer_size,
+                    0);
+            }
             cmd_buffer_ptr->record_fill_buffer(
-                m_cluster_storage_buffer_ptr.get(),
+                m_light_cluster_buffer_ptr.get(),
                 0,
-                m_cluster_buffer_size,
+                m_light_cluster_buffer_size,
                 0);
 
-            BufferBarrier buffer_barrier(
-                AccessFlagBits::HOST_WRITE_BIT,                      /* in_source_access_mask      */
-                AccessFlagBits::SHADER_WRITE_BIT | AccessFlagBits::SHADER_READ_BIT,                       /* in_destination_access_mask */
-                universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
-                universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
-                m_cluster_storage_buffer_ptr.get(),
-                0,                                                     /* in_offset                  */
-                m_cluster_buffer_size);
+            BufferBarrier buffer_barriers[2] = {
+                BufferBarrier(
+                    AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_WRITE_BIT | AccessFlagBits::SHADER_READ_BIT,                       /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_cluster_storage_buffer_ptr.get(),
+                    0,                                                     /* in_offset                  */
+                    m_cluster_buffer_size),
+                BufferBarrier(
+                    AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_WRITE_BIT | AccessFlagBits::SHADER_READ_BIT,                       /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_light_cluster_buffer_ptr.get(),
+                    0,                                                     /* in_offset                  */
+                    m_light_cluster_buffer_size)
+            };
 
             cmd_buffer_ptr->record_pipeline_barrier(
-                PipelineStageFlagBits::HOST_BIT,
-                PipelineStageFlagBits::FRAGMENT_SHADER_BIT,
+                PipelineStageFlagBits::TRANSFER_BIT,
+                PipelineStageFlagBits::FRAGMENT_SHADER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
                 DependencyFlagBits::NONE,
                 0,               /* in_memory_barrier_count        */
                 nullptr,         /* in_memory_barriers_ptr         */
-                1,               /* in_buffer_memory_barrier_count */
-                &buffer_barrier,
+                2,               /* in_buffer_memory_barrier_count */
+                buffer_barriers,
                 0,               /* in_image_memory_barrier_count  */
                 nullptr);        /* in_image_memory_barriers_ptr   */
         }
         #pragma endregion
 
-        #pragma region ȾGBuffer
+        #pragma region 渲染GBuffer
         {
             array<VkClearValue, 6>            attachment_clear_value;
             attachment_clear_value[0].color = { 1.0f, 0.0f, 0.0f, 0.0f };
@@ -1287,8 +1972,8 @@ void Engine::init_command_buffers()
             attachment_clear_value[5].depthStencil = { 1.0f, 0 };
 
             VkRect2D                          render_area;
-            render_area.extent.height = m_height;
-            render_area.extent.width = m_width;
+            render_area.extent.height = m_render_height;
+            render_area.extent.width = m_render_width;
             render_area.offset.x = 0;
             render_area.offset.y = 0;
 
@@ -1311,7 +1996,7 @@ void Engine::init_command_buffers()
                 PipelineBindPoint::GRAPHICS,
                 getPineLine(),
                 0, /* firstSet */
-                1, /* setCountshaderеsetһһӦ */
+                1, /* setCount：传入的描述符集与shader中的set一一对应 */
                 ds_ptr,
                 1,                /* dynamicOffsetCount */
                 &data_ub_offset); /* pDynamicOffsets    */
@@ -1320,18 +2005,26 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region cluster
+        #pragma region 对贴花做cluster
         {
+            //计算着色器分组或沿用cluster结果时三个cluster子流程为空，只推进子流程，渲染流程的结构保持不变
             for (int i = 0; i < 3; i++)
             {
-                cluster(cmd_buffer_ptr.get(), i, n_command_buffer);
+                if (rebuild_clusters && m_cluster_binning == ClusterBinning::RASTER)
+                {
+                    cluster(cmd_buffer_ptr.get(), i, n_command_buffer);
+                }
+                else
+                {
+                    cmd_buffer_ptr->record_next_subpass(SubpassContents::INLINE);
+                }
             }
 
             cmd_buffer_ptr->record_end_render_pass();
         }
         #pragma endregion
 
-        #pragma region ȷɫuniformѾд
+        #pragma region 确保计算着色器所需的uniform缓冲已经写入
         {
             BufferBarrier buffer_barrier1(
                 AccessFlagBits::HOST_WRITE_BIT,                 /* in_source_access_mask      */
@@ -1374,7 +2067,7 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region ı丽ͼ񲼾ڼɫȡ
+        #pragma region 改变附件图像布局用于计算着色器读取
         {
             vector<ImageBarrier> image_barriers;
             image_barriers.push_back(
@@ -1445,7 +2138,25 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region ı佻ͼ񲼾ڼɫд
+        #pragma region 计算着色器分组，需在GBuffer可读取之后进行
+        if (rebuild_clusters && m_cluster_binning == ClusterBinning::COMPUTE)
+        {
+            if (m_tile_depth_bounds)
+            {
+                compute_tile_depth_bounds(cmd_buffer_ptr.get(), n_command_buffer);
+            }
+            bin_clusters(cmd_buffer_ptr.get(), n_command_buffer);
+        }
+        #pragma endregion
+
+        #pragma region 对点光源与聚光灯做cluster，与贴花共用划分和重建时机
+        if (rebuild_clusters && m_num_lights > 0)
+        {
+            bin_lights(cmd_buffer_ptr.get(), n_command_buffer);
+        }
+        #pragma endregion
+
+        #pragma region 改变交换链图像(或场景颜色图像)布局用于计算着色器写入
         {
             ImageBarrier image_barrier(
                 AccessFlagBits::NONE,                       /* source_access_mask       */
@@ -1454,7 +2165,7 @@ void Engine::init_command_buffers()
                 ImageLayout::GENERAL,                       /* new_image_layout */
                 universal_queue_ptr->get_queue_family_index(),
                 universal_queue_ptr->get_queue_family_index(),
-                m_swapchain_ptr->get_image(n_command_buffer),
+                is_render_scaled() ? m_scene_color_image_ptr.get() : m_swapchain_ptr->get_image(n_command_buffer),
                 image_subresource_range);
 
             cmd_buffer_ptr->record_pipeline_barrier(
@@ -1470,10 +2181,10 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region ȷpicking_storageд
+        #pragma region 确保picking_storage缓冲可以写入
         {
             BufferBarrier buffer_barrier(
-                AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::HOST_READ_BIT,                      /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::TRANSFER_READ_BIT,                      /* in_source_access_mask      */
                 AccessFlagBits::SHADER_WRITE_BIT,                       /* in_destination_access_mask */
                 universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
                 universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
@@ -1482,7 +2193,7 @@ void Engine::init_command_buffers()
                 m_picking_buffer_size);
 
             cmd_buffer_ptr->record_pipeline_barrier(
-                PipelineStageFlagBits::COMPUTE_SHADER_BIT | PipelineStageFlagBits::HOST_BIT,
+                PipelineStageFlagBits::COMPUTE_SHADER_BIT | PipelineStageFlagBits::TRANSFER_BIT,
                 PipelineStageFlagBits::COMPUTE_SHADER_BIT,
                 DependencyFlagBits::NONE,
                 0,               /* in_memory_barrier_count        */
@@ -1494,10 +2205,11 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region ȡĻмصλúͷϢ
+        #pragma region 获取屏幕中间像素的位置和法线信息
         {
-            const uint32_t data_ub_offset[2] = { 
+            const uint32_t data_ub_offset[3] = { 
                 static_cast<uint32_t>(m_camera_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+                static_cast<uint32_t>(m_cursor_decal_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
                 static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer)
             };
 
@@ -1514,13 +2226,14 @@ void Engine::init_command_buffers()
                 PipelineBindPoint::COMPUTE,
                 getPineLine(4),
                 0, /* firstSet */
-                2, /* setCountshaderеsetһһӦ */
+                2, /* setCount：传入的描述符集与shader中的set一一对应 */
                 ds_ptr,
-                2,                /* dynamicOffsetCount */
+                3,                /* dynamicOffsetCount */
                 data_ub_offset); /* pDynamicOffsets    */
 
-            m_deferred_constants.RTSize.x = m_width;
-            m_deferred_constants.RTSize.y = m_height;
+            m_deferred_constants.RTSize.x = m_render_width;
+            m_deferred_constants.RTSize.y = m_render_height;
+            m_deferred_constants.HeatmapMode = m_cluster_occupancy == ClusterOccupancy::HEATMAP ? 1 : 0;
             cmd_buffer_ptr->record_push_constants(
                 getPineLine(4),
                 ShaderStageFlagBits::COMPUTE_BIT,
@@ -1532,11 +2245,11 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region ȷpicking_storageѾд
+        #pragma region 确保picking_storage缓冲已经写入
         {
             BufferBarrier buffer_barrier(
                 AccessFlagBits::SHADER_WRITE_BIT,                      /* in_source_access_mask      */
-                AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::HOST_READ_BIT,                       /* in_destination_access_mask */
+                AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::TRANSFER_READ_BIT,                       /* in_destination_access_mask */
                 universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
                 universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
                 m_picking_storage_buffer_ptr.get(),
@@ -1545,7 +2258,7 @@ void Engine::init_command_buffers()
 
             cmd_buffer_ptr->record_pipeline_barrier(
                 PipelineStageFlagBits::COMPUTE_SHADER_BIT,
-                PipelineStageFlagBits::COMPUTE_SHADER_BIT | PipelineStageFlagBits::HOST_BIT,
+                PipelineStageFlagBits::COMPUTE_SHADER_BIT | PipelineStageFlagBits::TRANSFER_BIT,
                 DependencyFlagBits::NONE,
                 0,               /* in_memory_barrier_count        */
                 nullptr,         /* in_memory_barriers_ptr         */
@@ -1556,31 +2269,130 @@ void Engine::init_command_buffers()
         }
         #pragma endregion
 
-        #pragma region ȷcluster_storageѾд
+        #pragma region 把picking结果拷贝到读回环
+        m_picking_readback->record_copy(
+            cmd_buffer_ptr.get(),
+            universal_queue_ptr,
+            m_picking_storage_buffer_ptr.get(),
+            0, /* src_offset */
+            n_command_buffer);
+        #pragma endregion
+
+        #pragma region 确保cluster_storage与灯光位掩码缓冲已经写入
+        if (rebuild_clusters)
         {
-            BufferBarrier buffer_barrier(
-                AccessFlagBits::SHADER_WRITE_BIT | AccessFlagBits::SHADER_READ_BIT,                      /* in_source_access_mask      */
-                AccessFlagBits::SHADER_READ_BIT,                       /* in_destination_access_mask */
-                universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
-                universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
-                m_cluster_storage_buffer_ptr.get(),
-                0,                                                     /* in_offset                  */
-                m_cluster_buffer_size);
+            BufferBarrier buffer_barriers[2] = {
+                BufferBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT | AccessFlagBits::SHADER_READ_BIT,                      /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                       /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_cluster_storage_buffer_ptr.get(),
+                    0,                                                     /* in_offset                  */
+                    m_cluster_buffer_size),
+                BufferBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT | AccessFlagBits::SHADER_READ_BIT,                      /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                       /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),         /* in_dst_queue_family_index  */
+                    m_light_cluster_buffer_ptr.get(),
+                    0,                                                     /* in_offset                  */
+                    m_light_cluster_buffer_size)
+            };
 
             cmd_buffer_ptr->record_pipeline_barrier(
-                PipelineStageFlagBits::FRAGMENT_SHADER_BIT,
+                PipelineStageFlagBits::FRAGMENT_SHADER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
                 PipelineStageFlagBits::COMPUTE_SHADER_BIT,
                 DependencyFlagBits::NONE,
                 0,               /* in_memory_barrier_count        */
                 nullptr,         /* in_memory_barriers_ptr         */
-                1,               /* in_buffer_memory_barrier_count */
-                &buffer_barrier,
+                2,               /* in_buffer_memory_barrier_count */
+                buffer_barriers,
+                0,               /* in_image_memory_barrier_count  */
+                nullptr);        /* in_image_memory_barriers_ptr   */
+        }
+        #pragma endregion
+
+        #pragma region 把cluster位掩码压缩成索引表
+        //子组统一的贴花循环直接遍历位掩码，不读取索引表，此时跳过压缩
+        if (rebuild_clusters && !m_scalarized_decal_loop)
+        {
+            compact_clusters(cmd_buffer_ptr.get());
+        }
+        #pragma endregion
+
+        #pragma region 统计cluster占用，沿用cluster结果的帧统计不变，不重复统计
+        if (rebuild_clusters && m_cluster_occupancy != ClusterOccupancy::OFF)
+        {
+            compute_cluster_occupancy(cmd_buffer_ptr.get(), n_command_buffer);
+        }
+        #pragma endregion
+
+        #pragma region 沿用上一次提交的cluster结果，确保其写入对deferred可见
+        if (!rebuild_clusters)
+        {
+            vector<BufferBarrier> buffer_barriers;
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT,                  /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                   /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_dst_queue_family_index  */
+                    m_cluster_storage_buffer_ptr.get(),
+                    0,                                                 /* in_offset                  */
+                    m_cluster_buffer_size));
+
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT,                  /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                   /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_dst_queue_family_index  */
+                    m_cluster_headers_buffer_ptr.get(),
+                    0,                                                 /* in_offset                  */
+                    m_cluster_headers_buffer_size));
+
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT,                  /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                   /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_dst_queue_family_index  */
+                    m_cluster_indices_buffer_ptr.get(),
+                    0,                                                 /* in_offset                  */
+                    m_cluster_indices_buffer_size));
+
+            buffer_barriers.push_back(
+                BufferBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT,                  /* in_source_access_mask      */
+                    AccessFlagBits::SHADER_READ_BIT,                   /* in_destination_access_mask */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_src_queue_family_index  */
+                    universal_queue_ptr->get_queue_family_index(),     /* in_dst_queue_family_index  */
+                    m_light_cluster_buffer_ptr.get(),
+                    0,                                                 /* in_offset                  */
+                    m_light_cluster_buffer_size));
+
+            cmd_buffer_ptr->record_pipeline_barrier(
+                PipelineStageFlagBits::FRAGMENT_SHADER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+                PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+                DependencyFlagBits::NONE,
+                0,               /* in_memory_barrier_count        */
+                nullptr,         /* in_memory_barriers_ptr         */
+                static_cast<uint32_t>(buffer_barriers.size()), /* in_buffer_memory_barrier_count */
+                buffer_barriers.data(),
                 0,               /* in_image_memory_barrier_count  */
                 nullptr);        /* in_image_memory_barriers_ptr   */
         }
         #pragma endregion
 
-        #pragma region ӳ͹
+        #pragma region 按tile分类，生成deferred的间接dispatch参数
+        if (m_tile_classification)
+        {
+            classify_tiles(cmd_buffer_ptr.get(), n_command_buffer);
+        }
+        #pragma endregion
+
+        #pragma region 延迟纹理采样和光照
         {
             const uint32_t data_ub_offset[4] = {
                 static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
@@ -1589,10 +2401,6 @@ void Engine::init_command_buffers()
                 static_cast<uint32_t>(m_cursor_decal_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer)
             };
 
-            cmd_buffer_ptr->record_bind_pipeline(
-                PipelineBindPoint::COMPUTE,
-                m_deferred_compute_pipeline_id);
-
             DescriptorSet* ds_ptr[6] = {
                 m_dsg_ptr->get_descriptor_set(0),
                 m_dsg_ptr->get_descriptor_set(2),
@@ -1605,7 +2413,7 @@ void Engine::init_command_buffers()
                 PipelineBindPoint::COMPUTE,
                 getPineLine(5),
                 0, /* firstSet */
-                6, /* setCountshaderеsetһһӦ */
+                6, /* setCount：传入的描述符集与shader中的set一一对应 */
                 ds_ptr,
                 4,                /* dynamicOffsetCount */
                 data_ub_offset); /* pDynamicOffsets    */
@@ -1617,18 +2425,105 @@ void Engine::init_command_buffers()
                 sizeof(DeferredConstants),
                 &m_deferred_constants);
 
-            cmd_buffer_ptr->record_dispatch(
-                (m_width + 7) / 8,
-                (m_height + 7) / 8,
-                1);
+            //各管线的布局相同，描述符集与推送常量只绑定一次
+            if (m_tile_classification)
+            {
+                //每类的工作组数由tileClassification.comp写入
+                for (uint32_t tile_class = 0; tile_class < uint32_t(TileClass::COUNT); tile_class++)
+                {
+                    cmd_buffer_ptr->record_bind_pipeline(
+                        PipelineBindPoint::COMPUTE,
+                        m_deferred_tile_class_compute_pipeline_id[tile_class]);
+                    cmd_buffer_ptr->record_dispatch_indirect(
+                        m_tile_classification_buffer_ptr.get(),
+                        TileClassificationStorage::get_dispatch_offset(TileClass(tile_class)));
+                }
+            }
+            else
+            {
+                cmd_buffer_ptr->record_bind_pipeline(
+                    PipelineBindPoint::COMPUTE,
+                    m_deferred_compute_pipeline_id);
+
+                //共享内存贴花缓存变体的工作组即tile
+                if (m_deferred_decal_cache_active)
+                {
+                    cmd_buffer_ptr->record_dispatch(m_num_x_tiles, m_num_y_tiles, 1);
+                }
+                else
+                {
+                    cmd_buffer_ptr->record_dispatch(
+                        (m_render_width + 7) / 8,
+                        (m_render_height + 7) / 8,
+                        1);
+                }
+            }
+        }
+        #pragma endregion
+
+        #pragma region 渲染分辨率与交换链不同时，把场景颜色缩放拷贝到交换链图像
+        if (is_render_scaled())
+        {
+            vector<ImageBarrier> image_barriers;
+            image_barriers.push_back(
+                ImageBarrier(
+                    AccessFlagBits::SHADER_WRITE_BIT,               /* source_access_mask       */
+                    AccessFlagBits::TRANSFER_READ_BIT,              /* destination_access_mask  */
+                    ImageLayout::GENERAL,                           /* old_image_layout */
+                    ImageLayout::TRANSFER_SRC_OPTIMAL,              /* new_image_layout */
+                    universal_queue_ptr->get_queue_family_index(),
+                    universal_queue_ptr->get_queue_family_index(),
+                    m_scene_color_image_ptr.get(),
+                    image_subresource_range));
+            image_barriers.push_back(
+                ImageBarrier(
+                    AccessFlagBits::NONE,                           /* source_access_mask       */
+                    AccessFlagBits::TRANSFER_WRITE_BIT,             /* destination_access_mask  */
+                    ImageLayout::UNDEFINED,                         /* old_image_layout */
+                    ImageLayout::TRANSFER_DST_OPTIMAL,              /* new_image_layout */
+                    universal_queue_ptr->get_queue_family_index(),
+                    universal_queue_ptr->get_queue_family_index(),
+                    m_swapchain_ptr->get_image(n_command_buffer),
+                    image_subresource_range));
+
+            cmd_buffer_ptr->record_pipeline_barrier(
+                PipelineStageFlagBits::COMPUTE_SHADER_BIT,                /* src_stage_mask                 */
+                PipelineStageFlagBits::TRANSFER_BIT,                      /* dst_stage_mask                 */
+                DependencyFlagBits::NONE,
+                0,                                                        /* in_memory_barrier_count        */
+                nullptr,                                                  /* in_memory_barrier_ptrs         */
+                0,                                                        /* in_buffer_memory_barrier_count */
+                nullptr,                                                  /* in_buffer_memory_barrier_ptrs  */
+                static_cast<uint32_t>(image_barriers.size()),             /* in_image_memory_barrier_count  */
+                image_barriers.data());
+
+            ImageBlit blit_region;
+            blit_region.src_subresource.aspect_mask = ImageAspectFlagBits::COLOR_BIT;
+            blit_region.src_subresource.mip_level = 0;
+            blit_region.src_subresource.base_array_layer = 0;
+            blit_region.src_subresource.layer_count = 1;
+            blit_region.src_offsets[0] = { 0, 0, 0 };
+            blit_region.src_offsets[1] = { m_render_width, m_render_height, 1 };
+            blit_region.dst_subresource = blit_region.src_subresource;
+            blit_region.dst_offsets[0] = { 0, 0, 0 };
+            blit_region.dst_offsets[1] = { m_width, m_height, 1 };
+
+            cmd_buffer_ptr->record_blit_image(
+                m_scene_color_image_ptr.get(),
+                ImageLayout::TRANSFER_SRC_OPTIMAL,
+                m_swapchain_ptr->get_image(n_command_buffer),
+                ImageLayout::TRANSFER_DST_OPTIMAL,
+                1, /* in_region_count */
+                &blit_region,
+                Filter::LINEAR);
         }
         #pragma endregion
 
-        #pragma region ı佻ͼ񲼾ڳ
+        #pragma region 改变交换链图像布局用于呈现
         ImageBarrier present_image_barrier(
-            AccessFlagBits::SHADER_WRITE_BIT,         /* source_access_mask       */
+            is_render_scaled() ? AccessFlagBits::TRANSFER_WRITE_BIT : AccessFlagBits::SHADER_WRITE_BIT, /* source_access_mask */
             AccessFlagBits::NONE,                     /* destination_access_mask  */
-            ImageLayout::GENERAL,                     /* old_image_layout */
+            is_render_scaled() ? ImageLayout::TRANSFER_DST_OPTIMAL : ImageLayout::GENERAL,              /* old_image_layout */
             ImageLayout::PRESENT_SRC_KHR,             /* new_image_layout */
             universal_queue_ptr->get_queue_family_index(),
             universal_queue_ptr->get_queue_family_index(),
@@ -1636,7 +2531,7 @@ void Engine::init_command_buffers()
             image_subresource_range);
 
         cmd_buffer_ptr->record_pipeline_barrier(
-            PipelineStageFlagBits::COMPUTE_SHADER_BIT,                /* src_stage_mask                 */
+            is_render_scaled() ? PipelineStageFlagBits::TRANSFER_BIT : PipelineStageFlagBits::COMPUTE_SHADER_BIT, /* src_stage_mask */
             PipelineStageFlagBits::BOTTOM_OF_PIPE_BIT,                /* dst_stage_mask                 */
             DependencyFlagBits::NONE,
             0,                                                        /* in_memory_barrier_count        */
@@ -1647,9 +2542,17 @@ void Engine::init_command_buffers()
             &present_image_barrier);
         #pragma endregion
 
-        #pragma region ¼ָ
+        #pragma region 结束记录指令
+        m_gpu_timer->record_end(cmd_buffer_ptr.get(), n_command_buffer);
         cmd_buffer_ptr->stop_recording();
-        m_command_buffers[n_command_buffer] = move(cmd_buffer_ptr);
+        if (rebuild_clusters)
+        {
+            m_command_buffers[n_command_buffer] = move(cmd_buffer_ptr);
+        }
+        else
+        {
+            m_reuse_cluster_command_buffers[n_command_buffer] = move(cmd_buffer_ptr);
+        }
         #pragma endregion
     }
 }
@@ -1684,11 +2587,23 @@ void Engine::init_semaphores()
         m_frame_signal_semaphores.push_back(move(new_signal_semaphore_ptr));
         m_frame_wait_semaphores.push_back(move(new_wait_semaphore_ptr));
     }
+
+    //栅栏按交换链图像索引使用，初始为已触发，第一次使用时无需等待
+    for (uint32_t n_fence = 0; n_fence < N_SWAPCHAIN_IMAGES; ++n_fence)
+    {
+        auto create_info_ptr = Anvil::FenceCreateInfo::create(m_device_ptr.get(), true); /* in_create_signalled */
+        Anvil::FenceUniquePtr new_fence_ptr = Anvil::Fence::create(move(create_info_ptr));
+
+        new_fence_ptr->set_name_formatted("Frame fence [%d]",
+            n_fence);
+
+        m_frame_fences.push_back(move(new_fence_ptr));
+    }
 }
 
 void Engine::recreate_swapchain()
 {
-    //СʱֹͣȾ
+    //当窗口最小化时停止渲染
     tagRECT rect;
     GetClientRect(m_window_ptr->get_handle(), &rect);
     long width = rect.right - rect.left;
@@ -1708,6 +2623,7 @@ void Engine::recreate_swapchain()
     cleanup_swapwhain();
 
     init_swapchain();
+    init_cluster_buffer();
     init_image();
     init_dsgs();
     init_framebuffers();
@@ -1716,96 +2632,545 @@ void Engine::recreate_swapchain()
     init_compute_pipelines();
     init_command_buffers();
 }
-#pragma endregion
 
-#pragma region 
-void Engine::run()
+void Engine::recreate_decal_resources()
 {
-    m_window_ptr->run();
-}
+    //调用前需确保设备空闲且指令缓冲已释放
+    auto gfx_pipeline_manager_ptr(m_device_ptr->get_graphics_pipeline_manager());
+    auto compute_pipeline_manager_ptr(m_device_ptr->get_compute_pipeline_manager());
 
-void Engine::draw_frame()
-{
-    if (m_key->IsPressed(KeyID::KEY_ID_ESCAPE))
+    for (int i = 0; i < 3; i++)
     {
-        m_window_ptr->close();
-        return;
+        gfx_pipeline_manager_ptr->delete_pipeline(m_cluster_gfx_pipeline_id[i]);
+        m_cluster_gfx_pipeline_id[i] = UINT32_MAX;
+    }
+    delete_deferred_pipelines(compute_pipeline_manager_ptr);
+    compute_pipeline_manager_ptr->delete_pipeline(m_cluster_binning_compute_pipeline_id);
+    m_cluster_binning_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_cluster_compaction_compute_pipeline_id);
+    m_cluster_compaction_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_cluster_occupancy_compute_pipeline_id);
+    m_cluster_occupancy_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_tile_classification_compute_pipeline_id);
+    m_tile_classification_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_light_binning_compute_pipeline_id);
+    m_light_binning_compute_pipeline_id = UINT32_MAX;
+
+    m_decal_indices_dynamic_buffer_helper->resize(m_decals->get_capacity() + 1);
+    m_decal_ZBounds_dynamic_buffer_helper->resize(m_decals->get_capacity());
+    init_cluster_buffer();
+    bind_decal_buffers();
+
+    //容量增长后共享内存贴花缓存可能超过设备上限，或重新放得下，tile分类变体的着色器随之重新编译
+    if (m_deferred_decal_cache && m_deferred_decal_cache_active != is_deferred_decal_cache_supported())
+    {
+        create_deferred_shaders();
     }
 
-    if (m_key->IsPressed(KeyID::KEY_ID_F1))
+    for (int i = 0; i < 3; i++)
     {
-        m_is_full_screen = !m_is_full_screen;
-        m_key->SetReleased(Anvil::KeyID::KEY_ID_F1);
-        if (m_is_full_screen)
-        {
-            GetWindowRect(m_window_ptr->get_handle(), &m_rect_before_full_screen);
-            
-            HWND hDesk = GetDesktopWindow();
-            RECT rc;
-            GetWindowRect(hDesk, &rc);
-            SetWindowLong(m_window_ptr->get_handle(), GWL_STYLE, WS_POPUP);
-            SetWindowPos(m_window_ptr->get_handle(), HWND_TOPMOST, 0, 0, rc.right, rc.bottom, SWP_SHOWWINDOW);
-            recreate_swapchain();
-            return;
-        }
-        else
+        create_cluster_pipeline(gfx_pipeline_manager_ptr, i);
+    }
+    create_deferred_pipeline(compute_pipeline_manager_ptr);
+    create_cluster_binning_pipeline(compute_pipeline_manager_ptr);
+    create_cluster_compaction_pipeline(compute_pipeline_manager_ptr);
+    create_cluster_occupancy_pipeline(compute_pipeline_manager_ptr);
+    create_tile_classification_pipeline(compute_pipeline_manager_ptr);
+    create_light_binning_pipeline(compute_pipeline_manager_ptr);
+}
+
+bool Engine::is_cluster_config_supported(uint tile_size, uint num_z_tiles)
+{
+    //tileDepthBounds.comp、tileClassification.comp以及共享内存贴花缓存与tile分类变体的deferred.comp的工作组大小即tile大小
+    const auto& limits = m_device_ptr->get_physical_device_properties().core_vk1_0_properties_ptr->limits;
+    return tile_size > 0
+        && num_z_tiles > 0
+        && tile_size * tile_size <= limits.max_compute_work_group_invocations
+        && tile_size <= limits.max_compute_work_group_size[0]
+        && tile_size <= limits.max_compute_work_group_size[1]
+        && get_max_cluster_decals(tile_size, num_z_tiles) >= m_decals->get_capacity();
+}
+
+VkDeviceSize Engine::get_cluster_storage_limit()
+{
+    //位掩码整块绑定为一个storage缓冲，不能超过maxStorageBufferRange，同时最多占用最大显存堆的1/CLUSTER_STORAGE_HEAP_FRACTION
+    VkDeviceSize heap_size = 0;
+    const MemoryProperties& memory_properties = m_device_ptr->get_physical_device_memory_properties();
+    for (uint32_t n_heap = 0; n_heap < memory_properties.n_heaps; n_heap++)
+    {
+        if ((memory_properties.heaps[n_heap].flags & MemoryHeapFlagBits::DEVICE_LOCAL_BIT) == MemoryHeapFlagBits::DEVICE_LOCAL_BIT)
         {
-            SetWindowLong(m_window_ptr->get_handle(), GWL_STYLE, WS_OVERLAPPEDWINDOW);
-            SetWindowPos(
-                m_window_ptr->get_handle(), 
-                HWND_TOPMOST,
-                m_rect_before_full_screen.left,
-                m_rect_before_full_screen.top,
-                m_rect_before_full_screen.right,
-                m_rect_before_full_screen.bottom,
-                SWP_SHOWWINDOW);
-            recreate_swapchain();
-            return;
+            heap_size = std::max(heap_size, memory_properties.heaps[n_heap].size);
         }
     }
 
-    Semaphore* curr_frame_signal_semaphore_ptr = nullptr;
-    Semaphore* curr_frame_wait_semaphore_ptr = nullptr;
-    uint32_t n_swapchain_image;
-    Queue* present_queue_ptr = m_device_ptr->get_universal_queue(0);
-    Semaphore* present_wait_semaphore_ptr = nullptr;
-    const PipelineStageFlags wait_stage_mask = PipelineStageFlagBits::ALL_COMMANDS_BIT;
-
-    /* Determine the signal + wait semaphores to use for drawing this frame */
-    m_n_last_semaphore_used = (m_n_last_semaphore_used + 1) % N_SWAPCHAIN_IMAGES;
+    const auto& limits = m_device_ptr->get_physical_device_properties().core_vk1_0_properties_ptr->limits;
+    return std::min(VkDeviceSize(limits.max_storage_buffer_range), heap_size / CLUSTER_STORAGE_HEAP_FRACTION);
+}
 
-    curr_frame_signal_semaphore_ptr = m_frame_signal_semaphores[m_n_last_semaphore_used].get();
-    curr_frame_wait_semaphore_ptr = m_frame_wait_semaphores[m_n_last_semaphore_used].get();
+uint32_t Engine::get_max_cluster_decals(uint tile_size, uint num_z_tiles)
+{
+    //每个cluster每32个贴花占一个uint，由cluster数反推位掩码能覆盖的贴花数，按块向下取整；
+    //按当前与全屏时渲染分辨率中较大的一个计算，切换全屏或放大窗口后仍能容纳已放置的贴花
+    RECT desktop_rect;
+    GetWindowRect(GetDesktopWindow(), &desktop_rect);
+    const uint render_width = std::max(uint(m_render_width), uint((desktop_rect.right - desktop_rect.left) * m_render_scale + 0.5f));
+    const uint render_height = std::max(uint(m_render_height), uint((desktop_rect.bottom - desktop_rect.top) * m_render_scale + 0.5f));
+    const uint num_x_tiles = (render_width + tile_size - 1) / tile_size;
+    const uint num_y_tiles = (render_height + tile_size - 1) / tile_size;
+    const VkDeviceSize elements_per_cluster = get_cluster_storage_limit() / ClusterStorage::get_size(1, num_x_tiles, num_y_tiles, num_z_tiles);
+    const VkDeviceSize max_decals = elements_per_cluster * 32 / N_DECALS_PER_CHUNK * N_DECALS_PER_CHUNK;
+    return uint32_t(std::min(max_decals, VkDeviceSize(UINT32_MAX) / N_DECALS_PER_CHUNK * N_DECALS_PER_CHUNK));
+}
 
-    present_wait_semaphore_ptr = curr_frame_signal_semaphore_ptr;
+void Engine::update_max_decals()
+{
+    //贴花上限取编译期上限与当前tile划分下位掩码能覆盖的贴花数中较小的一个
+    m_decals->set_max_decals(std::min<uint32_t>(N_MAX_DECALS, get_max_cluster_decals(m_tile_size, m_num_z_tiles)));
+}
 
-    /* Determine the semaphore which the swapchain image */
+bool Engine::set_cluster_config(uint tile_size, uint num_z_tiles)
+{
+    if (!is_cluster_config_supported(tile_size, num_z_tiles))
     {
-        const auto acquire_result = m_swapchain_ptr->acquire_image(
-            curr_frame_wait_semaphore_ptr,
-            &n_swapchain_image,
-            true); /* in_should_block */
+        return false;
+    }
+    if (tile_size == m_tile_size && num_z_tiles == m_num_z_tiles)
+    {
+        return true;
+    }
 
-        if (acquire_result != SwapchainOperationErrorCode::SUCCESS)
-        {
-            recreate_swapchain();
-            return;
-        }
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+    {
+        m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
     }
-    update_data(n_swapchain_image);
 
-    /* Submit work chunk and present */
+    apply_cluster_config(tile_size, num_z_tiles);
 
-    present_queue_ptr->submit(
-        SubmitInfo::create(
-            m_command_buffers[n_swapchain_image].get(),
-            1, /* n_semaphores_to_signal */
-            &curr_frame_signal_semaphore_ptr,
-            1, /* n_semaphores_to_wait_on */
-            &curr_frame_wait_semaphore_ptr,
-            &wait_stage_mask,
-            false /* should_block */)
-    );
+    m_cluster_config_generation++;
+    init_command_buffers();
+    return true;
+}
+
+void Engine::apply_cluster_config(uint tile_size, uint num_z_tiles)
+{
+    //调用前需确保设备空闲且指令缓冲已释放；GBuffer、picking管线与图像不依赖tile划分，保持不变
+    m_tile_size = tile_size;
+    m_num_z_tiles = num_z_tiles;
+    m_num_x_tiles = (m_render_width + m_tile_size - 1) / m_tile_size;
+    m_num_y_tiles = (m_render_height + m_tile_size - 1) / m_tile_size;
+    update_max_decals();
+
+    //贴花剔除与tile深度范围的特化常量也随之变化，其余cluster管线由recreate_decal_resources重建
+    auto compute_pipeline_manager_ptr(m_device_ptr->get_compute_pipeline_manager());
+    compute_pipeline_manager_ptr->delete_pipeline(m_decal_culling_compute_pipeline_id);
+    m_decal_culling_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_tile_depth_bounds_compute_pipeline_id);
+    m_tile_depth_bounds_compute_pipeline_id = UINT32_MAX;
+
+    recreate_decal_resources();
+
+    create_decal_culling_pipeline(compute_pipeline_manager_ptr);
+    create_tile_depth_bounds_pipeline(compute_pipeline_manager_ptr);
+}
+#pragma endregion
+
+#pragma region 自动调优
+void Engine::start_cluster_autotune()
+{
+    if (collect_cluster_autotune_configs())
+    {
+        begin_cluster_autotune();
+        apply_cluster_autotune_config(m_cluster_autotune_results[0]);
+    }
+}
+
+void Engine::start_deferred_variant_comparison()
+{
+    if (collect_deferred_variant_configs())
+    {
+        begin_cluster_autotune();
+        apply_cluster_autotune_config(m_cluster_autotune_results[0]);
+    }
+}
+
+bool Engine::collect_cluster_autotune_configs()
+{
+    if (!m_gpu_timer->is_supported())
+    {
+        cout << "Cluster auto-tune skipped: timestamp queries are not supported" << endl;
+        return false;
+    }
+
+    static const uint tile_sizes[] = { 8, 16, 32 };
+    static const uint z_slice_counts[] = { 8, 16, 24, 32 };
+
+    m_cluster_autotune_results.clear();
+    for (uint tile_size : tile_sizes)
+    {
+        for (uint num_z_tiles : z_slice_counts)
+        {
+            if (is_cluster_config_supported(tile_size, num_z_tiles))
+            {
+                m_cluster_autotune_results.push_back({ tile_size, num_z_tiles, m_deferred_decal_cache, m_scalarized_decal_loop, 0.0, 0 });
+            }
+        }
+    }
+    return !m_cluster_autotune_results.empty();
+}
+
+bool Engine::collect_deferred_variant_configs()
+{
+    if (!m_gpu_timer->is_supported())
+    {
+        cout << "Deferred variant comparison skipped: timestamp queries are not supported" << endl;
+        return false;
+    }
+
+    //tile划分保持不变，各次运行只有deferred的着色器不同；第一组为原始版本，作为加速比的基准
+    const bool scalarized_supported = is_subgroup_supported(
+        ShaderStageFlagBits::COMPUTE_BIT,
+        SubgroupFeatureFlagBits::BASIC_BIT | SubgroupFeatureFlagBits::ARITHMETIC_BIT);
+    m_cluster_autotune_results.clear();
+    for (uint32_t scalarized = 0; scalarized < (scalarized_supported ? 2u : 1u); scalarized++)
+    {
+        m_cluster_autotune_results.push_back({ m_tile_size, m_num_z_tiles, false, scalarized != 0, 0.0, 0 });
+        m_cluster_autotune_results.push_back({ m_tile_size, m_num_z_tiles, true, scalarized != 0, 0.0, 0 });
+    }
+    return true;
+}
+
+void Engine::begin_cluster_autotune()
+{
+    //固定路径会改写相机，结束后恢复到开始前的位姿
+    m_cluster_autotune_camera_position = m_camera->GetCameraWorldPos();
+    m_cluster_autotune_camera_yaw = m_camera->GetYaw();
+    m_cluster_autotune_camera_pitch = m_camera->GetPitch();
+
+    //第一组配置由调用者生效：运行中切换需要重建，启动时直接写入成员
+    m_cluster_autotune_active = true;
+    m_cluster_autotune_index = 0;
+    m_cluster_autotune_frame = 0;
+}
+
+void Engine::apply_cluster_autotune_config(const ClusterAutotuneResult& config)
+{
+    const bool variant_changed = config.deferred_decal_cache != m_deferred_decal_cache || config.scalarized_decal_loop != m_scalarized_decal_loop;
+    const bool cluster_config_changed = config.tile_size != m_tile_size || config.num_z_tiles != m_num_z_tiles;
+    if (!variant_changed && !cluster_config_changed)
+    {
+        return;
+    }
+
+    //deferred变体与tile划分一起切换，只等待一次设备空闲、重新记录一次指令缓冲
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+    {
+        m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+    }
+
+    auto compute_pipeline_manager_ptr(m_device_ptr->get_compute_pipeline_manager());
+    delete_deferred_pipelines(compute_pipeline_manager_ptr);
+    if (variant_changed)
+    {
+        apply_deferred_variant(config.deferred_decal_cache, config.scalarized_decal_loop);
+    }
+    //tile划分变化时deferred管线随其余cluster管线由recreate_decal_resources重建
+    if (cluster_config_changed)
+    {
+        apply_cluster_config(config.tile_size, config.num_z_tiles);
+    }
+    else
+    {
+        create_deferred_pipeline(compute_pipeline_manager_ptr);
+    }
+
+    m_cluster_config_generation++;
+    init_command_buffers();
+}
+
+void Engine::update_cluster_autotune()
+{
+    if (m_cluster_autotune_frame >= CLUSTER_AUTOTUNE_WARMUP_FRAMES + CLUSTER_AUTOTUNE_FRAMES)
+    {
+        m_cluster_autotune_index++;
+        m_cluster_autotune_frame = 0;
+        if (m_cluster_autotune_index == m_cluster_autotune_results.size())
+        {
+            finish_cluster_autotune();
+            return;
+        }
+
+        apply_cluster_autotune_config(m_cluster_autotune_results[m_cluster_autotune_index]);
+    }
+
+    //相机路径按帧序号而不是时间推进，每组配置计时的画面序列完全相同；预热时停在起点
+    const uint32_t path_frame = m_cluster_autotune_frame > CLUSTER_AUTOTUNE_WARMUP_FRAMES ? m_cluster_autotune_frame - CLUSTER_AUTOTUNE_WARMUP_FRAMES : 0;
+    const float t = float(path_frame) / CLUSTER_AUTOTUNE_FRAMES;
+    m_camera->SetPose(
+        vec3(mix(-11.5f, 11.5f, t), 1.85f, -0.45f),
+        360.0f * t,                                 /* yaw：沿大厅前进时转一整圈 */
+        10.0f * sin(radians(360.0f * t)));          /* pitch */
+    m_cluster_autotune_frame++;
+}
+
+void Engine::finish_cluster_autotune()
+{
+    m_cluster_autotune_active = false;
+    m_camera->SetPose(m_cluster_autotune_camera_position, m_cluster_autotune_camera_yaw, m_cluster_autotune_camera_pitch);
+
+    cout << "Cluster auto-tune: average GPU frame time over " << CLUSTER_AUTOTUNE_FRAMES << " frames" << endl;
+    cout << " tile  slices  decal cache  scalarized  GPU ms  speedup" << endl;
+
+    //加速比相对第一组配置
+    const ClusterAutotuneResult& first = m_cluster_autotune_results[0];
+    const double first_ms = first.samples > 0 ? first.total_gpu_ms / first.samples : 0.0;
+    uint32_t best = UINT32_MAX;
+    double best_ms = 0.0;
+    for (uint32_t i = 0; i < m_cluster_autotune_results.size(); i++)
+    {
+        const ClusterAutotuneResult& result = m_cluster_autotune_results[i];
+        char line[96];
+        if (result.samples == 0)
+        {
+            sprintf_s(line, "%5u  %6u  %11s  %10s  no samples", result.tile_size, result.num_z_tiles,
+                result.deferred_decal_cache ? "on" : "off", result.scalarized_decal_loop ? "on" : "off");
+            cout << line << endl;
+            continue;
+        }
+
+        const double average_ms = result.total_gpu_ms / result.samples;
+        sprintf_s(line, "%5u  %6u  %11s  %10s  %6.3f  %6.2fx", result.tile_size, result.num_z_tiles,
+            result.deferred_decal_cache ? "on" : "off", result.scalarized_decal_loop ? "on" : "off",
+            average_ms, first_ms > 0.0 ? first_ms / average_ms : 1.0);
+        cout << line << endl;
+        if (best == UINT32_MAX || average_ms < best_ms)
+        {
+            best = i;
+            best_ms = average_ms;
+        }
+    }
+
+    if (best != UINT32_MAX)
+    {
+        const ClusterAutotuneResult& result = m_cluster_autotune_results[best];
+        cout << "Best: tile " << result.tile_size << ", " << result.num_z_tiles << " slices, decal cache " << (result.deferred_decal_cache ? "on" : "off")
+            << ", scalarized " << (result.scalarized_decal_loop ? "on" : "off") << endl;
+        apply_cluster_autotune_config(result);
+    }
+}
+#pragma endregion
+
+#pragma region 运行
+void Engine::run()
+{
+    m_window_ptr->run();
+}
+
+bool Engine::save_decals(const string& path)
+{
+    return m_decals->save(path);
+}
+
+bool Engine::load_decals(const string& path)
+{
+    //容量随快照变化，与放置贴花时的容量增长一样需要重建贴花相关的资源和指令缓冲
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+    {
+        m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+    }
+
+    const bool result = m_decals->load(path, m_device_ptr->get_universal_queue(0));
+    if (result)
+    {
+        recreate_decal_resources();
+        reset_title_stats();
+    }
+
+    init_command_buffers();
+    return result;
+}
+
+void Engine::load_startup_decals()
+{
+    //在创建贴花相关的缓冲之前载入，缓冲直接按快照的容量创建，不需要重建
+    m_decal_snapshot_path = s_startup_options.decal_snapshot_path;
+    if (m_decal_snapshot_path.empty() || m_decals->load(m_decal_snapshot_path, m_device_ptr->get_universal_queue(0)))
+    {
+        return;
+    }
+
+    cout << "Failed to load decal snapshot " << m_decal_snapshot_path << ", starting empty" << endl;
+    //文件存在但被拒绝(版本不符或超过贴花上限)时退出不写回，避免覆盖原快照
+    if (_access(m_decal_snapshot_path.data(), 0) == 0)
+    {
+        m_decal_snapshot_path.clear();
+    }
+}
+
+const string& Engine::get_decal_snapshot_path() const
+{
+    return m_decal_snapshot_path;
+}
+
+bool Engine::dump_clusters(const string& path)
+{
+    //m_cluster_view/m_cluster_proj记录的是最近一次重建cluster时的视角，与缓冲中的位掩码对应
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    if (!m_cluster_state_valid)
+    {
+        return false;
+    }
+
+    const uint32_t n_decals = m_decals->get_size();
+    const VkDeviceSize n_words = ClusterStorage::get_size(m_elements_per_cluster, m_num_x_tiles, m_num_y_tiles, m_num_z_tiles) / sizeof(uint32_t);
+    vector<uint32_t> bitmask(n_words);
+    if (!m_cluster_storage_buffer_ptr->read(0, n_words * sizeof(uint32_t), bitmask.data(), m_device_ptr->get_universal_queue(0)))
+    {
+        return false;
+    }
+
+    vector<Decal> decals(n_decals);
+    for (uint32_t n = 0; n < n_decals; n++)
+    {
+        decals[n] = m_decals->get(n);
+    }
+
+    ClusterDumpHeader header = {};
+    header.magic = ClusterReference::DUMP_MAGIC;
+    header.version = ClusterReference::DUMP_VERSION;
+    header.record_size = sizeof(Decal);
+    header.n_decals = n_decals;
+    header.render_width = m_render_width;
+    header.render_height = m_render_height;
+    header.binning = uint32_t(m_cluster_binning);
+    header.flags = m_conservative_cluster_raster ? ClusterReference::DUMP_FLAG_CONSERVATIVE_RASTER : 0;
+    header.n_words = uint32_t(n_words);
+    header.constants = m_cluster_constants;
+    header.view = m_cluster_view;
+    header.proj = m_cluster_proj;
+    header.decals_offset = sizeof(ClusterDumpHeader);
+    header.bitmask_offset = header.decals_offset + uint64_t(n_decals) * sizeof(Decal);
+
+    return ClusterReference::save_dump(path, header, decals.data(), bitmask.data());
+}
+
+void Engine::draw_frame()
+{
+    if (m_key->IsPressed(KeyID::KEY_ID_ESCAPE))
+    {
+        m_window_ptr->close();
+        return;
+    }
+
+    if (m_key->IsPressed(KeyID::KEY_ID_F1))
+    {
+        m_is_full_screen = !m_is_full_screen;
+        m_key->SetReleased(Anvil::KeyID::KEY_ID_F1);
+        if (m_is_full_screen)
+        {
+            GetWindowRect(m_window_ptr->get_handle(), &m_rect_before_full_screen);
+            
+            HWND hDesk = GetDesktopWindow();
+            RECT rc;
+            GetWindowRect(hDesk, &rc);
+            SetWindowLong(m_window_ptr->get_handle(), GWL_STYLE, WS_POPUP);
+            SetWindowPos(m_window_ptr->get_handle(), HWND_TOPMOST, 0, 0, rc.right, rc.bottom, SWP_SHOWWINDOW);
+            recreate_swapchain();
+            return;
+        }
+        else
+        {
+            SetWindowLong(m_window_ptr->get_handle(), GWL_STYLE, WS_OVERLAPPEDWINDOW);
+            SetWindowPos(
+                m_window_ptr->get_handle(), 
+                HWND_TOPMOST,
+                m_rect_before_full_screen.left,
+                m_rect_before_full_screen.top,
+                m_rect_before_full_screen.right,
+                m_rect_before_full_screen.bottom,
+                SWP_SHOWWINDOW);
+            recreate_swapchain();
+            return;
+        }
+    }
+
+    Semaphore* curr_frame_signal_semaphore_ptr = nullptr;
+    Semaphore* curr_frame_wait_semaphore_ptr = nullptr;
+    uint32_t n_swapchain_image;
+    Queue* present_queue_ptr = m_device_ptr->get_universal_queue(0);
+    Semaphore* present_wait_semaphore_ptr = nullptr;
+    const PipelineStageFlags wait_stage_mask = PipelineStageFlagBits::ALL_COMMANDS_BIT;
+
+    /* Determine the signal + wait semaphores to use for drawing this frame */
+    m_n_last_semaphore_used = (m_n_last_semaphore_used + 1) % N_SWAPCHAIN_IMAGES;
+
+    curr_frame_signal_semaphore_ptr = m_frame_signal_semaphores[m_n_last_semaphore_used].get();
+    curr_frame_wait_semaphore_ptr = m_frame_wait_semaphores[m_n_last_semaphore_used].get();
+
+    present_wait_semaphore_ptr = curr_frame_signal_semaphore_ptr;
+
+    /* Determine the semaphore which the swapchain image */
+    {
+        const auto acquire_result = m_swapchain_ptr->acquire_image(
+            curr_frame_wait_semaphore_ptr,
+            &n_swapchain_image,
+            true); /* in_should_block */
+
+        if (acquire_result != SwapchainOperationErrorCode::SUCCESS)
+        {
+            recreate_swapchain();
+            return;
+        }
+    }
+
+    /* 等待该图像上一次提交的指令执行完毕，之后才能改写其对应的动态缓冲 */
+    Fence* curr_frame_fence_ptr = m_frame_fences[n_swapchain_image].get();
+    Vulkan::vkWaitForFences(
+        m_device_ptr->get_device_vk(),
+        1, /* fenceCount */
+        curr_frame_fence_ptr->get_fence_ptr(),
+        VK_TRUE, /* waitAll */
+        UINT64_MAX);
+
+    /* 栅栏在update_data之后才重置，update_data中仍能读到该图像上一次的读回结果 */
+    update_data(n_swapchain_image);
+
+    /* Submit work chunk and present */
+    curr_frame_fence_ptr->reset();
+
+    CommandBufferBase* cmd_buffer_ptrs[2];
+    uint32_t n_cmd_buffers = 0;
+    if (m_decal_update_command_buffers[n_swapchain_image] != nullptr)
+    {
+        cmd_buffer_ptrs[n_cmd_buffers++] = m_decal_update_command_buffers[n_swapchain_image].get();
+    }
+    cmd_buffer_ptrs[n_cmd_buffers++] = m_reuse_clusters ? m_reuse_cluster_command_buffers[n_swapchain_image].get() : m_command_buffers[n_swapchain_image].get();
+
+    present_queue_ptr->submit(
+        SubmitInfo::create(
+            n_cmd_buffers,
+            cmd_buffer_ptrs,
+            1, /* n_semaphores_to_signal */
+            &curr_frame_signal_semaphore_ptr,
+            1, /* n_semaphores_to_wait_on */
+            &curr_frame_wait_semaphore_ptr,
+            &wait_stage_mask,
+            false, /* should_block */
+            curr_frame_fence_ptr)
+    );
+    m_picking_readback->on_submit(n_swapchain_image, curr_frame_fence_ptr, m_n_frame);
+    if (!m_reuse_clusters && m_cluster_occupancy != ClusterOccupancy::OFF)
+    {
+        m_cluster_occupancy_readback->on_submit(n_swapchain_image, curr_frame_fence_ptr, m_n_frame);
+    }
+    m_gpu_timer->on_submit(n_swapchain_image, m_cluster_config_generation);
+    m_n_frame++;
 
     {
         SwapchainOperationErrorCode present_result = SwapchainOperationErrorCode::DEVICE_LOST;
@@ -1829,6 +3194,17 @@ void Engine::draw_frame()
     }
 }
 
+void Engine::reset_title_stats()
+{
+    m_title_elapsed = 0.0f;
+    m_title_frames = 0;
+    m_title_reused_frames = 0;
+    m_title_gpu_ms = 0.0;
+    m_title_gpu_samples = 0;
+    m_title_total_evicted = m_decals->get_stats().total_evicted;
+    m_title_generation = m_cluster_config_generation;
+}
+
 void Engine::update_data(uint32_t in_n_swapchain_image)
 {
     static auto lastTime = chrono::high_resolution_clock::now();
@@ -1836,27 +3212,56 @@ void Engine::update_data(uint32_t in_n_swapchain_image)
     float delta_time = chrono::duration<float, chrono::seconds::period>(currentTime - lastTime).count();
     lastTime = currentTime;
 
-    #pragma region ƶ
-    if (m_key->IsPressed(KeyID::KEY_ID_FORWARD))
+    #pragma region 读取GPU耗时
+    //该图像的栅栏已触发，取回它上一次提交的整帧GPU耗时，丢弃修改配置之前的结果；
+    //配置改变后标题栏的统计也重新开始，不混入之前配置的帧
+    if (m_title_generation != m_cluster_config_generation)
     {
-        m_camera->ProcessKeyboard(FORWARD, delta_time);
+        reset_title_stats();
     }
-    if (m_key->IsPressed(KeyID::KEY_ID_BACKWARD))
+    float gpu_ms;
+    uint64_t gpu_tag;
+    if (m_gpu_timer->collect(in_n_swapchain_image, &gpu_ms, &gpu_tag) && gpu_tag == m_cluster_config_generation)
     {
-        m_camera->ProcessKeyboard(BACKWARD, delta_time);
+        m_title_gpu_ms += gpu_ms;
+        m_title_gpu_samples++;
+        if (m_cluster_autotune_active && m_cluster_autotune_frame > CLUSTER_AUTOTUNE_WARMUP_FRAMES)
+        {
+            m_cluster_autotune_results[m_cluster_autotune_index].total_gpu_ms += gpu_ms;
+            m_cluster_autotune_results[m_cluster_autotune_index].samples++;
+        }
     }
-    if (m_key->IsPressed(KeyID::KEY_ID_LEFT))
+    #pragma endregion
+
+    #pragma region 相机移动
+    if (m_cluster_autotune_active)
     {
-        m_camera->ProcessKeyboard(LEFT, delta_time);
+        //自动调优时相机沿固定路径移动，忽略键盘
+        update_cluster_autotune();
     }
-    if (m_key->IsPressed(KeyID::KEY_ID_RIGHT))
+    else
     {
-        m_camera->ProcessKeyboard(RIGHT, delta_time);
+        if (m_key->IsPressed(KeyID::KEY_ID_FORWARD))
+        {
+            m_camera->ProcessKeyboard(FORWARD, delta_time);
+        }
+        if (m_key->IsPressed(KeyID::KEY_ID_BACKWARD))
+        {
+            m_camera->ProcessKeyboard(BACKWARD, delta_time);
+        }
+        if (m_key->IsPressed(KeyID::KEY_ID_LEFT))
+        {
+            m_camera->ProcessKeyboard(LEFT, delta_time);
+        }
+        if (m_key->IsPressed(KeyID::KEY_ID_RIGHT))
+        {
+            m_camera->ProcessKeyboard(RIGHT, delta_time);
+        }
     }
     #pragma endregion
 
-    #pragma region 
-    //ߴ
+    #pragma region 贴花设置
+    //贴花尺寸
     if (m_key->IsPressed(KeyID::KEY_ID_ADD))
     {
         if (m_key->IsPressed(KeyID::KEY_ID_WIDTH))
@@ -1890,7 +3295,7 @@ void Engine::update_data(uint32_t in_n_swapchain_image)
         }
     }
 
-    //
+    //贴花方向
     if (m_key->IsPressed(KeyID::KEY_ID_ANTICLOCKWIZE))
     {
         m_appsettings.update(ParamType::DECAL_ROTATION, Direction::DOWN, delta_time);
@@ -1900,7 +3305,7 @@ void Engine::update_data(uint32_t in_n_swapchain_image)
         m_appsettings.update(ParamType::DECAL_ROTATION, Direction::UP, delta_time);
     }
 
-    //
+    //贴花属性
     if (m_key->IsPressed(KeyID::KEY_ID_UP))
     {
         if (m_key->IsPressed(KeyID::KEY_ID_F))
@@ -1941,7 +3346,7 @@ void Engine::update_data(uint32_t in_n_swapchain_image)
         }
     }
 
-    //ѡ
+    //选择贴花
     for (int i = 0; i < N_DECALS; i++)
     {
         if (m_key->IsPressed((KeyID)(KeyID::KEY_ID_1 + i)))
@@ -1951,18 +3356,46 @@ void Engine::update_data(uint32_t in_n_swapchain_image)
     }
     if (m_key->IsPressed(KeyID::KEY_ID_TAB))
     {
-        m_appsettings.tab_decal();
+        if (m_key->IsPressed(KeyID::KEY_ID_CTRL))
+        {
+            //Ctrl+Tab切换淘汰策略
+            const uint32_t policy = (static_cast<uint32_t>(m_decals->get_eviction_policy()) + 1) % static_cast<uint32_t>(EvictionPolicy::COUNT);
+            m_decals->set_eviction_policy(static_cast<EvictionPolicy>(policy));
+        }
+        else
+        {
+            m_appsettings.tab_decal();
+        }
         m_key->SetReleased(KeyID::KEY_ID_TAB);
     }
+    if (m_key->IsPressed(KeyID::KEY_ID_R))
+    {
+        if (m_key->IsPressed(KeyID::KEY_ID_CTRL))
+        {
+            //Ctrl+R在控制台输出最近一次读回的完整占用统计
+            ClusterOccupancyStats occupancy;
+            if (m_cluster_occupancy != ClusterOccupancy::OFF && m_cluster_occupancy_readback->poll(m_n_frame, &occupancy))
+            {
+                print_cluster_occupancy(occupancy);
+            }
+        }
+        else
+        {
+            //R依次切换占用统计：关闭、统计、统计并叠加热力图
+            set_cluster_occupancy(ClusterOccupancy((uint32_t(m_cluster_occupancy) + 1) % uint32_t(ClusterOccupancy::COUNT)));
+        }
+        m_key->SetReleased(KeyID::KEY_ID_R);
+    }
     #pragma endregion
 
-    #pragma region д붯̬uniform
+    #pragma region 写入动态uniform
     Queue* queue = m_device_ptr->get_universal_queue(0);
 
     MVPUniform mvp;
     mvp.model = scale(mat4(1.0f), vec3(0.01f, 0.01f, 0.01f));
     mvp.view = m_camera->GetViewMatrix();
     mvp.proj = m_camera->GetProjMatrix();
+    mvp.inv_view_proj = inverse(mvp.proj * mvp.view);
     m_mvp_dynamic_buffer_helper->update(queue, &mvp, in_n_swapchain_image);
 
     SunLightUniform sun_light;
@@ -1976,59 +3409,185 @@ void Engine::update_data(uint32_t in_n_swapchain_image)
 
     CursorDecal cursorDecal;
     uint decal_id = m_appsettings.get_decal_id();
-    vec2 decal_size = m_model->get_texture_size(decal_id * 2);
+    vec2 decal_size = m_model->get_decal_atlas()->get_size(decal_id);
     cursorDecal.size = vec3(
         decal_size.x * m_appsettings.getParam(ParamType::DECAL_SCALE_X),
         decal_size.y * m_appsettings.getParam(ParamType::DECAL_SCALE_Y),
         m_appsettings.getParam(ParamType::DECAL_THICKNESS));
-    cursorDecal.albedoTexIdx = decal_id * 2;
-    cursorDecal.normalTexIdx = decal_id * 2 + 1;
+    cursorDecal.layer = decal_id;
     cursorDecal.rotation = m_appsettings.getParam(ParamType::DECAL_ROTATION);
     cursorDecal.angle_fade = m_appsettings.getParam(ParamType::DECAL_ANGLE_FADE);
     cursorDecal.albedo = m_appsettings.getParam(ParamType::DECAL_ALBEDO);
     cursorDecal.intensity = m_appsettings.getParam(ParamType::DECAL_INDENSITY);
     m_cursor_decal_dynamic_buffer_helper->update(queue, &cursorDecal, in_n_swapchain_image);
+    #pragma endregion
 
-    update_decal();
-    m_decal_indices_dynamic_buffer_helper->update(queue, &m_indexUniform, in_n_swapchain_image);
-    m_decal_ZBounds_dynamic_buffer_helper->update(queue, &m_zBoundsUniform, in_n_swapchain_image);
+    #pragma region 更新贴花可见性与统计
+    //只有按可见性淘汰时才逐贴花做CPU视锥剔除，GPU_DECAL_CULLING的剔除结果不回读
+    m_decals->update_visibility(mvp.proj * mvp.view, m_camera->GetCameraWorldPos(), m_n_frame);
     #pragma endregion
 
-    #pragma region ¼
-    if (m_mouse->isClick())
+    #pragma region 处理点击事件，存入贴花
+    PickingStorage pickingStorage;
+    if (m_mouse->isClick() && m_picking_readback->poll(m_n_frame, &pickingStorage, &m_picking_age))
     {
-        PickingStorage pickingStorage;
-        m_picking_storage_buffer_ptr->read(
-            0,
-            sizeof(PickingStorage),
-            &pickingStorage,
-            queue);
-        m_decals[(m_n_decal++) % N_MAX_STORED_DECALS] = Decal(pickingStorage.Position, pickingStorage.Normal, cursorDecal);
-        m_decals_uniform_buffer_ptr->write(
-            0, /* start_offset */
-            m_decals_buffer_size,
-            m_decals,
-            m_device_ptr->get_universal_queue(0));
-
-        update_decal();
-        m_decal_indices_dynamic_buffer_helper->update(queue, &m_indexUniform, in_n_swapchain_image);
-        m_decal_ZBounds_dynamic_buffer_helper->update(queue, &m_zBoundsUniform, in_n_swapchain_image);
+        //贴花数量与间接绘制参数每帧写入，只有容量增长时才需要等待设备空闲并重新记录指令缓冲
+        //达到上限后新贴花原地替换被淘汰的贴花，容量不再增长
+        const bool grow = m_decals->will_grow();
+        if (grow)
+        {
+            Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+            for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+            {
+                m_command_buffers[n_swapchain_image].reset();
+                m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+            }
+        }
 
-        Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
-        for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+        //追加时只写入新贴花所在的槽位，正在执行的帧不会读取该槽位；淘汰时的槽位由record_decal_updates在本帧的指令中写入
+        if (m_decals->add(Decal(pickingStorage.Position, pickingStorage.Normal, cursorDecal), queue))
         {
-            m_command_buffers[n_swapchain_image].reset();
+            recreate_decal_resources();
+        }
+
+        if (grow)
+        {
+            init_command_buffers();
         }
-        init_command_buffers();
 
         m_mouse->release();
     }
+
+    //该图像上一次提交的指令已执行完毕，可以释放上一次的贴花写入指令
+    m_decal_update_command_buffers[in_n_swapchain_image].reset();
+    if (!m_decals->get_pending_writes().empty())
+    {
+        record_decal_updates(in_n_swapchain_image);
+    }
+    #pragma endregion
+
+    #pragma region 判断本帧能否沿用cluster结果
+    //cluster只取决于视角、投影和贴花集合(深度来自静态场景)，三者都未变化时跳过剔除、分组与压缩
+    const uint64_t decal_generation = m_decals->get_generation();
+    m_reuse_clusters = m_cluster_state_valid
+        && mvp.view == m_cluster_view
+        && mvp.proj == m_cluster_proj
+        && decal_generation == m_cluster_decal_generation;
+    if (!m_reuse_clusters)
+    {
+        m_cluster_view = mvp.view;
+        m_cluster_proj = mvp.proj;
+        m_cluster_decal_generation = decal_generation;
+        m_cluster_state_valid = true;
+    }
+    #pragma endregion
+
+    #pragma region CPU分组，结果写入本图像的上传区
+    //该图像上一次提交的指令已执行完毕，其上传区可以改写；贴花的变换与包围盒直接用DecalStore中缓存的
+    if (!m_reuse_clusters && m_cluster_binning == ClusterBinning::CPU)
+    {
+        const uint32_t n_decals = m_decals->get_size();
+        m_cluster_reference->build(
+            n_decals > 0 ? &m_decals->get(0) : nullptr,
+            n_decals > 0 ? &m_decals->get_transform(0) : nullptr,
+            m_decals->get_bounds(),
+            n_decals,
+            mvp.view,
+            mvp.proj);
+
+        const vector<uint32_t>& bitmask = m_cluster_reference->get_bitmask();
+        m_cluster_upload_buffer_ptr->write(
+            m_cluster_buffer_size * in_n_swapchain_image, /* start_offset */
+            sizeof(uint32_t) * bitmask.size(),
+            bitmask.data());
+    }
+    #pragma endregion
+
+    #pragma region 每秒在标题栏显示帧时间、cluster配置与贴花统计
+    //evicted为单帧计数，标题栏改为显示这一秒内的淘汰数
+    m_title_elapsed += delta_time;
+    m_title_frames++;
+    if (m_reuse_clusters)
+    {
+        m_title_reused_frames++;
+    }
+    if (m_title_elapsed >= 1.0f)
+    {
+        //占用统计开启时附加非空cluster的平均贴花数、单个cluster的最大贴花数和空cluster的比例
+        char occupancy_text[96] = "";
+        ClusterOccupancyStats occupancy;
+        if (m_cluster_occupancy != ClusterOccupancy::OFF && m_cluster_occupancy_readback->poll(m_n_frame, &occupancy))
+        {
+            uint64_t num_clusters = 0;
+            uint64_t total_decals = 0;
+            uint max_decals = 0;
+            for (uint32_t i = 0; i < ClusterOccupancyStats::HISTOGRAM_BINS; i++)
+            {
+                num_clusters += occupancy.cluster_histogram[i];
+            }
+            for (uint32_t i = 0; i < ClusterOccupancyStats::MAX_Z_SLICES; i++)
+            {
+                total_decals += occupancy.slice_decals[i];
+                max_decals = std::max(max_decals, occupancy.slice_max[i]);
+            }
+            const uint64_t occupied_clusters = num_clusters - occupancy.cluster_histogram[0];
+            sprintf_s(occupancy_text, " - occupancy: %.2f avg, %u max, %.0f%% empty",
+                occupied_clusters > 0 ? double(total_decals) / occupied_clusters : 0.0,
+                max_decals,
+                num_clusters > 0 ? 100.0 * occupancy.cluster_histogram[0] / num_clusters : 0.0);
+        }
+
+        //可见数只在需要可见性的淘汰策略下统计
+        const DecalStoreStats& stats = m_decals->get_stats();
+        char visible_text[32] = "";
+        if (m_decals->get_eviction_policy() == EvictionPolicy::LEAST_RECENTLY_VISIBLE)
+        {
+            sprintf_s(visible_text, ", %u visible", stats.visible);
+        }
+        char title[512];
+        sprintf_s(title, "%s - %.2f ms (GPU %.2f ms), binning: %s%s (%.0f%% skipped), tile %u, %u slices%s%s%s%s - %u lights - decals: %u live%s, picked %llu frame(s) old, %llu evicted/s (%llu total), eviction: %s%s",
+            APP_NAME,
+            m_title_elapsed * 1000.0f / m_title_frames,
+            m_title_gpu_samples > 0 ? m_title_gpu_ms / m_title_gpu_samples : 0.0,
+            get_cluster_binning_name(m_cluster_binning),
+            m_cluster_binning == ClusterBinning::RASTER && m_conservative_cluster_raster ? " conservative" : "",
+            100.0f * m_title_reused_frames / m_title_frames,
+            m_tile_size,
+            m_num_z_tiles,
+            m_deferred_decal_cache_active ? ", decal cache" : "",
+            m_scalarized_decal_loop ? ", scalarized" : "",
+            m_tile_classification ? ", tile classes" : "",
+            m_cluster_autotune_active ? " (auto-tuning)" : "",
+            m_num_lights,
+            stats.live,
+            visible_text,
+            static_cast<unsigned long long>(m_picking_age),
+            stats.total_evicted - m_title_total_evicted,
+            stats.total_evicted,
+            DecalStore::get_eviction_policy_name(m_decals->get_eviction_policy()),
+            occupancy_text);
+        SetWindowTextA(m_window_ptr->get_handle(), title);
+        reset_title_stats();
+    }
+    #pragma endregion
+
+    #pragma region 上传贴花剔除数据
+    DecalCullingUniform decalCulling;
+    decalCulling.numDecals = m_decals->get_size();
+    m_decal_culling_dynamic_buffer_helper->update(queue, &decalCulling, in_n_swapchain_image);
+
+    //GPU剔除时剔除与分组由cull_decals在指令缓冲中完成；沿用cluster结果的帧不需要剔除
+    if (!m_gpu_decal_culling && !m_reuse_clusters)
+    {
+        update_decal();
+        upload_decal_culling(in_n_swapchain_image);
+    }
     #pragma endregion
 }
 
 void Engine::update_decal()
 {
-    #pragma region nearClipΧ
+    #pragma region nearClip包围盒
     BoundingOrientedBox nearClipBox;
     mat4 invProjection = inverse(m_camera->GetProjMatrix());
     vec4 nearTopRight_t = invProjection * vec4(1.0f, -1.0f, 0.0f, 1.0f);
@@ -2038,57 +3597,45 @@ void Engine::update_decal()
     nearClipBox.Orientation = m_camera->GetCameraWorldOrientation();
     #pragma endregion
 
-    const vec3 boxVerts[8] = { vec3(-1,  1, -1), vec3(1,  1, -1), vec3(-1,  1, 1), vec3(1,  1, 1),
-                               vec3(-1, -1, -1), vec3(1, -1, -1), vec3(-1, -1, 1), vec3(1, -1, 1) };
-    const float zRange = m_camera->GetFarZ() - m_camera->GetNearZ();
-    const int numDecalsToUpdate = std::min(m_n_decal, N_MAX_STORED_DECALS);
-    bool intersectsCamera[N_MAX_STORED_DECALS] = { };
+    const mat4 view = m_camera->GetViewMatrix();
+    const uint numDecalsToUpdate = m_decals->get_size();
+    vector<uint8_t> intersectsCamera(numDecalsToUpdate);
+    m_indexUniform.numIntersectingDecals = 0;
+    m_indexUniform.decalIndices.resize(numDecalsToUpdate);
+    m_zBoundsUniform.ZBounds.resize(numDecalsToUpdate);
     for (uint decalIdx = 0; decalIdx < numDecalsToUpdate; ++decalIdx)
     {
-        #pragma region еķ
-        const Decal& decal = m_decals[decalIdx];
-        vec3 forward = -decal.normal;
-        vec3 up = abs(dot(forward, vec3(0.0f, 1.0f, 0.0f))) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(0.0f, 0.0f, 1.0f);
-        vec3 right = normalize(cross(up, forward));
-        up = cross(forward, right);
-        mat3 decalOrientation(right, up, forward);
-        #pragma endregion
-
-        #pragma region zΧ
+        #pragma region 计算贴花z范围
+        //角点在放置时已变换到世界空间，这里只需观察空间的z分量(view为仿射矩阵，w恒为1)
+        const DecalTransform& transform = m_decals->get_transform(decalIdx);
         float minZ = std::numeric_limits<float>::max();
         float maxZ = -std::numeric_limits<float>::max();
         for (uint i = 0; i < 8; ++i)
         {
-            vec3 boxVert = boxVerts[i] * decal.size;
-            boxVert = mat3(cos(decal.rotation), -sin(decal.rotation), 0,
-                           sin(decal.rotation), cos(decal.rotation), 0,
-                           0, 0, 1) * boxVert;
-            boxVert = decalOrientation * boxVert;
-            boxVert += decal.position;
-
-            vec4 vert = m_camera->GetViewMatrix() * vec4(boxVert, 1.0f);
-            vert = vert / vert.w;
-            float vertZ = -vert.z;
+            const vec3& corner = transform.corners[i];
+            float vertZ = -(view[0][2] * corner.x + view[1][2] * corner.y + view[2][2] * corner.z + view[3][2]);
             minZ = std::min(minZ, vertZ);
             maxZ = std::max(maxZ, vertZ);
         }
-        minZ = clamp((minZ - m_camera->GetNearZ()) / zRange, 0.0f, 1.0f);
-        maxZ = clamp((maxZ - m_camera->GetNearZ()) / zRange, 0.0f, 1.0f);
-        uint minZTile = uint(minZ * NUM_Z_TILES);
-        uint maxZTile = std::min(int(maxZ * NUM_Z_TILES), NUM_Z_TILES - 1);
+        uint minZTile = m_cluster_constants.get_z_slice(minZ);
+        uint maxZTile = m_cluster_constants.get_z_slice(maxZ);
         m_zBoundsUniform.ZBounds[decalIdx] = uvec2(uint32(minZTile), uint32(maxZTile));
         #pragma endregion
+    }
 
-        #pragma region ƽΧײ
-        BoundingOrientedBox decalBox;
-        decalBox.Center = decal.position;
-        decalBox.Extents = decal.size;
-        decalBox.Orientation = decalOrientation;
-        intersectsCamera[decalIdx] = Intersects(nearClipBox, decalBox);
-        #pragma endregion
+    #pragma region 贴花盒与近平面包围盒碰撞检测
+    //SoA批量测试，一次4/8个贴花
+    DecalBounds* bounds = m_decals->get_bounds();
+    bounds->intersects(nearClipBox, intersectsCamera.data());
+#ifdef _DEBUG
+    for (uint decalIdx = 0; decalIdx < numDecalsToUpdate; ++decalIdx)
+    {
+        anvil_assert((intersectsCamera[decalIdx] != 0) == Intersects(nearClipBox, bounds->get(decalIdx)));
     }
+#endif
+    #pragma endregion
 
-    #pragma region ײΪ
+    #pragma region 根据碰撞检测结果将贴花分为两类
     for (uint64 decalIdx = 0; decalIdx < numDecalsToUpdate; ++decalIdx)
         if (intersectsCamera[decalIdx])
             m_indexUniform.decalIndices[m_indexUniform.numIntersectingDecals++] = uint32(decalIdx);
@@ -2100,6 +3647,216 @@ void Engine::update_decal()
     #pragma endregion
 }
 
+void Engine::upload_decal_culling(uint32_t in_n_swapchain_image)
+{
+    Queue* queue = m_device_ptr->get_universal_queue(0);
+
+    m_decal_indices_dynamic_buffer_helper->update(
+        queue,
+        &m_indexUniform.numIntersectingDecals,
+        in_n_swapchain_image);
+    m_decal_indices_dynamic_buffer_helper->update(
+        queue,
+        m_indexUniform.decalIndices.data(),
+        in_n_swapchain_image,
+        m_indexUniform.decalIndices.size(),
+        1); /* first_element：跳过numIntersectingDecals */
+    m_decal_ZBounds_dynamic_buffer_helper->update(
+        queue,
+        m_zBoundsUniform.ZBounds.data(),
+        in_n_swapchain_image,
+        m_zBoundsUniform.ZBounds.size());
+
+    VkDrawIndexedIndirectCommand draw_commands[3];
+    for (int i = 0; i < 3; i++)
+    {
+        draw_commands[i].indexCount = 36;
+        draw_commands[i].instanceCount = (i == 0) ? m_indexUniform.numIntersectingDecals : m_decals->get_size() - m_indexUniform.numIntersectingDecals;
+        draw_commands[i].firstIndex = 0;
+        draw_commands[i].vertexOffset = 0;
+        draw_commands[i].firstInstance = 0;
+    }
+    m_cluster_draw_commands_dynamic_buffer_helper->update(
+        queue,
+        draw_commands,
+        in_n_swapchain_image,
+        3);
+}
+
+void Engine::cull_decals(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer)
+{
+    Queue* universal_queue_ptr(m_device_ptr->get_universal_queue(0));
+
+    const VkDeviceSize indices_offset = m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer;
+    const VkDeviceSize draw_commands_offset = m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer;
+
+    #pragma region 等待上一次使用结束后再清零计数
+    {
+        BufferBarrier buffer_barriers[2] = {
+            BufferBarrier(
+                AccessFlagBits::SHADER_READ_BIT,                /* in_source_access_mask      */
+                AccessFlagBits::TRANSFER_WRITE_BIT,             /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_decal_indices_dynamic_buffer_helper->getBuffer(),
+                indices_offset,                                 /* in_offset                  */
+                sizeof(uint)),
+            BufferBarrier(
+                AccessFlagBits::INDIRECT_COMMAND_READ_BIT,      /* in_source_access_mask      */
+                AccessFlagBits::TRANSFER_WRITE_BIT,             /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+                draw_commands_offset,                           /* in_offset                  */
+                m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage())
+        };
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::DRAW_INDIRECT_BIT | PipelineStageFlagBits::VERTEX_SHADER_BIT,
+            PipelineStageFlagBits::TRANSFER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            2,               /* in_buffer_memory_barrier_count */
+            buffer_barriers,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+    }
+    #pragma endregion
+
+    #pragma region 清零计数
+    VkDrawIndexedIndirectCommand draw_commands[3];
+    for (int i = 0; i < 3; i++)
+    {
+        draw_commands[i].indexCount = 36;
+        draw_commands[i].instanceCount = 0;
+        draw_commands[i].firstIndex = 0;
+        draw_commands[i].vertexOffset = 0;
+        draw_commands[i].firstInstance = 0;
+    }
+    cmd_buffer_ptr->record_update_buffer(
+        m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+        draw_commands_offset,
+        sizeof(draw_commands),
+        reinterpret_cast<const uint32_t*>(draw_commands));
+    cmd_buffer_ptr->record_fill_buffer(
+        m_decal_indices_dynamic_buffer_helper->getBuffer(),
+        indices_offset,
+        sizeof(uint), /* numIntersectingDecals */
+        0);
+
+    {
+        BufferBarrier buffer_barriers[2] = {
+            BufferBarrier(
+                AccessFlagBits::TRANSFER_WRITE_BIT,             /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::SHADER_WRITE_BIT, /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_decal_indices_dynamic_buffer_helper->getBuffer(),
+                indices_offset,                                 /* in_offset                  */
+                sizeof(uint)),
+            BufferBarrier(
+                AccessFlagBits::TRANSFER_WRITE_BIT,             /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::SHADER_WRITE_BIT, /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+                draw_commands_offset,                           /* in_offset                  */
+                m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage())
+        };
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::TRANSFER_BIT,
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            2,               /* in_buffer_memory_barrier_count */
+            buffer_barriers,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+    }
+    #pragma endregion
+
+    #pragma region 剔除
+    {
+        cmd_buffer_ptr->record_bind_pipeline(
+            PipelineBindPoint::COMPUTE,
+            m_decal_culling_compute_pipeline_id);
+
+        DescriptorSet* ds_ptr[3] = {
+            m_dsg_ptr->get_descriptor_set(1),
+            m_dsg_ptr->get_descriptor_set(5 + N_SWAPCHAIN_IMAGES),
+            m_dsg_ptr->get_descriptor_set(6 + N_SWAPCHAIN_IMAGES)
+        };
+        const uint32_t data_ub_offset[5] = {
+            static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+            static_cast<uint32_t>(indices_offset),
+            static_cast<uint32_t>(m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+            static_cast<uint32_t>(draw_commands_offset),
+            static_cast<uint32_t>(m_decal_culling_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer)
+        };
+
+        cmd_buffer_ptr->record_bind_descriptor_sets(
+            PipelineBindPoint::COMPUTE,
+            getPineLine(6),
+            0, /* firstSet */
+            3, /* setCount */
+            ds_ptr,
+            5,                /* dynamicOffsetCount */
+            data_ub_offset); /* pDynamicOffsets    */
+
+        //按容量派发，实际贴花数每帧从uniform中读取，放置贴花后无需重新记录
+        cmd_buffer_ptr->record_dispatch(
+            (m_decals->get_capacity() + 63) / 64,
+            1,
+            1);
+    }
+    #pragma endregion
+
+    #pragma region 确保剔除结果对cluster可见
+    {
+        BufferBarrier buffer_barriers[3] = {
+            BufferBarrier(
+                AccessFlagBits::SHADER_WRITE_BIT,               /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT,                /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_decal_indices_dynamic_buffer_helper->getBuffer(),
+                indices_offset,                                 /* in_offset                  */
+                m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage()),
+            BufferBarrier(
+                AccessFlagBits::SHADER_WRITE_BIT,               /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT,                /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_decal_ZBounds_dynamic_buffer_helper->getBuffer(),
+                m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer, /* in_offset */
+                m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage()),
+            BufferBarrier(
+                AccessFlagBits::SHADER_WRITE_BIT,               /* in_source_access_mask      */
+                AccessFlagBits::INDIRECT_COMMAND_READ_BIT,      /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),  /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),  /* in_dst_queue_family_index  */
+                m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+                draw_commands_offset,                           /* in_offset                  */
+                m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage())
+        };
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            PipelineStageFlagBits::DRAW_INDIRECT_BIT | PipelineStageFlagBits::VERTEX_SHADER_BIT | PipelineStageFlagBits::FRAGMENT_SHADER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            3,               /* in_buffer_memory_barrier_count */
+            buffer_barriers,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+    }
+    #pragma endregion
+}
+
 void Engine::mouse_move_callback(CallbackArgument* argumentPtr)
 {
     double mouse_x_pos = reinterpret_cast<OnMouseMoveCallbackArgument*>(argumentPtr)->mouse_x_pos;
@@ -2151,7 +3908,7 @@ void Engine::key_release_callback(CallbackArgument* argumentPtr)
 }
 #pragma endregion
 
-#pragma region ж
+#pragma region 卸载
 Engine::~Engine()
 {
     deinit();
@@ -2165,6 +3922,8 @@ void Engine::cleanup_swapwhain()
     for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
     {
         m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+        m_decal_update_command_buffers[n_swapchain_image].reset();
     }
 
     m_depth_image_view_ptr.reset();
@@ -2180,6 +3939,8 @@ void Engine::cleanup_swapwhain()
     m_uv_and_depth_gradient_image_ptr.reset();
     m_uv_gradient_image_ptr.reset();
     m_material_id_image_ptr.reset();
+    m_scene_color_image_view_ptr.reset();
+    m_scene_color_image_ptr.reset();
     
     m_fbo.reset();
 
@@ -2193,10 +3954,23 @@ void Engine::cleanup_swapwhain()
     }
 
     auto compute_pipeline_manager_ptr(m_device_ptr->get_compute_pipeline_manager());
-    compute_pipeline_manager_ptr->delete_pipeline(m_deferred_compute_pipeline_id);
-    m_deferred_compute_pipeline_id = UINT32_MAX;
+    delete_deferred_pipelines(compute_pipeline_manager_ptr);
     compute_pipeline_manager_ptr->delete_pipeline(m_picking_compute_pipeline_id);
     m_picking_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_decal_culling_compute_pipeline_id);
+    m_decal_culling_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_cluster_binning_compute_pipeline_id);
+    m_cluster_binning_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_tile_depth_bounds_compute_pipeline_id);
+    m_tile_depth_bounds_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_cluster_compaction_compute_pipeline_id);
+    m_cluster_compaction_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_cluster_occupancy_compute_pipeline_id);
+    m_cluster_occupancy_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_tile_classification_compute_pipeline_id);
+    m_tile_classification_compute_pipeline_id = UINT32_MAX;
+    compute_pipeline_manager_ptr->delete_pipeline(m_light_binning_compute_pipeline_id);
+    m_light_binning_compute_pipeline_id = UINT32_MAX;
     
     
     m_renderpass_ptr.reset();
@@ -2212,6 +3986,7 @@ void Engine::deinit()
     m_sampler.reset();
 
     m_frame_signal_semaphores.clear();
+    m_frame_fences.clear();
     m_frame_wait_semaphores.clear();
 
     m_rendering_surface_ptr.reset();
@@ -2224,12 +3999,26 @@ void Engine::deinit()
     delete m_cursor_decal_dynamic_buffer_helper;
     delete m_decal_indices_dynamic_buffer_helper;
     delete m_decal_ZBounds_dynamic_buffer_helper;
+    delete m_cluster_draw_commands_dynamic_buffer_helper;
+    delete m_decal_culling_dynamic_buffer_helper;
 
-    m_decals_uniform_buffer_ptr.reset();
+    m_decals.reset();
     m_picking_storage_buffer_ptr.reset();
+    delete m_picking_readback;
+    m_cluster_occupancy_buffer_ptr.reset();
+    delete m_cluster_occupancy_readback;
+    delete m_gpu_timer;
     m_box_vertex_buffer_ptr.reset();
     m_box_index_buffer_ptr.reset();
     m_cluster_storage_buffer_ptr.reset();
+    m_cluster_upload_buffer_ptr.reset();
+    delete m_cluster_reference;
+    m_tile_depth_bounds_buffer_ptr.reset();
+    m_cluster_headers_buffer_ptr.reset();
+    m_cluster_indices_buffer_ptr.reset();
+    m_tile_classification_buffer_ptr.reset();
+    m_light_buffer_ptr.reset();
+    m_light_cluster_buffer_ptr.reset();
 
     m_cluster_vs_ptr.reset();
     m_cluster_fs_ptr.reset();
@@ -2237,6 +4026,15 @@ void Engine::deinit()
     m_GBuffer_fs_ptr.reset();
     m_picking_cs_ptr.reset();
     m_deferred_cs_ptr.reset();
+    m_deferred_decal_cache_cs_ptr.reset();
+    m_deferred_tile_class_cs_ptr.reset();
+    m_decal_culling_cs_ptr.reset();
+    m_cluster_binning_cs_ptr.reset();
+    m_tile_depth_bounds_cs_ptr.reset();
+    m_cluster_compaction_cs_ptr.reset();
+    m_cluster_occupancy_cs_ptr.reset();
+    m_tile_classification_cs_ptr.reset();
+    m_light_binning_cs_ptr.reset();
 
     m_model.reset();
 
@@ -2247,8 +4045,8 @@ void Engine::deinit()
 }
 #pragma endregion
 
-#pragma region 
-ShaderModuleStageEntryPoint* Engine::create_shader(string file, ShaderStage type, string name)
+#pragma region 工具
+ShaderModuleStageEntryPoint* Engine::create_shader(string file, ShaderStage type, string name, const vector<string>& definitions, SpvVersion spirv_version)
 {
     GLSLShaderToSPIRVGeneratorUniquePtr shader_ptr;
     ShaderModuleUniquePtr               shader_module_ptr;
@@ -2257,7 +4055,13 @@ ShaderModuleStageEntryPoint* Engine::create_shader(string file, ShaderStage type
         m_device_ptr.get(),
         GLSLShaderToSPIRVGenerator::MODE_LOAD_SOURCE_FROM_FILE,
         file,
-        type);
+        type,
+        spirv_version);
+
+    for (const string& definition : definitions)
+    {
+        shader_ptr->add_definition_value_pair(definition, 1);
+    }
 
     shader_module_ptr = ShaderModule::create_from_spirv_generator(
         m_device_ptr.get(),
@@ -2285,8 +4089,8 @@ void Engine::create_image_source(ImageUniquePtr& image, ImageViewUniquePtr& imag
         format,
         ImageTiling::OPTIMAL,
         usage | ImageUsageFlagBits::SAMPLED_BIT,
-        m_width,
-        m_height,
+        m_render_width,
+        m_render_height,
         1,
         1,
         SampleCountFlagBits::_1_BIT,
@@ -2362,6 +4166,19 @@ void Engine::create_cluster_pipeline(GraphicsPipelineManager* gfxPipelineManager
     gfx_pipeline_create_info_ptr->toggle_depth_test(false, CompareOp::LESS);
     gfx_pipeline_create_info_ptr->toggle_depth_writes(false);
 
+    if (m_conservative_cluster_raster)
+    {
+        //视口缩小为渲染分辨率除以tile边长，每个像素即一个tile；最右、最下一列不完整的tile同样只占一个像素
+        gfx_pipeline_create_info_ptr->set_conservative_rasterization_mode(ConservativeRasterizationModeEXT::OVERESTIMATE);
+        gfx_pipeline_create_info_ptr->set_viewport_properties(0, 0.0f, 0.0f, static_cast<float>(m_render_width) / m_tile_size, static_cast<float>(m_render_height) / m_tile_size, 0.0f, 1.0f);
+        gfx_pipeline_create_info_ptr->set_scissor_box_properties(0, 0, 0, m_num_x_tiles, m_num_y_tiles);
+    }
+    else
+    {
+        gfx_pipeline_create_info_ptr->set_viewport_properties(0, 0.0f, 0.0f, static_cast<float>(m_render_width), static_cast<float>(m_render_height), 0.0f, 1.0f);
+        gfx_pipeline_create_info_ptr->set_scissor_box_properties(0, 0, 0, m_render_width, m_render_height);
+    }
+
     gfx_pipeline_create_info_ptr->add_vertex_binding(
         0, /* in_binding */
         VertexInputRate::VERTEX,
@@ -2369,31 +4186,928 @@ void Engine::create_cluster_pipeline(GraphicsPipelineManager* gfxPipelineManager
         VertexOnlyPos::getVertexInputAttribute().size(), /* in_n_attributes */
         VertexOnlyPos::getVertexInputAttribute().data());
 
-    int32 num_decals = N_MAX_STORED_DECALS;
-    float near_clip = m_camera->GetNearZ();
-    float far_clip = m_camera->GetFarZ();
-    uint num_x_tiles = m_num_x_tiles;
-    uint num_y_tiles = m_num_y_tiles;
-    uint num_z_tiles = NUM_Z_TILES;
-    uint elements_per_cluster = (N_MAX_STORED_DECALS + 31) / 32;
-    uint tile_size = Tile_Size;
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::VERTEX, 0, 4, &num_decals);
     gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::VERTEX, 1, 4, &mode);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 0, 4, &num_decals);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 1, 4, &near_clip);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 2, 4, &far_clip);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 3, 4, &num_x_tiles);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 4, 4, &num_y_tiles);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 5, 4, &num_z_tiles);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 6, 4, &elements_per_cluster);
-    gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 7, 4, &tile_size);
     gfx_pipeline_create_info_ptr->add_specialization_constant(ShaderStage::FRAGMENT, 8, 4, &mode);
+    add_cluster_specialization_constants(gfx_pipeline_create_info_ptr.get(), ShaderStage::FRAGMENT);
 
     gfxPipelineManager->add_pipeline(
         move(gfx_pipeline_create_info_ptr),
         &m_cluster_gfx_pipeline_id[mode]);
 }
 
+void Engine::create_deferred_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    create_deferred_pipeline(
+        computePipelineManager,
+        m_deferred_decal_cache_active ? m_deferred_decal_cache_cs_ptr.get() : m_deferred_cs_ptr.get(),
+        nullptr,
+        &m_deferred_compute_pipeline_id);
+
+    //三类共用同一个着色器模块，由特化常量TILE_CLASS区分，死代码由驱动在特化时去掉
+    for (uint32_t tile_class = 0; tile_class < uint32_t(TileClass::COUNT); tile_class++)
+    {
+        create_deferred_pipeline(
+            computePipelineManager,
+            m_deferred_tile_class_cs_ptr.get(),
+            &tile_class,
+            &m_deferred_tile_class_compute_pipeline_id[tile_class]);
+    }
+}
+
+void Engine::delete_deferred_pipelines(ComputePipelineManager* computePipelineManager)
+{
+    computePipelineManager->delete_pipeline(m_deferred_compute_pipeline_id);
+    m_deferred_compute_pipeline_id = UINT32_MAX;
+    for (uint32_t tile_class = 0; tile_class < uint32_t(TileClass::COUNT); tile_class++)
+    {
+        computePipelineManager->delete_pipeline(m_deferred_tile_class_compute_pipeline_id[tile_class]);
+        m_deferred_tile_class_compute_pipeline_id[tile_class] = UINT32_MAX;
+    }
+}
+
+void Engine::create_deferred_pipeline(ComputePipelineManager* computePipelineManager, ShaderModuleStageEntryPoint* shader_ptr, const uint32_t* tile_class, PipelineID* pipeline_id_ptr)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *shader_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(0));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(2));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(3));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(4));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(5 + N_SWAPCHAIN_IMAGES));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+    compute_pipeline_create_info_ptr->attach_push_constant_range(
+        0,
+        sizeof(m_deferred_constants),
+        ShaderStageFlagBits::COMPUTE_BIT);
+
+    int SIZE = m_model->get_material_num();
+    compute_pipeline_create_info_ptr->add_specialization_constant(0, 4, &SIZE);
+    if (tile_class != nullptr)
+    {
+        compute_pipeline_create_info_ptr->add_specialization_constant(1, 4, tile_class);
+    }
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        pipeline_id_ptr);
+}
+
+void Engine::create_decal_culling_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_decal_culling_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(1));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(5 + N_SWAPCHAIN_IMAGES));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(6 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_decal_culling_compute_pipeline_id);
+}
+
+void Engine::create_cluster_binning_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_cluster_binning_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(1));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(5 + N_SWAPCHAIN_IMAGES));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(6 + N_SWAPCHAIN_IMAGES));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+    compute_pipeline_create_info_ptr->attach_push_constant_range(
+        0,
+        sizeof(m_deferred_constants),
+        ShaderStageFlagBits::COMPUTE_BIT);
+
+    uint use_tile_depth_bounds = m_tile_depth_bounds ? 1 : 0;
+    compute_pipeline_create_info_ptr->add_specialization_constant(0, 4, &use_tile_depth_bounds);
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_cluster_binning_compute_pipeline_id);
+}
+
+void Engine::bin_clusters(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer)
+{
+    cmd_buffer_ptr->record_bind_pipeline(
+        PipelineBindPoint::COMPUTE,
+        m_cluster_binning_compute_pipeline_id);
+
+    //与cluster()绑定相同的描述符集，动态偏移一致
+    DescriptorSet* ds_ptr[4] = {
+        m_dsg_ptr->get_descriptor_set(1),
+        m_dsg_ptr->get_descriptor_set(5 + N_SWAPCHAIN_IMAGES),
+        m_dsg_ptr->get_descriptor_set(6 + N_SWAPCHAIN_IMAGES),
+        m_dsg_ptr->get_descriptor_set(7 + N_SWAPCHAIN_IMAGES)
+    };
+    const uint32_t data_ub_offset[5] = {
+        static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+        static_cast<uint32_t>(m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+        static_cast<uint32_t>(m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+        static_cast<uint32_t>(m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+        static_cast<uint32_t>(m_decal_culling_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer)
+    };
+
+    cmd_buffer_ptr->record_bind_descriptor_sets(
+        PipelineBindPoint::COMPUTE,
+        getPineLine(7),
+        0, /* firstSet */
+        4, /* setCount */
+        ds_ptr,
+        5,                /* dynamicOffsetCount */
+        data_ub_offset); /* pDynamicOffsets    */
+
+    m_deferred_constants.RTSize.x = m_render_width;
+    m_deferred_constants.RTSize.y = m_render_height;
+    cmd_buffer_ptr->record_push_constants(
+        getPineLine(7),
+        ShaderStageFlagBits::COMPUTE_BIT,
+        0, /* in_offset */
+        sizeof(DeferredConstants),
+        &m_deferred_constants);
+
+    //每个工作组一个贴花，按容量派发，超过单维上限时折成二维
+    const uint32_t max_group_count_x = 65535;
+    const uint32_t capacity = m_decals->get_capacity();
+    cmd_buffer_ptr->record_dispatch(
+        std::min(capacity, max_group_count_x),
+        (capacity + max_group_count_x - 1) / max_group_count_x,
+        1);
+}
+
+void Engine::create_tile_depth_bounds_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_tile_depth_bounds_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(1));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(3));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+    compute_pipeline_create_info_ptr->attach_push_constant_range(
+        0,
+        sizeof(m_deferred_constants),
+        ShaderStageFlagBits::COMPUTE_BIT);
+
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_tile_depth_bounds_compute_pipeline_id);
+}
+
+void Engine::compute_tile_depth_bounds(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer)
+{
+    Queue* universal_queue_ptr(m_device_ptr->get_universal_queue(0));
+
+    //上一帧的分组可能仍在读取
+    BufferBarrier write_barrier(
+        AccessFlagBits::SHADER_READ_BIT,                     /* in_source_access_mask      */
+        AccessFlagBits::SHADER_WRITE_BIT,                    /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_tile_depth_bounds_buffer_ptr.get(),
+        0,                                                   /* in_offset                  */
+        m_tile_depth_bounds_buffer_size);
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &write_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+
+    cmd_buffer_ptr->record_bind_pipeline(
+        PipelineBindPoint::COMPUTE,
+        m_tile_depth_bounds_compute_pipeline_id);
+
+    DescriptorSet* ds_ptr[3] = {
+        m_dsg_ptr->get_descriptor_set(1),
+        m_dsg_ptr->get_descriptor_set(3),
+        m_dsg_ptr->get_descriptor_set(7 + N_SWAPCHAIN_IMAGES)
+    };
+    const uint32_t data_ub_offset = static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer);
+
+    cmd_buffer_ptr->record_bind_descriptor_sets(
+        PipelineBindPoint::COMPUTE,
+        getPineLine(8),
+        0, /* firstSet */
+        3, /* setCount */
+        ds_ptr,
+        1,                /* dynamicOffsetCount */
+        &data_ub_offset); /* pDynamicOffsets    */
+
+    m_deferred_constants.RTSize.x = m_render_width;
+    m_deferred_constants.RTSize.y = m_render_height;
+    cmd_buffer_ptr->record_push_constants(
+        getPineLine(8),
+        ShaderStageFlagBits::COMPUTE_BIT,
+        0, /* in_offset */
+        sizeof(DeferredConstants),
+        &m_deferred_constants);
+
+    //每个工作组一个tile
+    cmd_buffer_ptr->record_dispatch(m_num_x_tiles, m_num_y_tiles, 1);
+
+    BufferBarrier read_barrier(
+        AccessFlagBits::SHADER_WRITE_BIT,                    /* in_source_access_mask      */
+        AccessFlagBits::SHADER_READ_BIT,                     /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_tile_depth_bounds_buffer_ptr.get(),
+        0,                                                   /* in_offset                  */
+        m_tile_depth_bounds_buffer_size);
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &read_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+}
+
+void Engine::create_tile_classification_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_tile_classification_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(1));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(3));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+    compute_pipeline_create_info_ptr->attach_push_constant_range(
+        0,
+        sizeof(m_deferred_constants),
+        ShaderStageFlagBits::COMPUTE_BIT);
+
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_tile_classification_compute_pipeline_id);
+}
+
+void Engine::classify_tiles(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer)
+{
+    Queue* universal_queue_ptr(m_device_ptr->get_universal_queue(0));
+    const VkDeviceSize dispatch_size = TileClassificationStorage::DISPATCH_STRIDE * uint(TileClass::COUNT);
+
+    //上一帧的deferred可能仍在读取间接参数与tile列表
+    BufferBarrier reset_barrier(
+        AccessFlagBits::INDIRECT_COMMAND_READ_BIT | AccessFlagBits::SHADER_READ_BIT, /* in_source_access_mask      */
+        AccessFlagBits::TRANSFER_WRITE_BIT | AccessFlagBits::SHADER_WRITE_BIT,       /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_tile_classification_buffer_ptr.get(),
+        0,                                                   /* in_offset                  */
+        m_tile_classification_buffer_size);
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        PipelineStageFlagBits::DRAW_INDIRECT_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        PipelineStageFlagBits::TRANSFER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &reset_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+
+    //工作组数x由着色器累加，y、z固定为1
+    uvec4 dispatch_commands[uint(TileClass::COUNT)];
+    for (uint32_t i = 0; i < uint32_t(TileClass::COUNT); i++)
+    {
+        dispatch_commands[i] = uvec4(0, 1, 1, 0);
+    }
+    cmd_buffer_ptr->record_update_buffer(
+        m_tile_classification_buffer_ptr.get(),
+        0,
+        dispatch_size,
+        reinterpret_cast<const uint32_t*>(dispatch_commands));
+
+    BufferBarrier clear_barrier(
+        AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+        AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::SHADER_WRITE_BIT, /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_tile_classification_buffer_ptr.get(),
+        0,                                                   /* in_offset                  */
+        dispatch_size);
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        PipelineStageFlagBits::TRANSFER_BIT,
+        PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &clear_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+
+    cmd_buffer_ptr->record_bind_pipeline(
+        PipelineBindPoint::COMPUTE,
+        m_tile_classification_compute_pipeline_id);
+
+    DescriptorSet* ds_ptr[3] = {
+        m_dsg_ptr->get_descriptor_set(1),
+        m_dsg_ptr->get_descriptor_set(3),
+        m_dsg_ptr->get_descriptor_set(7 + N_SWAPCHAIN_IMAGES)
+    };
+    const uint32_t data_ub_offset = static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer);
+
+    cmd_buffer_ptr->record_bind_descriptor_sets(
+        PipelineBindPoint::COMPUTE,
+        getPineLine(11),
+        0, /* firstSet */
+        3, /* setCount */
+        ds_ptr,
+        1,                /* dynamicOffsetCount */
+        &data_ub_offset); /* pDynamicOffsets    */
+
+    m_deferred_constants.RTSize.x = m_render_width;
+    m_deferred_constants.RTSize.y = m_render_height;
+    cmd_buffer_ptr->record_push_constants(
+        getPineLine(11),
+        ShaderStageFlagBits::COMPUTE_BIT,
+        0, /* in_offset */
+        sizeof(DeferredConstants),
+        &m_deferred_constants);
+
+    //每个工作组一个tile
+    cmd_buffer_ptr->record_dispatch(m_num_x_tiles, m_num_y_tiles, 1);
+
+    BufferBarrier read_barrier(
+        AccessFlagBits::SHADER_WRITE_BIT,                    /* in_source_access_mask      */
+        AccessFlagBits::INDIRECT_COMMAND_READ_BIT | AccessFlagBits::SHADER_READ_BIT, /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_tile_classification_buffer_ptr.get(),
+        0,                                                   /* in_offset                  */
+        m_tile_classification_buffer_size);
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        PipelineStageFlagBits::DRAW_INDIRECT_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &read_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+}
+
+void Engine::create_light_binning_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_light_binning_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(1));
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+    compute_pipeline_create_info_ptr->attach_push_constant_range(
+        0,
+        sizeof(m_deferred_constants),
+        ShaderStageFlagBits::COMPUTE_BIT);
+
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_light_binning_compute_pipeline_id);
+}
+
+void Engine::bin_lights(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer)
+{
+    cmd_buffer_ptr->record_bind_pipeline(
+        PipelineBindPoint::COMPUTE,
+        m_light_binning_compute_pipeline_id);
+
+    DescriptorSet* ds_ptr[2] = {
+        m_dsg_ptr->get_descriptor_set(1),
+        m_dsg_ptr->get_descriptor_set(7 + N_SWAPCHAIN_IMAGES)
+    };
+    const uint32_t data_ub_offset = static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer);
+
+    cmd_buffer_ptr->record_bind_descriptor_sets(
+        PipelineBindPoint::COMPUTE,
+        getPineLine(12),
+        0, /* firstSet */
+        2, /* setCount */
+        ds_ptr,
+        1,                /* dynamicOffsetCount */
+        &data_ub_offset); /* pDynamicOffsets    */
+
+    m_deferred_constants.RTSize.x = m_render_width;
+    m_deferred_constants.RTSize.y = m_render_height;
+    cmd_buffer_ptr->record_push_constants(
+        getPineLine(12),
+        ShaderStageFlagBits::COMPUTE_BIT,
+        0, /* in_offset */
+        sizeof(DeferredConstants),
+        &m_deferred_constants);
+
+    //每个工作组一盏灯，灯光数静态，直接固化在指令缓冲中
+    cmd_buffer_ptr->record_dispatch(m_num_lights, 1, 1);
+}
+
+void Engine::create_cluster_compaction_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_cluster_compaction_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_cluster_compaction_compute_pipeline_id);
+}
+
+void Engine::compact_clusters(PrimaryCommandBuffer* cmd_buffer_ptr)
+{
+    Queue* universal_queue_ptr(m_device_ptr->get_universal_queue(0));
+
+    #pragma region 等待上一帧deferred读取结束后再清零分配计数
+    {
+        BufferBarrier buffer_barriers[2] = {
+            BufferBarrier(
+                AccessFlagBits::SHADER_READ_BIT,                     /* in_source_access_mask      */
+                AccessFlagBits::SHADER_WRITE_BIT,                    /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+                m_cluster_headers_buffer_ptr.get(),
+                0,                                                   /* in_offset                  */
+                m_cluster_headers_buffer_size),
+            BufferBarrier(
+                AccessFlagBits::SHADER_READ_BIT,                     /* in_source_access_mask      */
+                AccessFlagBits::TRANSFER_WRITE_BIT | AccessFlagBits::SHADER_WRITE_BIT, /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+                m_cluster_indices_buffer_ptr.get(),
+                0,                                                   /* in_offset                  */
+                m_cluster_indices_buffer_size)
+        };
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            PipelineStageFlagBits::TRANSFER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            2,               /* in_buffer_memory_barrier_count */
+            buffer_barriers,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+
+        cmd_buffer_ptr->record_fill_buffer(
+            m_cluster_indices_buffer_ptr.get(),
+            0,
+            sizeof(uint),
+            0);
+
+        BufferBarrier buffer_barrier(
+            AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+            AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::SHADER_WRITE_BIT, /* in_destination_access_mask */
+            universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+            universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+            m_cluster_indices_buffer_ptr.get(),
+            0,                                                   /* in_offset                  */
+            sizeof(uint));
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::TRANSFER_BIT,
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            1,               /* in_buffer_memory_barrier_count */
+            &buffer_barrier,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+    }
+    #pragma endregion
+
+    #pragma region 压缩
+    {
+        cmd_buffer_ptr->record_bind_pipeline(
+            PipelineBindPoint::COMPUTE,
+            m_cluster_compaction_compute_pipeline_id);
+
+        DescriptorSet* ds_ptr = m_dsg_ptr->get_descriptor_set(7 + N_SWAPCHAIN_IMAGES);
+        cmd_buffer_ptr->record_bind_descriptor_sets(
+            PipelineBindPoint::COMPUTE,
+            getPineLine(9),
+            0, /* firstSet */
+            1, /* setCount */
+            &ds_ptr,
+            0,        /* dynamicOffsetCount */
+            nullptr); /* pDynamicOffsets    */
+
+        //每个线程一个cluster，与clusterCompaction.comp的GROUP_SIZE一致
+        const uint32_t group_size = 256;
+        const uint32_t num_clusters = m_num_x_tiles * m_num_y_tiles * m_num_z_tiles;
+        cmd_buffer_ptr->record_dispatch((num_clusters + group_size - 1) / group_size, 1, 1);
+    }
+    #pragma endregion
+
+    #pragma region 确保压缩结果已经写入
+    {
+        BufferBarrier buffer_barriers[2] = {
+            BufferBarrier(
+                AccessFlagBits::SHADER_WRITE_BIT,                    /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT,                     /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+                m_cluster_headers_buffer_ptr.get(),
+                0,                                                   /* in_offset                  */
+                m_cluster_headers_buffer_size),
+            BufferBarrier(
+                AccessFlagBits::SHADER_WRITE_BIT,                    /* in_source_access_mask      */
+                AccessFlagBits::SHADER_READ_BIT,                     /* in_destination_access_mask */
+                universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+                universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+                m_cluster_indices_buffer_ptr.get(),
+                0,                                                   /* in_offset                  */
+                m_cluster_indices_buffer_size)
+        };
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            2,               /* in_buffer_memory_barrier_count */
+            buffer_barriers,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+    }
+    #pragma endregion
+}
+
+void Engine::record_decal_updates(uint n_command_buffer)
+{
+    //被淘汰的槽位仍被之前提交、尚未完成的帧读取：屏障的第一个同步范围包含之前提交的所有指令，
+    //由GPU等这些读取结束后再写入，CPU不需要等待栅栏
+    Queue* universal_queue_ptr(m_device_ptr->get_universal_queue(0));
+    const PipelineStageFlags decal_read_stages = PipelineStageFlagBits::VERTEX_SHADER_BIT | PipelineStageFlagBits::FRAGMENT_SHADER_BIT | PipelineStageFlagBits::COMPUTE_SHADER_BIT;
+
+    PrimaryCommandBufferUniquePtr cmd_buffer_ptr = m_device_ptr->
+        get_command_pool_for_queue_family_index(universal_queue_ptr->get_queue_family_index())
+        ->alloc_primary_level_command_buffer();
+    cmd_buffer_ptr->start_recording(true,   /* one_time_submit          */
+                                    false); /* simultaneous_use_allowed */
+
+    BufferBarrier buffer_barrier(
+        AccessFlagBits::SHADER_READ_BIT,                     /* in_source_access_mask      */
+        AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_decals->get_buffer(),
+        0,                                                   /* in_offset                  */
+        m_decals->get_buffer_size());
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        decal_read_stages,
+        PipelineStageFlagBits::TRANSFER_BIT,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &buffer_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+
+    for (uint32_t n : m_decals->get_pending_writes())
+    {
+        cmd_buffer_ptr->record_update_buffer(
+            m_decals->get_buffer(),
+            sizeof(Decal) * n, /* in_dst_offset */
+            sizeof(Decal),
+            &m_decals->get(n));
+    }
+    m_decals->clear_pending_writes();
+
+    buffer_barrier = BufferBarrier(
+        AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+        AccessFlagBits::SHADER_READ_BIT,                     /* in_destination_access_mask */
+        universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+        universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+        m_decals->get_buffer(),
+        0,                                                   /* in_offset                  */
+        m_decals->get_buffer_size());
+
+    cmd_buffer_ptr->record_pipeline_barrier(
+        PipelineStageFlagBits::TRANSFER_BIT,
+        decal_read_stages,
+        DependencyFlagBits::NONE,
+        0,               /* in_memory_barrier_count        */
+        nullptr,         /* in_memory_barriers_ptr         */
+        1,               /* in_buffer_memory_barrier_count */
+        &buffer_barrier,
+        0,               /* in_image_memory_barrier_count  */
+        nullptr);        /* in_image_memory_barriers_ptr   */
+
+    cmd_buffer_ptr->stop_recording();
+    m_decal_update_command_buffers[n_command_buffer] = move(cmd_buffer_ptr);
+}
+
+void Engine::create_cluster_occupancy_pipeline(ComputePipelineManager* computePipelineManager)
+{
+    ComputePipelineCreateInfoUniquePtr compute_pipeline_create_info_ptr;
+
+    compute_pipeline_create_info_ptr = ComputePipelineCreateInfo::create(
+        PipelineCreateFlagBits::NONE,
+        *m_cluster_occupancy_cs_ptr);
+
+    vector<const DescriptorSetCreateInfo*> m_desc_create_info;
+    m_desc_create_info.push_back(m_dsg_ptr->get_descriptor_set_create_info(7 + N_SWAPCHAIN_IMAGES));
+    compute_pipeline_create_info_ptr->set_descriptor_set_create_info(&m_desc_create_info);
+
+    add_cluster_specialization_constants(compute_pipeline_create_info_ptr.get());
+
+    computePipelineManager->add_pipeline(
+        move(compute_pipeline_create_info_ptr),
+        &m_cluster_occupancy_compute_pipeline_id);
+}
+
+void Engine::compute_cluster_occupancy(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer)
+{
+    Queue* universal_queue_ptr(m_device_ptr->get_universal_queue(0));
+
+    #pragma region 等待上一帧拷贝到读回环结束后再清零统计
+    {
+        BufferBarrier buffer_barrier(
+            AccessFlagBits::TRANSFER_READ_BIT,                   /* in_source_access_mask      */
+            AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_destination_access_mask */
+            universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+            universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+            m_cluster_occupancy_buffer_ptr.get(),
+            0,                                                   /* in_offset                  */
+            m_cluster_occupancy_buffer_size);
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::TRANSFER_BIT,
+            PipelineStageFlagBits::TRANSFER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            1,               /* in_buffer_memory_barrier_count */
+            &buffer_barrier,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+
+        cmd_buffer_ptr->record_fill_buffer(
+            m_cluster_occupancy_buffer_ptr.get(),
+            0,
+            m_cluster_occupancy_buffer_size,
+            0);
+
+        BufferBarrier fill_barrier(
+            AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+            AccessFlagBits::SHADER_READ_BIT | AccessFlagBits::SHADER_WRITE_BIT, /* in_destination_access_mask */
+            universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+            universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+            m_cluster_occupancy_buffer_ptr.get(),
+            0,                                                   /* in_offset                  */
+            m_cluster_occupancy_buffer_size);
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::TRANSFER_BIT,
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            1,               /* in_buffer_memory_barrier_count */
+            &fill_barrier,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+    }
+    #pragma endregion
+
+    #pragma region 统计
+    {
+        cmd_buffer_ptr->record_bind_pipeline(
+            PipelineBindPoint::COMPUTE,
+            m_cluster_occupancy_compute_pipeline_id);
+
+        DescriptorSet* ds_ptr = m_dsg_ptr->get_descriptor_set(7 + N_SWAPCHAIN_IMAGES);
+        cmd_buffer_ptr->record_bind_descriptor_sets(
+            PipelineBindPoint::COMPUTE,
+            getPineLine(10),
+            0, /* firstSet */
+            1, /* setCount */
+            &ds_ptr,
+            0,        /* dynamicOffsetCount */
+            nullptr); /* pDynamicOffsets    */
+
+        //每个线程一个tile，与clusterOccupancy.comp的8x8工作组一致
+        cmd_buffer_ptr->record_dispatch((m_num_x_tiles + 7) / 8, (m_num_y_tiles + 7) / 8, 1);
+    }
+    #pragma endregion
+
+    #pragma region 把统计结果拷贝到读回环
+    {
+        BufferBarrier buffer_barrier(
+            AccessFlagBits::SHADER_WRITE_BIT,                    /* in_source_access_mask      */
+            AccessFlagBits::TRANSFER_READ_BIT,                   /* in_destination_access_mask */
+            universal_queue_ptr->get_queue_family_index(),       /* in_src_queue_family_index  */
+            universal_queue_ptr->get_queue_family_index(),       /* in_dst_queue_family_index  */
+            m_cluster_occupancy_buffer_ptr.get(),
+            0,                                                   /* in_offset                  */
+            m_cluster_occupancy_buffer_size);
+
+        cmd_buffer_ptr->record_pipeline_barrier(
+            PipelineStageFlagBits::COMPUTE_SHADER_BIT,
+            PipelineStageFlagBits::TRANSFER_BIT,
+            DependencyFlagBits::NONE,
+            0,               /* in_memory_barrier_count        */
+            nullptr,         /* in_memory_barriers_ptr         */
+            1,               /* in_buffer_memory_barrier_count */
+            &buffer_barrier,
+            0,               /* in_image_memory_barrier_count  */
+            nullptr);        /* in_image_memory_barriers_ptr   */
+
+        m_cluster_occupancy_readback->record_copy(
+            cmd_buffer_ptr,
+            universal_queue_ptr,
+            m_cluster_occupancy_buffer_ptr.get(),
+            0, /* src_offset */
+            n_command_buffer);
+    }
+    #pragma endregion
+}
+
+void Engine::print_cluster_occupancy(const ClusterOccupancyStats& stats)
+{
+    cout << "Cluster occupancy: tile " << m_tile_size << ", " << m_num_z_tiles << " slices, "
+        << m_num_x_tiles << "x" << m_num_y_tiles << " tiles" << endl;
+
+    //按贴花数分桶：cluster个数，以及最大贴花数落在该桶的tile个数
+    cout << " decals  clusters     tiles" << endl;
+    for (uint32_t i = 0; i < ClusterOccupancyStats::HISTOGRAM_BINS; i++)
+    {
+        if (stats.cluster_histogram[i] == 0 && stats.tile_histogram[i] == 0)
+        {
+            continue;
+        }
+        char line[64];
+        sprintf_s(line, "%s%5u  %8u  %8u",
+            i == ClusterOccupancyStats::HISTOGRAM_BINS - 1 ? ">=" : "  ",
+            i,
+            stats.cluster_histogram[i],
+            stats.tile_histogram[i]);
+        cout << line << endl;
+    }
+
+    cout << " slice    decals   max" << endl;
+    const uint32_t num_slices = std::min(m_num_z_tiles, uint32_t(ClusterOccupancyStats::MAX_Z_SLICES));
+    for (uint32_t i = 0; i < num_slices; i++)
+    {
+        char line[64];
+        sprintf_s(line, "%6u  %8u  %4u", i, stats.slice_decals[i], stats.slice_max[i]);
+        cout << line << endl;
+    }
+}
+
+void Engine::set_cluster_occupancy(ClusterOccupancy mode)
+{
+    if (mode == m_cluster_occupancy)
+    {
+        return;
+    }
+
+    //统计pass与热力图开关都固化在指令缓冲中
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+    {
+        m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+    }
+
+    m_cluster_occupancy = mode;
+    init_command_buffers();
+    cout << "Cluster occupancy: " << get_cluster_occupancy_name(mode) << endl;
+}
+
+void Engine::set_deferred_decal_cache(bool enable)
+{
+    set_deferred_variant(enable, m_scalarized_decal_loop);
+}
+
+bool Engine::set_scalarized_decal_loop(bool enable)
+{
+    if (enable && !is_subgroup_supported(ShaderStageFlagBits::COMPUTE_BIT, SubgroupFeatureFlagBits::BASIC_BIT | SubgroupFeatureFlagBits::ARITHMETIC_BIT))
+    {
+        return false;
+    }
+    set_deferred_variant(m_deferred_decal_cache, enable);
+    return true;
+}
+
+void Engine::set_deferred_variant(bool decal_cache, bool scalarized_decal_loop)
+{
+    if (decal_cache == m_deferred_decal_cache && scalarized_decal_loop == m_scalarized_decal_loop)
+    {
+        return;
+    }
+
+    //各变体的工作组大小、dispatch与着色器不同，需要重建deferred管线并重新记录指令缓冲
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+    {
+        m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+    }
+
+    auto compute_pipeline_manager_ptr(m_device_ptr->get_compute_pipeline_manager());
+    delete_deferred_pipelines(compute_pipeline_manager_ptr);
+    apply_deferred_variant(decal_cache, scalarized_decal_loop);
+    create_deferred_pipeline(compute_pipeline_manager_ptr);
+
+    m_cluster_config_generation++;
+    init_command_buffers();
+}
+
+void Engine::apply_deferred_variant(bool decal_cache, bool scalarized_decal_loop)
+{
+    //调用前需确保deferred管线已删除；tile分类变体的着色器随两个开关变化
+    m_scalarized_decal_loop = scalarized_decal_loop;
+    m_deferred_decal_cache = decal_cache;
+    create_deferred_shaders();
+    cout << "Deferred decal cache: " << (decal_cache ? "on" : "off") << ", scalarized decal loop: " << (scalarized_decal_loop ? "on" : "off") << endl;
+}
+
+void Engine::set_tile_classification(bool enable)
+{
+    if (enable == m_tile_classification)
+    {
+        return;
+    }
+
+    //分类pass与间接dispatch固化在指令缓冲中
+    Vulkan::vkDeviceWaitIdle(m_device_ptr->get_device_vk());
+    for (uint32_t n_swapchain_image = 0; n_swapchain_image < N_SWAPCHAIN_IMAGES; n_swapchain_image++)
+    {
+        m_command_buffers[n_swapchain_image].reset();
+        m_reuse_cluster_command_buffers[n_swapchain_image].reset();
+    }
+
+    m_tile_classification = enable;
+    m_cluster_config_generation++;
+    init_command_buffers();
+    cout << "Tile classification: " << (enable ? "on" : "off") << endl;
+}
+
 void Engine::cluster(PrimaryCommandBuffer* cmd_buffer_ptr, uint mode, uint n_command_buffer)
 {
     cmd_buffer_ptr->record_next_subpass(SubpassContents::INLINE);
@@ -2402,10 +5116,12 @@ void Engine::cluster(PrimaryCommandBuffer* cmd_buffer_ptr, uint mode, uint n_com
         PipelineBindPoint::GRAPHICS,
         m_cluster_gfx_pipeline_id[mode]);
 
-    const uint32_t data_ub_offset[3] = {
+    const uint32_t data_ub_offset[5] = {
         static_cast<uint32_t>(m_mvp_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
         static_cast<uint32_t>(m_decal_indices_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
-        static_cast<uint32_t>(m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer)
+        static_cast<uint32_t>(m_decal_ZBounds_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+        static_cast<uint32_t>(m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer),
+        static_cast<uint32_t>(m_decal_culling_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer)
     };
     DescriptorSet* ds_ptr[4] = {
         m_dsg_ptr->get_descriptor_set(1),
@@ -2418,9 +5134,9 @@ void Engine::cluster(PrimaryCommandBuffer* cmd_buffer_ptr, uint mode, uint n_com
         PipelineBindPoint::GRAPHICS,
         getPineLine(mode + 1),
         0, /* firstSet */
-        4, /* setCountshaderеsetһһӦ */
+        4, /* setCount：传入的描述符集与shader中的set一一对应 */
         ds_ptr,
-        3,                /* dynamicOffsetCount */
+        5,                /* dynamicOffsetCount */
         data_ub_offset); /* pDynamicOffsets    */
 
     Buffer* buffer_raw_ptrs[] = { m_box_vertex_buffer_ptr.get() };
@@ -2436,30 +5152,19 @@ void Engine::cluster(PrimaryCommandBuffer* cmd_buffer_ptr, uint mode, uint n_com
         0,
         Anvil::IndexType::UINT16);
 
-    uint num = 0;
-    switch(mode)
-    {
-    case 0:
-        num = m_indexUniform.numIntersectingDecals;
-        break;
-    case 1:
-    case 2:
-        num = std::min(m_n_decal, N_MAX_STORED_DECALS) - m_indexUniform.numIntersectingDecals;
-    }
-
-    cmd_buffer_ptr->record_draw_indexed(
-        36,
-        num,
-        0,
-        0,
-        0);
+    //实例数由贴花剔除(GPU或CPU)每帧写入间接绘制参数，无需重新记录指令
+    cmd_buffer_ptr->record_draw_indexed_indirect(
+        m_cluster_draw_commands_dynamic_buffer_helper->getBuffer(),
+        m_cluster_draw_commands_dynamic_buffer_helper->getSizePerSwapchainImage() * n_command_buffer + sizeof(VkDrawIndexedIndirectCommand) * mode,
+        1, /* in_draw_count */
+        sizeof(VkDrawIndexedIndirectCommand));
 }
 
 void Engine::make_box(float scale)
 {
     auto allocator_ptr = MemoryAllocator::create_oneshot(Engine::Instance()->getDevice());
 
-    #pragma region 
+    #pragma region 顶点数据
     array<vec3, 24> boxVerts;
     uint64 vIdx = 0;
 
@@ -2515,7 +5220,7 @@ void Engine::make_box(float scale)
         MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
     #pragma endregion
 
-    #pragma region 
+    #pragma region 索引数据
     array<uint16, 36> boxIndices;
     uint64 iIdx = 0;
 
@@ -2583,7 +5288,7 @@ void Engine::make_box(float scale)
         MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
     #pragma endregion
 
-    #pragma region д뻺
+    #pragma region 写入缓冲数据
     m_box_vertex_buffer_ptr->write(
         0, /* start_offset */
         vertex_buffer_size,
@@ -3,13 +3,84 @@
 #include "../scene/camera.h"
 #include "../support/input.h"
 #include "../scene/model.h"
+#include "../scene/decalStore.h"
 #include "support/dynamicBufferHelper.h"
+#include "support/readbackRing.h"
+#include "support/gpuTimer.h"
 #include "appSettings.h"
 
 #pragma region struct
+//cluster分组方式：RASTER 光栅化贴花盒(cluster.vert/cluster.frag)，COMPUTE 计算着色器逐froxel测试(clusterBinning.comp)，
+//CPU 由ClusterReference在CPU上软件光栅化后上传位掩码，用于没有可靠GPU分组时的后备与对照
+enum class ClusterBinning
+{
+    RASTER = 0,
+    COMPUTE,
+    CPU
+};
+
+class ClusterReference;
+
+//cluster的z分片方式：LINEAR 在近远平面间均分，EXPONENTIAL 按深度比例均分，近处分片更薄
+enum class ZSlicing
+{
+    LINEAR = 0,
+    EXPONENTIAL
+};
+
+//cluster占用统计：STATS 每次重建cluster后统计直方图并异步读回，HEATMAP 另在deferred中按cluster贴花数叠加伪彩色
+enum class ClusterOccupancy
+{
+    OFF = 0,
+    STATS,
+    HEATMAP,
+    COUNT
+};
+
+//deferred前的tile分类：SKY 没有几何体，NO_DECALS 几何体覆盖的cluster都没有贴花，DECALS 需要完整的贴花循环
+enum class TileClass
+{
+    SKY = 0,
+    NO_DECALS,
+    DECALS,
+    COUNT
+};
+
+//所有cluster相关着色器共用的特化常量，按成员顺序从CONSTANT_ID_BASE开始依次对应constant_id，成员均为4字节
+struct ClusterConstants
+{
+    static const uint32_t CONSTANT_ID_BASE = 16;
+    static const uint32_t CONSTANT_COUNT = 8;
+
+    float near_clip;
+    float far_clip;
+    uint num_x_tiles;
+    uint num_y_tiles;
+    uint num_z_tiles;
+    uint elements_per_cluster;
+    uint tile_size;
+    uint z_slicing;
+
+    //视空间深度(正值)映射到[0,1]的z分片坐标，与着色器中的NormalizedSliceDepth一致
+    float get_normalized_slice_depth(float view_depth) const
+    {
+        if (z_slicing == uint(ZSlicing::EXPONENTIAL))
+        {
+            return clamp(log(std::max(view_depth, near_clip) / near_clip) / log(far_clip / near_clip), 0.0f, 1.0f);
+        }
+        return clamp((view_depth - near_clip) / (far_clip - near_clip), 0.0f, 1.0f);
+    }
+
+    uint get_z_slice(float view_depth) const
+    {
+        return std::min(uint(get_normalized_slice_depth(view_depth) * num_z_tiles), num_z_tiles - 1);
+    }
+};
+
 struct DeferredConstants
 {
     vec2 RTSize;
+    uint HeatmapMode;//只有deferred.comp使用，其余管线共用同一推送常量范围
 };
 
 struct MVPUniform
@@ -17,24 +88,126 @@ struct MVPUniform
     alignas(16) mat4 model;
     alignas(16) mat4 view;
     alignas(16) mat4 proj;
+    alignas(16) mat4 inv_view_proj;//deferred和picking由深度重建世界坐标用，每帧在CPU上求一次
 };
 
+//长度随贴花容量变化，上传时先写numIntersectingDecals，再紧接着写decalIndices
 struct IndexUniform
 {
-    uint decalIndices[N_MAX_STORED_DECALS];
     uint numIntersectingDecals;
+    vector<uint> decalIndices;
 };
 
 struct ZBoundsUniform
 {
-    uvec2 ZBounds[N_MAX_STORED_DECALS];
+    vector<uvec2> ZBounds;
 };
 
+//贴花剔除的每帧参数，贴花数量不再固化在指令缓冲中
+struct DecalCullingUniform
+{
+    alignas(4) uint numDecals;
+};
+
+//每个cluster用ELEMENTS_PER_CLUSTER个uint的位掩码记录贴花，总长度随贴花容量和渲染分辨率的tile数变化
 struct ClusterStorage
 {
-    uint data[N_MAX_STORED_DECALS / 32 * ((1920 + Tile_Size - 1) / Tile_Size) * ((1080 + Tile_Size - 1) / Tile_Size) * NUM_Z_TILES];
+    static VkDeviceSize get_size(uint elements_per_cluster, uint num_x_tiles, uint num_y_tiles, uint num_z_tiles)
+    {
+        return sizeof(uint) * elements_per_cluster * num_x_tiles * num_y_tiles * num_z_tiles;
+    }
+
+    //压缩结果：每个cluster一个(偏移, 数量)，索引表开头是分配计数，后接CLUSTER_INDEX_LIST_AVERAGE倍cluster数的贴花索引
+    static VkDeviceSize get_headers_size(uint num_x_tiles, uint num_y_tiles, uint num_z_tiles)
+    {
+        return sizeof(uvec2) * num_x_tiles * num_y_tiles * num_z_tiles;
+    }
+
+    static VkDeviceSize get_indices_size(uint num_x_tiles, uint num_y_tiles, uint num_z_tiles)
+    {
+        return sizeof(uint) * (1 + VkDeviceSize(num_x_tiles) * num_y_tiles * num_z_tiles * CLUSTER_INDEX_LIST_AVERAGE);
+    }
 };
 
+//tileClassification.comp的输出：开头每类一个VkDispatchIndirectCommand(补齐到16字节)，其后每类一段tile序号列表
+struct TileClassificationStorage
+{
+    static const uint32_t DISPATCH_STRIDE = 4 * sizeof(uint);
+
+    static VkDeviceSize get_size(uint num_x_tiles, uint num_y_tiles)
+    {
+        return DISPATCH_STRIDE * uint(TileClass::COUNT) + sizeof(uint) * uint(TileClass::COUNT) * num_x_tiles * num_y_tiles;
+    }
+
+    static VkDeviceSize get_dispatch_offset(TileClass tile_class)
+    {
+        return DISPATCH_STRIDE * uint(tile_class);
+    }
+};
+
+//clusterOccupancy.comp的统计结果，布局与着色器中的ClusterOccupancy缓冲一致
+struct ClusterOccupancyStats
+{
+    static const uint32_t HISTOGRAM_BINS = 32;//最后一个桶计入贴花数更多的cluster
+    static const uint32_t MAX_Z_SLICES = 64;//超出的z分片计入最后一项
+
+    uint cluster_histogram[HISTOGRAM_BINS];//按贴花数统计的cluster个数
+    uint tile_histogram[HISTOGRAM_BINS];//按tile内各cluster的最大贴花数统计的tile个数
+    uint slice_decals[MAX_Z_SLICES];//每个z分片的贴花引用总数
+    uint slice_max[MAX_Z_SLICES];//每个z分片中单个cluster的最大贴花数
+};
+
+//自动调优中一组tile大小、z分片数与deferred变体的计时结果
+struct ClusterAutotuneResult
+{
+    uint tile_size;
+    uint num_z_tiles;
+    bool deferred_decal_cache;
+    bool scalarized_decal_loop;
+    double total_gpu_ms;
+    uint32_t samples;
+};
+
+//启动参数：main解析命令行后在第一次调用Engine::Instance()之前传入，在第一次记录指令缓冲之前生效
+struct EngineStartupOptions
+{
+    ClusterBinning cluster_binning = CLUSTER_BINNING;
+    uint num_lights = NUM_LIGHTS;//超过MAX_LIGHTS时截断
+    string decal_snapshot_path;//非空时启动前从快照恢复贴花
+    bool deferred_decal_cache = DEFERRED_DECAL_CACHE;
+    bool scalarized_decal_loop = SCALARIZED_DECAL_LOOP;//设备不支持时保持关闭
+    bool tile_classification = TILE_CLASSIFICATION;
+    ClusterOccupancy cluster_occupancy = CLUSTER_OCCUPANCY;
+    bool autotune_clusters = false;
+    bool compare_deferred_variants = false;
+};
+
+//点光源与聚光灯，与着色器中的LIGHT_TYPE_*一致
+enum class LightType
+{
+    POINT = 0,
+    SPOT
+};
+
+//布局与着色器中的Light一致(std430)
+struct Light
+{
+    vec4 position;//xyz 世界坐标，w 影响半径
+    vec4 color;//rgb 峰值辐照度，w 类型LightType
+    vec4 direction;//xyz 聚光方向，w 外锥角余弦
+    vec4 cone;//x 内锥角余弦，其余保留
+};
+
+//灯光缓冲：开头是灯光数量(补齐到16字节)，后接MAX_LIGHTS个Light；灯光位掩码与贴花的cluster划分相同，每个cluster LIGHT_ELEMENTS_PER_CLUSTER个uint
+struct LightStorage
+{
+    static const uint32_t ELEMENTS_PER_CLUSTER = MAX_LIGHTS / 32;
+
+    alignas(16) uint num_lights;
+    Light lights[MAX_LIGHTS];
+};
+static_assert(offsetof(LightStorage, lights) == 16, "LightStorage must match the std430 layout of the Lights buffer");
+
 struct SunLightUniform
 {
     vec3 SunDirectionWS;
@@ -50,6 +223,8 @@ struct PickingStorage
 {
     vec3 Position;
     vec3 Normal;
+    vec4 CursorRect;//鼠标贴花的屏幕包围矩形(像素)，由picking.comp写入，只在GPU上使用
+    vec2 CursorDepthRange;
 };
 #pragma endregion
 
@@ -57,16 +232,44 @@ struct PickingStorage
 class Engine
 {
 public:
-    //ģʽ̲߳ȫ
+    //单例模式，懒汉，线程不安全
     static unique_ptr<Engine>& Instance();
 
-    //ģʽɾⲿĹ캯
+    //单例模式：删除外部的构造函数
     Engine(Engine const& r) = delete;
     Engine(Engine const&& r) = delete;
     Engine& operator=(Engine const& r) = delete;
 
     void run ();
 
+    //在第一次调用Instance()之前设置
+    static void set_startup_options(const EngineStartupOptions& options);
+    static const char* get_cluster_binning_name(ClusterBinning binning);
+
+    //贴花快照：保存当前全部贴花，或用快照替换全部贴花
+    bool save_decals(const string& path);
+    bool load_decals(const string& path);
+    //启动时恢复贴花的快照路径；快照存在但被拒绝时为空，退出时不写回，避免覆盖原快照
+    const string& get_decal_snapshot_path() const;
+
+    //运行时修改tile边长与z分片数，只重建cluster缓冲和依赖它们的管线；设备不支持该组合时返回false
+    bool set_cluster_config(uint tile_size, uint num_z_tiles);
+    //在固定的相机路径上依次测试一组tile大小与z分片数，结束后输出每组的GPU耗时并采用最快的一组
+    void start_cluster_autotune();
+    //回读最近一次分组的位掩码，连同视角、特化常量和全部贴花写入转储文件，供ClusterReference::diff_dump离线比较
+    bool dump_clusters(const string& path);
+    //切换cluster占用统计，需要重新记录指令缓冲；关闭时不记录统计pass，没有额外开销
+    void set_cluster_occupancy(ClusterOccupancy mode);
+    static const char* get_cluster_occupancy_name(ClusterOccupancy mode);
+    //切换deferred前的tile分类，只重新记录指令缓冲；三类的管线始终存在
+    void set_tile_classification(bool enable);
+    //切换deferred的共享内存贴花缓存变体，只重建deferred管线和指令缓冲
+    void set_deferred_decal_cache(bool enable);
+    //切换deferred的子组统一贴花循环；设备不支持计算着色器中的子组算术操作时返回false
+    bool set_scalarized_decal_loop(bool enable);
+    //在自动调优的相机路径上依次运行设备支持的各个deferred变体，输出GPU耗时与相对原始版本的加速比并采用最快的一个
+    void start_deferred_variant_comparison();
+
     BaseDevice* getDevice();
     PipelineLayout* getPineLine(int id = 0);
     Sampler* getSampler();
@@ -83,9 +286,16 @@ private:
     void init_swapchain     ();
 
     void init_buffers       ();
+    void init_cluster_buffer();
+    void init_lights        ();
+    void reserve_storage_buffer(BufferUniquePtr& buffer_ptr, VkDeviceSize size, VkDeviceSize& capacity, BufferUsageFlags usage, const char* name);
+    void add_cluster_specialization_constants(ComputePipelineCreateInfo* create_info_ptr);
+    void add_cluster_specialization_constants(GraphicsPipelineCreateInfo* create_info_ptr, ShaderStage stage);
+    bool is_render_scaled();
     void init_image         ();
     void init_sampler       ();
     void init_dsgs          ();
+    void bind_decal_buffers ();
 
     void init_render_pass    ();
     void init_shaders        ();
@@ -98,26 +308,65 @@ private:
     void init_semaphores     ();
 
     void update_data(uint32_t in_n_swapchain_image);
+    void reset_title_stats();
     void update_decal        ();
+    void upload_decal_culling(uint32_t in_n_swapchain_image);
     void draw_frame          ();
 
     void recreate_swapchain();
+    void recreate_decal_resources();
+    bool is_cluster_config_supported(uint tile_size, uint num_z_tiles);
+    VkDeviceSize get_cluster_storage_limit();
+    uint32_t get_max_cluster_decals(uint tile_size, uint num_z_tiles);
+    void update_max_decals();
+    void apply_cluster_config(uint tile_size, uint num_z_tiles);
+    void load_startup_decals();
+    bool collect_cluster_autotune_configs();
+    bool collect_deferred_variant_configs();
+    void begin_cluster_autotune();
+    void apply_cluster_autotune_config(const ClusterAutotuneResult& config);
+    void update_cluster_autotune();
+    void finish_cluster_autotune();
 
     void cleanup_swapwhain   ();
     void deinit              ();
     #pragma endregion
 
     #pragma region tools
-    ShaderModuleStageEntryPoint* create_shader (string file, ShaderStage type, string name);
+    ShaderModuleStageEntryPoint* create_shader (string file, ShaderStage type, string name, const vector<string>& definitions = vector<string>(), SpvVersion spirv_version = SpvVersion::_1_0);
+    bool is_subgroup_supported(ShaderStageFlagBits stage, SubgroupFeatureFlags required_operations);
+    void create_deferred_shaders();
+    bool is_deferred_decal_cache_supported();
+    void set_deferred_variant(bool decal_cache, bool scalarized_decal_loop);
+    void apply_deferred_variant(bool decal_cache, bool scalarized_decal_loop);
     void create_image_source(ImageUniquePtr& image, ImageViewUniquePtr&image_view, string name, Format format, bool isDepthImage = false);
     void create_cluster_pipeline(GraphicsPipelineManager* gfxPipelineManager, uint mode);
+    void create_deferred_pipeline(ComputePipelineManager* computePipelineManager);
+    void create_deferred_pipeline(ComputePipelineManager* computePipelineManager, ShaderModuleStageEntryPoint* shader_ptr, const uint32_t* tile_class, PipelineID* pipeline_id_ptr);
+    void delete_deferred_pipelines(ComputePipelineManager* computePipelineManager);
+    void create_tile_classification_pipeline(ComputePipelineManager* computePipelineManager);
+    void classify_tiles(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer);
+    void create_light_binning_pipeline(ComputePipelineManager* computePipelineManager);
+    void bin_lights(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer);
+    void create_decal_culling_pipeline(ComputePipelineManager* computePipelineManager);
+    void create_cluster_binning_pipeline(ComputePipelineManager* computePipelineManager);
+    void cull_decals(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer);
+    void bin_clusters(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer);
+    void create_tile_depth_bounds_pipeline(ComputePipelineManager* computePipelineManager);
+    void compute_tile_depth_bounds(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer);
+    void create_cluster_compaction_pipeline(ComputePipelineManager* computePipelineManager);
+    void compact_clusters(PrimaryCommandBuffer* cmd_buffer_ptr);
+    void record_decal_updates(uint n_command_buffer);
+    void create_cluster_occupancy_pipeline(ComputePipelineManager* computePipelineManager);
+    void compute_cluster_occupancy(PrimaryCommandBuffer* cmd_buffer_ptr, uint n_command_buffer);
+    void print_cluster_occupancy(const ClusterOccupancyStats& stats);
     void cluster(PrimaryCommandBuffer* cmd_buffer_ptr, uint mode, uint n_command_buffer);
     void make_box(float scale);
     Format SelectSupportedFormat(
         const vector<Format>& candidates,
         ImageTiling tiling,
         FormatFeatureFlags features);
-    bool Intersects(const BoundingOrientedBox& boxA, const BoundingOrientedBox& boxB);
+    static bool Intersects(const BoundingOrientedBox& boxA, const BoundingOrientedBox& boxB);
     #pragma endregion
 
     #pragma region callback
@@ -145,14 +394,20 @@ private:
     DescriptorSetGroupUniquePtr                  m_dsg_ptr;
     FramebufferUniquePtr                         m_fbo;
     PrimaryCommandBufferUniquePtr                m_command_buffers[N_SWAPCHAIN_IMAGES];
+    PrimaryCommandBufferUniquePtr                m_reuse_cluster_command_buffers[N_SWAPCHAIN_IMAGES];//不做剔除、分组与压缩，沿用上一次提交的cluster结果
+    PrimaryCommandBufferUniquePtr                m_decal_update_command_buffers[N_SWAPCHAIN_IMAGES];//本帧有贴花被淘汰时在主指令缓冲之前提交，写入替换后的槽位
 
     uint32_t       m_n_last_semaphore_used;
     vector<SemaphoreUniquePtr> m_frame_signal_semaphores;
     vector<SemaphoreUniquePtr> m_frame_wait_semaphores;
+    vector<FenceUniquePtr>     m_frame_fences;//每张交换链图像一个，标记其指令缓冲是否执行完毕
+    uint64_t                   m_n_frame;
+    GpuTimer*                  m_gpu_timer;
     #pragma endregion
 
     #pragma region custom
     shared_ptr<Model>         m_model;
+    shared_ptr<DecalStore>    m_decals;
     shared_ptr<Camera>        m_camera;
     shared_ptr<Key>           m_key;
     shared_ptr<Mouse>         m_mouse;
@@ -174,32 +429,64 @@ private:
     ImageViewUniquePtr                                          m_uv_gradient_image_view_ptr;
     ImageUniquePtr                                              m_material_id_image_ptr;
     ImageViewUniquePtr                                          m_material_id_image_view_ptr;
+    ImageUniquePtr                                              m_scene_color_image_ptr;//渲染分辨率与交换链不同时deferred的输出，再缩放拷贝到交换链图像
+    ImageViewUniquePtr                                          m_scene_color_image_view_ptr;
     SamplerUniquePtr                                            m_sampler;
     #pragma endregion
 
     #pragma region buffer
     BufferUniquePtr                         m_texture_indices_uniform_buffer_ptr;
 
-    Decal                                   m_decals[N_MAX_STORED_DECALS];
-    BufferUniquePtr                         m_decals_uniform_buffer_ptr;
-    VkDeviceSize                            m_decals_buffer_size;
     BufferUniquePtr                         m_box_vertex_buffer_ptr;
     BufferUniquePtr                         m_box_index_buffer_ptr;
 
     BufferUniquePtr                         m_picking_storage_buffer_ptr;
     VkDeviceSize                            m_picking_buffer_size;
+    ReadbackRing<PickingStorage>*           m_picking_readback;
+    uint64_t                                m_picking_age;//最近一次放置贴花所用的picking结果距当前的帧数
 
     BufferUniquePtr                         m_cluster_storage_buffer_ptr;
-    VkDeviceSize                            m_cluster_buffer_size;
+    VkDeviceSize                            m_cluster_buffer_size;//当前分辨率和贴花容量实际使用的大小
+    VkDeviceSize                            m_cluster_buffer_capacity;//已分配的大小，只在不够时重新分配
+    ClusterReference*                       m_cluster_reference;//ClusterBinning::CPU时每帧在CPU上分组
+    BufferUniquePtr                         m_cluster_upload_buffer_ptr;//CPU分组结果的上传区，每张交换链图像m_cluster_buffer_size字节
+    VkDeviceSize                            m_cluster_upload_buffer_capacity;
+
+    BufferUniquePtr                         m_tile_depth_bounds_buffer_ptr;//每个tile覆盖的z分片范围(uvec2)
+    VkDeviceSize                            m_tile_depth_bounds_buffer_size;
+    VkDeviceSize                            m_tile_depth_bounds_buffer_capacity;
+
+    BufferUniquePtr                         m_cluster_headers_buffer_ptr;//压缩后每个cluster的(偏移, 数量)
+    VkDeviceSize                            m_cluster_headers_buffer_size;
+    VkDeviceSize                            m_cluster_headers_buffer_capacity;
+    BufferUniquePtr                         m_cluster_indices_buffer_ptr;//压缩后的贴花索引表
+    VkDeviceSize                            m_cluster_indices_buffer_size;
+    VkDeviceSize                            m_cluster_indices_buffer_capacity;
+
+    BufferUniquePtr                         m_cluster_occupancy_buffer_ptr;//ClusterOccupancyStats，每次统计前清零
+    VkDeviceSize                            m_cluster_occupancy_buffer_size;
+    ReadbackRing<ClusterOccupancyStats>*    m_cluster_occupancy_readback;
+
+    BufferUniquePtr                         m_tile_classification_buffer_ptr;//TileClassificationStorage，deferred的间接dispatch参数
+    VkDeviceSize                            m_tile_classification_buffer_size;
+    VkDeviceSize                            m_tile_classification_buffer_capacity;
+
+    BufferUniquePtr                         m_light_buffer_ptr;//LightStorage，启动时写入一次
+    VkDeviceSize                            m_light_buffer_size;
+    BufferUniquePtr                         m_light_cluster_buffer_ptr;//灯光位掩码，与m_cluster_storage_buffer_ptr平行
+    VkDeviceSize                            m_light_cluster_buffer_size;
+    VkDeviceSize                            m_light_cluster_buffer_capacity;
 
     DynamicBufferHelper<MVPUniform>*        m_mvp_dynamic_buffer_helper;
     DynamicBufferHelper<SunLightUniform>*   m_sunLight_dynamic_buffer_helper;
     DynamicBufferHelper<CameraUniform>*     m_camera_dynamic_buffer_helper;
     DynamicBufferHelper<CursorDecal>*       m_cursor_decal_dynamic_buffer_helper;
     IndexUniform                            m_indexUniform;
-    DynamicBufferHelper<IndexUniform>*      m_decal_indices_dynamic_buffer_helper;
+    DynamicBufferHelper<uint>*              m_decal_indices_dynamic_buffer_helper;
     ZBoundsUniform                          m_zBoundsUniform;
-    DynamicBufferHelper<ZBoundsUniform>*    m_decal_ZBounds_dynamic_buffer_helper;
+    DynamicBufferHelper<uvec2>*             m_decal_ZBounds_dynamic_buffer_helper;
+    DynamicBufferHelper<VkDrawIndexedIndirectCommand>* m_cluster_draw_commands_dynamic_buffer_helper;
+    DynamicBufferHelper<DecalCullingUniform>* m_decal_culling_dynamic_buffer_helper;
     #pragma endregion
 
     #pragma region shader
@@ -207,6 +494,15 @@ private:
     unique_ptr<ShaderModuleStageEntryPoint>      m_GBuffer_fs_ptr;
     unique_ptr<ShaderModuleStageEntryPoint>      m_picking_cs_ptr;
     unique_ptr<ShaderModuleStageEntryPoint>      m_deferred_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_deferred_decal_cache_cs_ptr;//定义SHARED_DECAL_CACHE的deferred.comp
+    unique_ptr<ShaderModuleStageEntryPoint>      m_deferred_tile_class_cs_ptr;//定义TILE_CLASSIFICATION的deferred.comp
+    unique_ptr<ShaderModuleStageEntryPoint>      m_tile_classification_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_light_binning_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_decal_culling_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_cluster_binning_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_tile_depth_bounds_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_cluster_compaction_cs_ptr;
+    unique_ptr<ShaderModuleStageEntryPoint>      m_cluster_occupancy_cs_ptr;
     unique_ptr<ShaderModuleStageEntryPoint>      m_cluster_vs_ptr;
     unique_ptr<ShaderModuleStageEntryPoint>      m_cluster_fs_ptr;
     #pragma endregion
@@ -219,17 +515,66 @@ private:
     PipelineID                                   m_GBuffer_gfx_pipeline_id;
     PipelineID                                   m_picking_compute_pipeline_id;
     PipelineID                                   m_deferred_compute_pipeline_id;
+    PipelineID                                   m_deferred_tile_class_compute_pipeline_id[uint(TileClass::COUNT)];//按TileClass特化
+    PipelineID                                   m_tile_classification_compute_pipeline_id;
+    PipelineID                                   m_light_binning_compute_pipeline_id;
+    PipelineID                                   m_decal_culling_compute_pipeline_id;
+    PipelineID                                   m_cluster_binning_compute_pipeline_id;
+    PipelineID                                   m_tile_depth_bounds_compute_pipeline_id;
+    PipelineID                                   m_cluster_compaction_compute_pipeline_id;
+    PipelineID                                   m_cluster_occupancy_compute_pipeline_id;
     #pragma endregion
 
     #pragma region other
-    int m_width;
+    int m_width;//交换链(窗口)尺寸
     int m_height;
+    int m_render_width;//GBuffer、cluster和deferred使用的渲染分辨率，为交换链尺寸乘以m_render_scale
+    int m_render_height;
+    float m_render_scale;
     bool m_is_full_screen;
     RECT m_rect_before_full_screen;
     Format m_depth_format;
-    int m_n_decal;
     DeferredConstants m_deferred_constants;
+    uint m_tile_size;
+    uint m_num_z_tiles;
+    uint64_t m_cluster_config_generation;//每次修改tile大小或z分片数后加一，用于区分GPU计时结果属于哪组配置
+    //标题栏每秒刷新一次的统计，刷新、修改配置或重新加载贴花后清零
+    float m_title_elapsed;
+    uint32_t m_title_frames;
+    uint32_t m_title_reused_frames;
+    double m_title_gpu_ms;
+    uint32_t m_title_gpu_samples;
+    uint64_t m_title_total_evicted;//上次清零时的累计淘汰数
+    uint64_t m_title_generation;//统计所属的m_cluster_config_generation
     int m_num_x_tiles;
     int m_num_y_tiles;
+    uint m_elements_per_cluster;
+    ClusterConstants m_cluster_constants;//随init_cluster_buffer更新，创建管线时作为特化常量数据
+    ZSlicing m_z_slicing;
+    bool m_tile_depth_bounds;
+    bool m_gpu_decal_culling;
+    bool m_subgroup_cluster_atomics;
+    bool m_conservative_cluster_raster;//cluster子流程以tile网格为视口并开启保守光栅化
+    bool m_deferred_decal_cache;//deferred使用共享内存贴花缓存变体，每个工作组一个tile
+    bool m_deferred_decal_cache_active;//实际编译使用的缓存变体，共享内存超过设备上限时退回不带缓存的变体
+    bool m_scalarized_decal_loop;//deferred的贴花循环在子组内统一遍历合并后的cluster位掩码
+    bool m_tile_classification;//deferred按tile分类间接dispatch
+    uint m_num_lights;//灯光静态放置，数量只在启动时确定
+    ClusterBinning m_cluster_binning;
+    //cluster结果对应的视角与贴花集合，三者都未变化时提交m_reuse_cluster_command_buffers
+    mat4 m_cluster_view;
+    mat4 m_cluster_proj;
+    uint64_t m_cluster_decal_generation;
+    bool m_cluster_state_valid;//重新记录指令缓冲后cluster缓冲可能已重新分配，需至少重建一次
+    bool m_reuse_clusters;//本帧是否沿用上一次的cluster结果
+    ClusterOccupancy m_cluster_occupancy;
+    bool m_cluster_autotune_active;
+    vector<ClusterAutotuneResult> m_cluster_autotune_results;
+    uint32_t m_cluster_autotune_index;//正在测试的配置
+    uint32_t m_cluster_autotune_frame;//当前配置已运行的帧数，包括预热帧
+    vec3 m_cluster_autotune_camera_position;//开始前的相机位姿，结束后恢复
+    float m_cluster_autotune_camera_yaw;
+    float m_cluster_autotune_camera_pitch;
+    string m_decal_snapshot_path;
     #pragma endregion
 };
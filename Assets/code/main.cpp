@@ -2,8 +2,178 @@
 
 int main(int argc, char* argv[])
 {
+    //--bench-decal-bounds [n]：只运行贴花包围盒相交测试的微基准，不创建窗口
+    if (argc > 1 && string(argv[1]) == "--bench-decal-bounds")
+    {
+        uint32_t n_boxes = argc > 2 ? uint32_t(atoi(argv[2])) : 100000;
+        return DecalBounds::benchmark(n_boxes) == 0 ? 0 : 1;
+    }
+
+    //--bench-decal-snapshot [n]：只运行DecalStore的快照加载(含GPU上传)、保存耗时测试与往返校验，需要创建设备，不进入渲染循环
+    if (argc > 1 && string(argv[1]) == "--bench-decal-snapshot")
+    {
+        uint32_t n_decals = argc > 2 ? uint32_t(atoi(argv[2])) : 100000;
+        return DecalStore::benchmark(n_decals) == 0 ? 0 : 1;
+    }
+
+    //--bench-cluster-reference [n]：只运行CPU参考分组的微基准，对比单线程与多线程耗时并校验结果一致，不创建窗口
+    if (argc > 1 && string(argv[1]) == "--bench-cluster-reference")
+    {
+        uint32_t n_decals = argc > 2 ? uint32_t(atoi(argv[2])) : 4096;
+        return ClusterReference::benchmark(n_decals) == 0 ? 0 : 1;
+    }
+
+    //--diff-clusters <dump> [tolerance]：读取--dump-clusters写出的转储，在CPU上重新分组并与GPU结果逐位比较，不创建窗口
+    if (argc > 2 && string(argv[1]) == "--diff-clusters")
+    {
+        float tolerance = argc > 3 ? float(atof(argv[3])) : 0.0f;
+        return ClusterReference::diff_dump(argv[2], tolerance);
+    }
+
+    //其余参数一次解析到启动参数中，在第一次调用Engine::Instance()之前传入；未知参数或取值直接报错退出
+    EngineStartupOptions options;
+    string cluster_dump_path;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        const bool takes_value =
+            arg == "--cluster-binning" || arg == "--lights" || arg == "--decals" || arg == "--deferred-decal-cache" ||
+            arg == "--scalarized-decal-loop" || arg == "--tile-classification" || arg == "--dump-clusters" || arg == "--cluster-occupancy";
+        if (takes_value && i + 1 >= argc)
+        {
+            cout << "Missing value for " << arg << endl;
+            return 1;
+        }
+        const string value = takes_value ? argv[++i] : "";
+
+        //on|off开关的取值
+        bool on_off = false;
+        if (arg == "--deferred-decal-cache" || arg == "--scalarized-decal-loop" || arg == "--tile-classification")
+        {
+            if (value != "on" && value != "off")
+            {
+                cout << "Invalid value " << value << " for " << arg << ", expected on|off" << endl;
+                return 1;
+            }
+            on_off = value == "on";
+        }
+
+        //--cluster-binning raster|compute|cpu：选择cluster分组方式
+        if (arg == "--cluster-binning")
+        {
+            if (value == "raster")
+            {
+                options.cluster_binning = ClusterBinning::RASTER;
+            }
+            else if (value == "compute")
+            {
+                options.cluster_binning = ClusterBinning::COMPUTE;
+            }
+            else if (value == "cpu")
+            {
+                options.cluster_binning = ClusterBinning::CPU;
+            }
+            else
+            {
+                cout << "Invalid value " << value << " for " << arg << ", expected raster|compute|cpu" << endl;
+                return 1;
+            }
+        }
+        //--lights <n>：启动时在场景中放置的点光源与聚光灯数量，超过MAX_LIGHTS时截断
+        else if (arg == "--lights")
+        {
+            if (value.empty() || value.find_first_not_of("0123456789") != string::npos)
+            {
+                cout << "Invalid value " << value << " for " << arg << ", expected a non-negative integer" << endl;
+                return 1;
+            }
+            options.num_lights = uint(std::min(strtoul(value.data(), nullptr, 10), static_cast<unsigned long>(MAX_LIGHTS)));
+        }
+        //--decals <path>：启动时从快照恢复贴花，退出时写回同一文件
+        else if (arg == "--decals")
+        {
+            options.decal_snapshot_path = value;
+        }
+        //--deferred-decal-cache on|off：选择deferred是否使用共享内存贴花缓存变体
+        else if (arg == "--deferred-decal-cache")
+        {
+            options.deferred_decal_cache = on_off;
+        }
+        //--scalarized-decal-loop on|off：选择deferred是否使用子组统一贴花循环，设备不支持时保持关闭
+        else if (arg == "--scalarized-decal-loop")
+        {
+            options.scalarized_decal_loop = on_off;
+        }
+        //--tile-classification on|off：选择deferred是否先按tile分类再对每类间接dispatch
+        else if (arg == "--tile-classification")
+        {
+            options.tile_classification = on_off;
+        }
+        //--autotune-clusters：启动后在固定的相机路径上测试多组tile大小与z分片数，输出每组的GPU耗时并采用最快的一组
+        else if (arg == "--autotune-clusters")
+        {
+            options.autotune_clusters = true;
+        }
+        //--compare-deferred-variants：启动后在自动调优的相机路径上依次运行各个deferred变体，输出GPU耗时与加速比并采用最快的一个；
+        //配合--decals载入高密度贴花快照测量贴花密集时的差异
+        else if (arg == "--compare-deferred-variants")
+        {
+            options.compare_deferred_variants = true;
+        }
+        //--dump-clusters <path>：退出时转储最后一次分组的cluster位掩码
+        else if (arg == "--dump-clusters")
+        {
+            cluster_dump_path = value;
+        }
+        //--cluster-occupancy off|stats|heatmap：启动时的cluster占用统计，运行时也可按R切换
+        else if (arg == "--cluster-occupancy")
+        {
+            if (value == "off")
+            {
+                options.cluster_occupancy = ClusterOccupancy::OFF;
+            }
+            else if (value == "stats")
+            {
+                options.cluster_occupancy = ClusterOccupancy::STATS;
+            }
+            else if (value == "heatmap")
+            {
+                options.cluster_occupancy = ClusterOccupancy::HEATMAP;
+            }
+            else
+            {
+                cout << "Invalid value " << value << " for " << arg << ", expected off|stats|heatmap" << endl;
+                return 1;
+            }
+        }
+        else
+        {
+            cout << "Unknown argument " << arg << endl;
+            return 1;
+        }
+    }
+
+    //两者共用自动调优的相机路径与结果表，不能同时运行
+    if (options.autotune_clusters && options.compare_deferred_variants)
+    {
+        cout << "--autotune-clusters and --compare-deferred-variants cannot be combined" << endl;
+        return 1;
+    }
+
+    Engine::set_startup_options(options);
     Engine::Instance()->run();
 
+    if (!cluster_dump_path.empty() && !Engine::Instance()->dump_clusters(cluster_dump_path))
+    {
+        cout << "Failed to dump clusters to " << cluster_dump_path << endl;
+    }
+
+    const string& decal_snapshot_path = Engine::Instance()->get_decal_snapshot_path();
+    if (!decal_snapshot_path.empty() && !Engine::Instance()->save_decals(decal_snapshot_path))
+    {
+        cout << "Failed to save decal snapshot " << decal_snapshot_path << endl;
+    }
+
 #ifdef _DEBUG
     {
         Engine::Instance().reset();
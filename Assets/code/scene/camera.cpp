@@ -28,6 +28,16 @@ vec3 Camera::GetCameraWorldPos()
 	return m_position;
 }
 
+float Camera::GetYaw()
+{
+	return m_yaw;
+}
+
+float Camera::GetPitch()
+{
+	return m_pitch;
+}
+
 mat3 Camera::GetCameraWorldOrientation()
 {
 	mat3 orientation;
@@ -90,7 +100,7 @@ void Camera::ProcessMouseMovement(float xoffset, float yoffset, bool constrainPi
 	m_yaw += xoffset;
 	m_pitch += yoffset;
 
-	//Ʒͻ
+	//限制方向突变
 	if (constrainPitch)
 	{
 		if (m_pitch > 89.0f)
@@ -99,7 +109,15 @@ void Camera::ProcessMouseMovement(float xoffset, float yoffset, bool constrainPi
 			m_pitch = -89.0f;
 	}
 
-	//ͨƫǺ͸Ǽ
+	//通过偏航角和俯仰角计算相机方向
+	updateCameraVectors();
+}
+
+void Camera::SetPose(vec3 position, float yaw, float pitch)
+{
+	m_position = position;
+	m_yaw = yaw;
+	m_pitch = pitch;
 	updateCameraVectors();
 }
 
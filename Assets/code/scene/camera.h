@@ -2,7 +2,7 @@
 #include <stdafx.h>
 #include "../support/single_active.h"
 
-//˶ǰ
+//相机能做的运动：前后左右
 enum Camera_Movement {
 	FORWARD,
 	BACKWARD,
@@ -10,14 +10,14 @@ enum Camera_Movement {
 	RIGHT
 };
 
-//Ĭϵ
-const float YAW = -90.0f;//ƫ
-const float PITCH = 0.0f;//
-const float NEARZ = 0.1f;//ü
-const float FARZ = 35.0f;//Զü
-const float SPEED = 5.0f;//ƶٶ
-const float SENSITIVITY = 0.1f;//תж
-const float ZOOM = 45.0f;//ű
+//默认的相机参数
+const float YAW = -90.0f;//偏航角
+const float PITCH = 0.0f;//俯仰角
+const float NEARZ = 0.1f;//近裁剪面
+const float FARZ = 35.0f;//远裁剪面
+const float SPEED = 5.0f;//相机移动速度
+const float SENSITIVITY = 0.1f;//相机转向敏感度
+const float ZOOM = 45.0f;//缩放比例
 
 class Camera : public SingleActive<Camera>
 {
@@ -35,29 +35,34 @@ public:
 
 	vec3 GetCameraWorldPos();
 	mat3 GetCameraWorldOrientation();
+	float GetYaw();
+	float GetPitch();
 
 
 	void ProcessKeyboard(Camera_Movement direction, float deltaTime);
 	void ProcessMouseMovement(float xoffset, float yoffset, bool constrainPitch = true);
 	void ProcessMouseScroll(float yoffset);
 
+	//直接设置位置与朝向，用于按固定路径移动相机
+	void SetPose(vec3 position, float yaw, float pitch);
+
 private:
-	vec3 m_position;//λ
-	vec3 m_front;//۲ռ-zᳯ
-	vec3 m_up;//۲ռyᳯ
-	vec3 m_right;//۲ռxᳯ
-	vec3 m_world_up;//ռyᳯ
+	vec3 m_position;//相机位置
+	vec3 m_front;//观察空间的-z轴朝向
+	vec3 m_up;//观察空间的y轴朝向
+	vec3 m_right;//观察空间的x轴朝向
+	vec3 m_world_up;//世界空间的y轴朝向
 	
-	float m_yaw;//ƫ
-	float m_pitch;//
-	float m_near_z;//ü
-	float m_far_z;//Զü
-	float m_movement_speed;//ƶٶ
-	float m_mouse_sensitivity;//תж
-	float m_zoom;//ű
+	float m_yaw;//偏航角
+	float m_pitch;//俯仰角
+	float m_near_z;//近裁剪面
+	float m_far_z;//远裁剪面
+	float m_movement_speed;//相机移动速度
+	float m_mouse_sensitivity;//相机转向敏感度
+	float m_zoom;//缩放比例
 
-	mat4 m_viewM;//۲
+	mat4 m_viewM;//观察坐标
 
-	//ͨƫǺ͸Ǽ
+	//通过偏航角和俯仰角计算相机方向
 	void updateCameraVectors();
 };
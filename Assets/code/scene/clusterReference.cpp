@@ -0,0 +1,476 @@
+#include "stdafx.h"
+#include "clusterReference.h"
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <bitset>
+
+//贴花盒的6个面，按DecalTransform::corners的顺序索引，与make_box的顶点顺序一致(从外侧看右手螺旋)，每个面拆成(0,1,2)、(2,3,0)两个三角形
+static const uint32_t s_box_faces[6][4] = {
+	{ 2, 3, 1, 0 },//上
+	{ 4, 5, 7, 6 },//下
+	{ 0, 1, 5, 4 },//前
+	{ 3, 2, 6, 7 },//后
+	{ 2, 0, 4, 6 },//左
+	{ 1, 3, 7, 5 },//右
+};
+
+//-------------------------------------------------------------------------------------------------
+// Sutherland-Hodgman clipping against one Vulkan clip plane: 0 for z >= 0 (near), 1 for z <= w (far)
+//-------------------------------------------------------------------------------------------------
+static uint32_t clip_polygon(const vec4* in, uint32_t n_in, vec4* out, uint32_t plane)
+{
+	uint32_t n_out = 0;
+	for (uint32_t i = 0; i < n_in; ++i)
+	{
+		const vec4& a = in[i];
+		const vec4& b = in[(i + 1) % n_in];
+		const float da = plane == 0 ? a.z : a.w - a.z;
+		const float db = plane == 0 ? b.z : b.w - b.z;
+		if (da >= 0.0f)
+		{
+			out[n_out++] = a;
+		}
+		if ((da >= 0.0f) != (db >= 0.0f))
+		{
+			out[n_out++] = mix(a, b, da / (da - db));
+		}
+	}
+	return n_out;
+}
+
+ClusterReference::ClusterReference(const ClusterConstants& constants, uint32_t render_width, uint32_t render_height)
+	:m_constants(constants),
+	 m_render_width(render_width),
+	 m_render_height(render_height)
+{
+}
+
+void ClusterReference::build(const Decal* decals, const DecalTransform* transforms, DecalBounds* bounds, uint32_t n_decals, const mat4& view, const mat4& proj, uint32_t n_threads)
+{
+	const VkDeviceSize n_words = ClusterStorage::get_size(m_constants.elements_per_cluster, m_constants.num_x_tiles, m_constants.num_y_tiles, m_constants.num_z_tiles) / sizeof(uint);
+	m_bitmask.assign(n_words, 0);
+	if (n_decals == 0)
+	{
+		return;
+	}
+
+	#pragma region 与近平面包围盒相交的贴花走子流程0，其余走子流程1、2
+	//近平面包围盒与decalCulling.comp相同，由view和proj求出
+	BoundingOrientedBox nearClipBox;
+	nearClipBox.Orientation = transpose(mat3(view));
+	nearClipBox.Center = -(nearClipBox.Orientation * vec3(view[3])) - m_constants.near_clip * nearClipBox.Orientation[2];
+	nearClipBox.Extents = vec3(m_constants.near_clip / proj[0][0], -m_constants.near_clip / proj[1][1], 0.01f);
+
+	DecalBounds local_bounds;
+	if (bounds == nullptr)
+	{
+		local_bounds.reserve(n_decals);
+		for (uint32_t n = 0; n < n_decals; ++n)
+		{
+			BoundingOrientedBox box;
+			box.Center = decals[n].position;
+			box.Extents = decals[n].size;
+			box.Orientation = transforms[n].orientation;
+			local_bounds.add(box);
+		}
+		bounds = &local_bounds;
+	}
+	vector<uint8_t> intersects_near_clip(bounds->get_size());
+	bounds->intersects(nearClipBox, intersects_near_clip.data());
+	#pragma endregion
+
+	#pragma region 每32个贴花一组分给工作线程
+	const mat4 view_proj = proj * view;
+	const uint32_t n_groups = (n_decals + 31) / 32;
+	if (n_threads == 0)
+	{
+		n_threads = std::max(1u, thread::hardware_concurrency());
+	}
+	n_threads = std::min(n_threads, n_groups);
+
+	atomic<uint32_t> next_group(0);
+	auto worker = [&]()
+	{
+		for (uint32_t group = next_group++; group < n_groups; group = next_group++)
+		{
+			const uint32_t end = std::min(n_decals, (group + 1) * 32);
+			for (uint32_t n = group * 32; n < end; ++n)
+			{
+				bin_decal(n, transforms[n], view, view_proj, intersects_near_clip[n] != 0);
+			}
+		}
+	};
+
+	vector<thread> threads;
+	for (uint32_t i = 1; i < n_threads; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (thread& t : threads)
+	{
+		t.join();
+	}
+	#pragma endregion
+}
+
+const vector<uint32_t>& ClusterReference::get_bitmask()
+{
+	return m_bitmask;
+}
+
+vector<DecalTransform> ClusterReference::build_transforms(const Decal* decals, uint32_t n_decals)
+{
+	vector<DecalTransform> transforms(n_decals);
+	for (uint32_t n = 0; n < n_decals; ++n)
+	{
+		transforms[n] = DecalStore::build_transform(decals[n]);
+	}
+	return transforms;
+}
+
+void ClusterReference::bin_decal(uint32_t decal_idx, const DecalTransform& transform, const mat4& view, const mat4& view_proj, bool intersects_near_clip)
+{
+	//贴花z范围，与Engine::update_decal相同
+	vec4 clip_corners[8];
+	float minZ = std::numeric_limits<float>::max();
+	float maxZ = -std::numeric_limits<float>::max();
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		const vec4 corner(transform.corners[i], 1.0f);
+		const float vertZ = -(view * corner).z;
+		minZ = std::min(minZ, vertZ);
+		maxZ = std::max(maxZ, vertZ);
+		clip_corners[i] = view_proj * corner;
+	}
+	const uvec2 z_range(m_constants.get_z_slice(minZ), m_constants.get_z_slice(maxZ));
+
+	//GPU上三个子流程依次执行，每个贴花只写自己的位，逐个贴花按相同顺序执行结果一致
+	const uint32_t first_mode = intersects_near_clip ? 0 : 1;
+	const uint32_t last_mode = intersects_near_clip ? 0 : 2;
+	for (uint32_t mode = first_mode; mode <= last_mode; ++mode)
+	{
+		for (uint32_t face = 0; face < 6; ++face)
+		{
+			const uint32_t* quad = s_box_faces[face];
+			const vec4 triangles[2][3] = {
+				{ clip_corners[quad[0]], clip_corners[quad[1]], clip_corners[quad[2]] },
+				{ clip_corners[quad[2]], clip_corners[quad[3]], clip_corners[quad[0]] },
+			};
+			rasterize(decal_idx, triangles[0], mode, z_range);
+			rasterize(decal_idx, triangles[1], mode, z_range);
+		}
+	}
+}
+
+void ClusterReference::rasterize(uint32_t decal_idx, const vec4* triangle, uint32_t mode, uvec2 z_range)
+{
+	#pragma region 裁剪到近、远平面
+	vec4 clipped[8];
+	vec4 temp[8];
+	uint32_t n_vertices = clip_polygon(triangle, 3, temp, 0);
+	n_vertices = clip_polygon(temp, n_vertices, clipped, 1);
+	if (n_vertices < 3)
+	{
+		return;
+	}
+
+	//帧缓冲坐标，视口与create_cluster_pipeline一致：原点在左上，y向下
+	vec3 screen[8];
+	for (uint32_t i = 0; i < n_vertices; ++i)
+	{
+		const vec3 ndc = vec3(clipped[i]) / clipped[i].w;
+		screen[i] = vec3((ndc.x * 0.5f + 0.5f) * m_render_width, (ndc.y * 0.5f + 0.5f) * m_render_height, ndc.z);
+	}
+	#pragma endregion
+
+	for (uint32_t fan = 1; fan + 1 < n_vertices; ++fan)
+	{
+		vec3 v0 = screen[0];
+		vec3 v1 = screen[fan];
+		vec3 v2 = screen[fan + 1];
+
+		#pragma region 面剔除：FrontFace::CLOCKWISE，子流程0、1剔除正面，子流程2剔除背面
+		//按Vulkan规范的面积公式，面积为负的三角形是正面
+		const float area = -0.5f * ((v0.x * v1.y - v1.x * v0.y) + (v1.x * v2.y - v2.x * v1.y) + (v2.x * v0.y - v0.x * v2.y));
+		if (area == 0.0f || (mode == 2) != (area < 0.0f))
+		{
+			continue;
+		}
+		#pragma endregion
+
+		//统一成边函数在内部为正的顺序
+		float area2 = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (area2 < 0.0f)
+		{
+			std::swap(v1, v2);
+			area2 = -area2;
+		}
+
+		//z/w在屏幕空间是线性的，dFdx/dFdy即平面的梯度
+		const float zw_dx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area2;
+		const float zw_dy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area2;
+
+		const vec3 edge_start[3] = { v0, v1, v2 };
+		const vec3 edge_end[3] = { v1, v2, v0 };
+		bool top_left[3];
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			//y向下时，上边水平且内部在下方，左边向上走
+			const vec2 d = vec2(edge_end[e] - edge_start[e]);
+			top_left[e] = (d.y == 0.0f && d.x > 0.0f) || d.y < 0.0f;
+		}
+
+		const float min_x = std::min(v0.x, std::min(v1.x, v2.x));
+		const float max_x = std::max(v0.x, std::max(v1.x, v2.x));
+		const float min_y = std::min(v0.y, std::min(v1.y, v2.y));
+		const float max_y = std::max(v0.y, std::max(v1.y, v2.y));
+		const int x_begin = std::max(0, int(floor(min_x)));
+		const int x_end = std::min(int(m_render_width) - 1, int(ceil(max_x)));
+		const int y_begin = std::max(0, int(floor(min_y)));
+		const int y_end = std::min(int(m_render_height) - 1, int(ceil(max_y)));
+
+		for (int y = y_begin; y <= y_end; ++y)
+		{
+			for (int x = x_begin; x <= x_end; ++x)
+			{
+				//在像素中心采样，恰好落在边上时按左上规则归属
+				const vec2 p(x + 0.5f, y + 0.5f);
+				bool inside = true;
+				for (uint32_t e = 0; e < 3 && inside; ++e)
+				{
+					const vec2 d = vec2(edge_end[e] - edge_start[e]);
+					const float w = d.x * (p.y - edge_start[e].y) - d.y * (p.x - edge_start[e].x);
+					inside = w > 0.0f || (w == 0.0f && top_left[e]);
+				}
+				if (inside)
+				{
+					const float zw = v0.z + zw_dx * (p.x - v0.x) + zw_dy * (p.y - v0.y);
+					shade_fragment(decal_idx, x, y, zw, zw_dx, zw_dy, mode, z_range);
+				}
+			}
+		}
+	}
+}
+
+void ClusterReference::shade_fragment(uint32_t decal_idx, uint32_t pixel_x, uint32_t pixel_y, float zw, float zw_dx, float zw_dy, uint32_t mode, uvec2 z_range)
+{
+	//以下与cluster.frag逐行对应
+	const float tileMinZW = zw - abs(0.5f * zw_dx) - abs(0.5f * zw_dy);
+	const float tileMaxZW = zw + abs(0.5f * zw_dx) + abs(0.5f * zw_dy);
+
+	const float invClipRange = 1.0f / (m_constants.far_clip - m_constants.near_clip);
+	const float proj33 = -m_constants.far_clip * invClipRange;
+	const float proj43 = -m_constants.near_clip * m_constants.far_clip * invClipRange;
+	const float tileMinDepth = proj43 / (-tileMinZW - proj33);
+	const float tileMaxDepth = proj43 / (-tileMaxZW - proj33);
+	const uint minZTile = m_constants.get_z_slice(-tileMinDepth);
+	const uint maxZTile = m_constants.get_z_slice(-tileMaxDepth);
+
+	uint zTileStart = 0;
+	uint zTileEnd = 0;
+	switch (mode)
+	{
+	case 0://intersect
+		zTileStart = 0;
+		zTileEnd = std::min(maxZTile, z_range.y);
+		break;
+	case 1://back
+		zTileStart = std::max(minZTile, z_range.x);
+		zTileEnd = std::min(maxZTile, z_range.y);
+		break;
+	case 2://front
+		zTileStart = std::max(minZTile, z_range.x);
+		zTileEnd = z_range.y;
+		break;
+	}
+
+	const uint elemIdx = decal_idx / 32;
+	const uint mask = 1u << (decal_idx % 32);
+	const uint tileX = pixel_x / m_constants.tile_size;
+	const uint tileY = pixel_y / m_constants.tile_size;
+	for (uint zTile = zTileStart; zTile <= zTileEnd; zTile++)
+	{
+		const uint clusterIndex = (zTile * m_constants.num_x_tiles * m_constants.num_y_tiles) + (tileY * m_constants.num_x_tiles) + tileX;
+		const uint address = clusterIndex * m_constants.elements_per_cluster + elemIdx;
+		if (mode == 2 && (m_bitmask[address] & mask) != 0)break;
+		m_bitmask[address] |= mask;
+	}
+}
+
+ClusterDiffStats ClusterReference::diff(const uint32_t* expected, const uint32_t* actual, const ClusterConstants& constants)
+{
+	ClusterDiffStats stats = {};
+	const uint32_t n_clusters = constants.num_x_tiles * constants.num_y_tiles * constants.num_z_tiles;
+	for (uint32_t cluster = 0; cluster < n_clusters; ++cluster)
+	{
+		bool mismatch = false;
+		for (uint32_t elem = 0; elem < constants.elements_per_cluster; ++elem)
+		{
+			const uint32_t address = cluster * constants.elements_per_cluster + elem;
+			stats.expected_bits += bitset<32>(expected[address]).count();
+			stats.actual_bits += bitset<32>(actual[address]).count();
+			stats.missing_bits += bitset<32>(expected[address] & ~actual[address]).count();
+			stats.extra_bits += bitset<32>(actual[address] & ~expected[address]).count();
+			mismatch = mismatch || expected[address] != actual[address];
+		}
+		stats.mismatched_clusters += mismatch ? 1 : 0;
+	}
+	return stats;
+}
+
+bool ClusterReference::save_dump(const string& path, const ClusterDumpHeader& header, const Decal* decals, const uint32_t* bitmask)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, path.data(), "wb") != 0 || file == nullptr)
+	{
+		return false;
+	}
+
+	//文件头之后紧跟Decal数组和位掩码，偏移由调用者按此顺序填好
+	bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+	result = result && (header.n_decals == 0 || fwrite(decals, sizeof(Decal), header.n_decals, file) == header.n_decals);
+	result = result && fwrite(bitmask, sizeof(uint32_t), header.n_words, file) == header.n_words;
+	result = fclose(file) == 0 && result;
+
+	return result;
+}
+
+int ClusterReference::diff_dump(const string& path, float tolerance)
+{
+	char* data = nullptr;
+	size_t data_size = 0;
+	if (!Anvil::IO::read_file(path, false, &data, &data_size))
+	{
+		cout << "ClusterReference: failed to read " << path << endl;
+		return 1;
+	}
+
+	#pragma region 校验文件头
+	ClusterDumpHeader header;
+	bool valid = data_size >= sizeof(header);
+	if (valid)
+	{
+		memcpy(&header, data, sizeof(header));
+		const ClusterConstants& c = header.constants;
+		valid = header.magic == DUMP_MAGIC
+			&& header.version == DUMP_VERSION
+			&& header.record_size == sizeof(Decal)
+			&& header.n_words * sizeof(uint32_t) == ClusterStorage::get_size(c.elements_per_cluster, c.num_x_tiles, c.num_y_tiles, c.num_z_tiles)
+			&& header.decals_offset + uint64_t(header.n_decals) * sizeof(Decal) <= data_size
+			&& header.bitmask_offset + uint64_t(header.n_words) * sizeof(uint32_t) <= data_size;
+	}
+	if (!valid)
+	{
+		cout << "ClusterReference: " << path << " is not a valid cluster dump" << endl;
+		delete[] data;
+		return 1;
+	}
+
+	//拷贝出来，保证Decal与mat4的对齐
+	vector<Decal> decals(header.n_decals);
+	memcpy(decals.data(), data + header.decals_offset, sizeof(Decal) * header.n_decals);
+	vector<uint32_t> gpu_bitmask(header.n_words);
+	memcpy(gpu_bitmask.data(), data + header.bitmask_offset, sizeof(uint32_t) * header.n_words);
+	delete[] data;
+	#pragma endregion
+
+	#pragma region 重新分组并比较
+	ClusterReference reference(header.constants, header.render_width, header.render_height);
+	auto start_time = chrono::high_resolution_clock::now();
+	const vector<DecalTransform> transforms = build_transforms(decals.data(), header.n_decals);
+	reference.build(decals.data(), transforms.data(), nullptr, header.n_decals, header.view, header.proj);
+	const double build_time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+
+	const ClusterDiffStats stats = diff(reference.get_bitmask().data(), gpu_bitmask.data(), header.constants);
+	const uint64_t mismatched_bits = stats.missing_bits + stats.extra_bits;
+	const double mismatch_ratio = double(mismatched_bits) / double(std::max<uint64_t>(1, stats.expected_bits));
+
+	cout << "ClusterReference diff: " << path << endl;
+	cout << "  " << header.n_decals << " decals, " << header.render_width << "x" << header.render_height
+		<< ", tile " << header.constants.tile_size << ", " << header.constants.num_z_tiles << " slices, GPU binning: "
+		<< Engine::get_cluster_binning_name(ClusterBinning(header.binning)) << endl;
+	cout << "  CPU build: " << build_time << " ms" << endl;
+	cout << "  bits set: CPU " << stats.expected_bits << ", GPU " << stats.actual_bits << endl;
+	cout << "  missing on GPU: " << stats.missing_bits << ", extra on GPU: " << stats.extra_bits
+		<< ", mismatched clusters: " << stats.mismatched_clusters << " (" << mismatch_ratio * 100.0 << "% of set bits)" << endl;
+	if (ClusterBinning(header.binning) == ClusterBinning::COMPUTE)
+	{
+		cout << "  note: compute binning is conservative, extra bits on GPU are expected" << endl;
+	}
+	else if ((header.flags & DUMP_FLAG_CONSERVATIVE_RASTER) != 0)
+	{
+		cout << "  note: GPU used conservative tile-resolution raster, extra bits on GPU are expected" << endl;
+	}
+	#pragma endregion
+
+	return mismatch_ratio <= tolerance ? 0 : 1;
+}
+
+uint32_t ClusterReference::benchmark(uint32_t n_decals, uint32_t n_iterations)
+{
+	#pragma region 随机生成相机前方的贴花，部分与近平面相交
+	const uint32_t render_width = 1280;
+	const uint32_t render_height = 720;
+
+	ClusterConstants constants;
+	constants.near_clip = NEARZ;
+	constants.far_clip = FARZ;
+	constants.num_x_tiles = (render_width + Tile_Size - 1) / Tile_Size;
+	constants.num_y_tiles = (render_height + Tile_Size - 1) / Tile_Size;
+	constants.num_z_tiles = NUM_Z_TILES;
+	constants.elements_per_cluster = (n_decals + 31) / 32;
+	constants.tile_size = Tile_Size;
+	constants.z_slicing = uint(Z_SLICING);
+
+	const mat4 view = lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	mat4 proj = perspective(radians(ZOOM), float(render_width) / render_height, NEARZ, FARZ);
+	proj[1][1] *= -1;
+
+	mt19937 random_engine(1234);
+	uniform_real_distribution<float> random_x(-6.0f, 6.0f);
+	uniform_real_distribution<float> random_y(-3.0f, 3.0f);
+	uniform_real_distribution<float> random_z(-20.0f, 0.5f);
+	uniform_real_distribution<float> random_size(0.1f, 1.0f);
+	uniform_real_distribution<float> random_normal(-1.0f, 1.0f);
+	uniform_real_distribution<float> random_rotation(0.0f, 6.2831853f);
+
+	vector<Decal> decals(n_decals);
+	memset(decals.data(), 0, sizeof(Decal) * n_decals);
+	for (uint32_t n = 0; n < n_decals; ++n)
+	{
+		decals[n].position = vec3(random_x(random_engine), random_y(random_engine), random_z(random_engine));
+		decals[n].normal = normalize(vec3(random_normal(random_engine), random_normal(random_engine), random_normal(random_engine)) + vec3(0.0f, 0.0f, 1e-3f));
+		decals[n].size = vec3(random_size(random_engine), random_size(random_engine), random_size(random_engine) * 0.25f);
+		decals[n].rotation = random_rotation(random_engine);
+		decals[n].layer = n % N_DECALS;
+	}
+	#pragma endregion
+
+	#pragma region 单线程参考结果与多线程对比
+	const vector<DecalTransform> transforms = build_transforms(decals.data(), n_decals);
+	ClusterReference single_thread(constants, render_width, render_height);
+	ClusterReference multi_thread(constants, render_width, render_height);
+	double times[2] = { 0.0, 0.0 };
+	for (uint32_t iteration = 0; iteration < n_iterations; ++iteration)
+	{
+		auto start_time = chrono::high_resolution_clock::now();
+		single_thread.build(decals.data(), transforms.data(), nullptr, n_decals, view, proj, 1);
+		times[0] += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+
+		start_time = chrono::high_resolution_clock::now();
+		multi_thread.build(decals.data(), transforms.data(), nullptr, n_decals, view, proj);
+		times[1] += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+	}
+
+	const ClusterDiffStats stats = diff(single_thread.get_bitmask().data(), multi_thread.get_bitmask().data(), constants);
+	cout << "ClusterReference benchmark: " << n_decals << " decals, " << render_width << "x" << render_height << ", " << n_iterations << " iterations" << endl;
+	cout << "  1 thread: " << times[0] / n_iterations << " ms/build, " << stats.expected_bits << " bits set" << endl;
+	cout << "  " << std::max(1u, thread::hardware_concurrency()) << " threads: " << times[1] / n_iterations << " ms/build, "
+		<< times[0] / times[1] << "x, " << stats.mismatched_clusters << " mismatched clusters" << endl;
+	#pragma endregion
+
+	return stats.mismatched_clusters;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "stdafx.h"
+
+//cluster位掩码转储文件头：小端序，文件头后依次为Decal数组与位掩码，偏移由文件头给出。
+//记录了GPU这一帧分组的全部输入，没有GPU的机器上也能用ClusterReference重新分组并逐位比较
+struct ClusterDumpHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;//sizeof(Decal)，布局改变后旧文件被拒绝
+	uint32_t n_decals;
+	uint32_t render_width;
+	uint32_t render_height;
+	uint32_t binning;//ClusterBinning
+	uint32_t flags;//DUMP_FLAG_*
+	uint32_t n_words;//位掩码的uint数，与ClusterStorage::get_size一致
+	ClusterConstants constants;
+	mat4 view;
+	mat4 proj;
+	uint64_t decals_offset;
+	uint64_t bitmask_offset;
+};
+
+//两份位掩码逐位比较的结果
+struct ClusterDiffStats
+{
+	uint64_t expected_bits;//参考结果中置位的数量
+	uint64_t actual_bits;
+	uint64_t missing_bits;//参考结果有而实际结果没有
+	uint64_t extra_bits;//实际结果有而参考结果没有
+	uint32_t mismatched_clusters;
+};
+
+//CPU参考分组：用软件光栅化重现cluster.vert/cluster.frag的三个子流程(与近平面相交、背面、正面)，输出与ClusterStorage相同的位掩码布局。
+//每32个贴花为一组分给工作线程，一组只写每个cluster中属于自己的那个uint，线程间不需要同步。
+//除转储比较与微基准外，也作为ClusterBinning::CPU每帧的分组方式，结果由Engine上传到cluster缓冲
+class ClusterReference
+{
+public:
+	static const uint32_t DUMP_MAGIC = 0x54534C43;//"CLST"
+	static const uint32_t DUMP_VERSION = 2;
+	static const uint32_t DUMP_FLAG_CONSERVATIVE_RASTER = 1;//GPU在tile分辨率下保守光栅化
+
+	ClusterReference(const ClusterConstants& constants, uint32_t render_width, uint32_t render_height);
+
+	//view、proj与GPU的MVP一致(proj已翻转y轴)；transforms为DecalStore放置时缓存的变换，bounds为与贴花一一对应的包围盒，
+	//为nullptr时由transforms临时建立；n_threads为0时使用全部硬件线程
+	void build(const Decal* decals, const DecalTransform* transforms, DecalBounds* bounds, uint32_t n_decals, const mat4& view, const mat4& proj, uint32_t n_threads = 0);
+	const vector<uint32_t>& get_bitmask();
+
+	static ClusterDiffStats diff(const uint32_t* expected, const uint32_t* actual, const ClusterConstants& constants);
+
+	//转储文件由Engine::dump_clusters写出
+	static bool save_dump(const string& path, const ClusterDumpHeader& header, const Decal* decals, const uint32_t* bitmask);
+	//读取转储文件，在CPU上重新分组并与其中的GPU结果比较；不一致的位数占参考置位数的比例超过tolerance时返回非0
+	static int diff_dump(const string& path, float tolerance = 0.0f);
+
+	//微基准：随机生成相机前方的n_decals个贴花，对比单线程与多线程的耗时并校验结果一致，返回不一致的cluster数
+	static uint32_t benchmark(uint32_t n_decals, uint32_t n_iterations = 10);
+
+private:
+	ClusterConstants m_constants;
+	uint32_t m_render_width;
+	uint32_t m_render_height;
+	vector<uint32_t> m_bitmask;
+
+	static vector<DecalTransform> build_transforms(const Decal* decals, uint32_t n_decals);//转储与微基准中的贴花没有缓存的变换
+	void bin_decal(uint32_t decal_idx, const DecalTransform& transform, const mat4& view, const mat4& view_proj, bool intersects_near_clip);
+	void rasterize(uint32_t decal_idx, const vec4* triangle, uint32_t mode, uvec2 z_range);
+	void shade_fragment(uint32_t decal_idx, uint32_t pixel_x, uint32_t pixel_y, float zw, float zw_dx, float zw_dy, uint32_t mode, uvec2 z_range);
+};
@@ -0,0 +1,198 @@
+#include "stdafx.h"
+#include "decalAtlas.h"
+#include "stb_image/stb_image.h"
+#include "stb_image/stb_image_resize.h"
+
+DecalAtlas::DecalAtlas(string directory, uint32_t n_decals, uint32_t layer_size)
+	:m_layer_size(layer_size)
+{
+	m_n_mipmaps = static_cast<uint32_t>(floor(log2(m_layer_size))) + 1;
+
+	vector<string> albedo_paths;
+	vector<string> normal_paths;
+	char decal_str[128];
+	for (uint32_t i = 0; i < n_decals; i++)
+	{
+		sprintf_s(decal_str, "/BrickDamageDecal%02d.png", i + 1);
+		albedo_paths.push_back(directory + decal_str);
+
+		sprintf_s(decal_str, "/BrickDamageDecal%02d_NM.png", i + 1);
+		normal_paths.push_back(directory + decal_str);
+	}
+
+	create_array(albedo_paths, m_albedo_image_ptr, m_albedo_image_view_ptr, "Decal albedo array");
+	create_array(normal_paths, m_normal_image_ptr, m_normal_image_view_ptr, "Decal normal array");
+	init_sampler();
+}
+
+void DecalAtlas::create_array(const vector<string>& paths, ImageUniquePtr& image_ptr, ImageViewUniquePtr& image_view_ptr, const char* name)
+{
+	auto allocator_ptr = MemoryAllocator::create_oneshot(Engine::Instance()->getDevice());
+	const uint32_t n_layers = paths.size();
+	const bool record_sizes = m_sizes.empty();
+
+	#pragma region 读取每层纹理，缩放到统一尺寸并生成mipmap
+	//各贴花纹理尺寸不同，统一缩放到m_layer_size，采样时UV仍为[0,1]，贴花的长宽比由贴花尺寸保证
+	vector<Anvil::MipmapRawData> mipmapRawDatas;
+	for (uint32_t n_layer = 0; n_layer < n_layers; n_layer++)
+	{
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(paths[n_layer].data(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			throw std::runtime_error("failed to load decal texture image!");
+		}
+		if (record_sizes)
+		{
+			m_sizes.push_back(vec2(width, height));
+		}
+
+		int32_t mip_size = m_layer_size;
+		auto mip_pixels = make_shared<vector<unsigned char>>(mip_size * mip_size * 4);
+		stbir_resize_uint8(
+			pixels,
+			width,
+			height,
+			0,
+			mip_pixels->data(),
+			mip_size,
+			mip_size,
+			0,
+			4);
+		stbi_image_free(pixels);
+
+		for (uint32_t n_mipmap = 0; n_mipmap < m_n_mipmaps; n_mipmap++)
+		{
+			mipmapRawDatas.push_back(MipmapRawData::create_2D_array_from_uchar_vector_ptr(
+				ImageAspectFlagBits::COLOR_BIT,
+				n_layer,
+				1, /* in_n_layers */
+				n_mipmap,
+				mip_pixels,
+				mip_size * mip_size * 4,
+				mip_size * 4));
+
+			if (n_mipmap + 1 < m_n_mipmaps)
+			{
+				int32_t next_mip_size = mip_size > 1 ? mip_size / 2 : 1;
+				auto next_mip_pixels = make_shared<vector<unsigned char>>(next_mip_size * next_mip_size * 4);
+				stbir_resize_uint8(
+					mip_pixels->data(),
+					mip_size,
+					mip_size,
+					0,
+					next_mip_pixels->data(),
+					next_mip_size,
+					next_mip_size,
+					0,
+					4);
+				mip_size = next_mip_size;
+				mip_pixels = next_mip_pixels;
+			}
+		}
+	}
+	#pragma endregion
+
+	#pragma region 创建纹理数组图像
+	auto image_create_info_ptr = ImageCreateInfo::create_no_alloc(
+		Engine::Instance()->getDevice(),
+		ImageType::_2D,
+		Format::R8G8B8A8_UNORM,
+		ImageTiling::OPTIMAL,
+		ImageUsageFlagBits::SAMPLED_BIT,
+		m_layer_size,
+		m_layer_size,
+		1,
+		n_layers,
+		SampleCountFlagBits::_1_BIT,
+		QueueFamilyFlagBits::COMPUTE_BIT | QueueFamilyFlagBits::GRAPHICS_BIT,
+		SharingMode::EXCLUSIVE,
+		true, /* in_use_full_mipmap_chain */
+		ImageCreateFlagBits::NONE,
+		ImageLayout::SHADER_READ_ONLY_OPTIMAL,
+		&mipmapRawDatas);
+
+	image_ptr = Image::create(move(image_create_info_ptr));
+	image_ptr->set_name(name);
+
+	allocator_ptr->add_image_whole(
+		image_ptr.get(),
+		MemoryFeatureFlagBits::NONE);
+	#pragma endregion
+
+	#pragma region 创建纹理数组图像视图
+	auto image_view_create_info_ptr = ImageViewCreateInfo::create_2D_array(
+		Engine::Instance()->getDevice(),
+		image_ptr.get(),
+		0,
+		n_layers,
+		0,
+		m_n_mipmaps,
+		ImageAspectFlagBits::COLOR_BIT,
+		Format::R8G8B8A8_UNORM,
+		ComponentSwizzle::R,
+		ComponentSwizzle::G,
+		ComponentSwizzle::B,
+		ComponentSwizzle::A);
+
+	image_view_ptr = ImageView::create(move(image_view_create_info_ptr));
+	#pragma endregion
+}
+
+void DecalAtlas::init_sampler()
+{
+	//贴花UV已限制在[0,1]，边缘使用CLAMP避免相邻纹素渗入；mip不设上限
+	auto sampler_create_info_ptr = SamplerCreateInfo::create(
+		Engine::Instance()->getDevice(),
+		Filter::LINEAR,
+		Filter::LINEAR,
+		SamplerMipmapMode::LINEAR,
+		SamplerAddressMode::CLAMP_TO_EDGE,
+		SamplerAddressMode::CLAMP_TO_EDGE,
+		SamplerAddressMode::CLAMP_TO_EDGE,
+		0.0f,
+		16,
+		false,
+		CompareOp::ALWAYS,
+		0.0f,
+		static_cast<float>(m_n_mipmaps),
+		BorderColor::INT_OPAQUE_BLACK,
+		false);
+
+	m_sampler_ptr = Sampler::create(move(sampler_create_info_ptr));
+}
+
+uint32_t DecalAtlas::get_layer_num()
+{
+	return m_sizes.size();
+}
+
+vec2 DecalAtlas::get_size(uint32_t layer)
+{
+	return m_sizes[layer];
+}
+
+DescriptorSet::CombinedImageSamplerBindingElement DecalAtlas::get_albedo_binding()
+{
+	return DescriptorSet::CombinedImageSamplerBindingElement(
+		ImageLayout::SHADER_READ_ONLY_OPTIMAL,
+		m_albedo_image_view_ptr.get(),
+		m_sampler_ptr.get());
+}
+
+DescriptorSet::CombinedImageSamplerBindingElement DecalAtlas::get_normal_binding()
+{
+	return DescriptorSet::CombinedImageSamplerBindingElement(
+		ImageLayout::SHADER_READ_ONLY_OPTIMAL,
+		m_normal_image_view_ptr.get(),
+		m_sampler_ptr.get());
+}
+
+DecalAtlas::~DecalAtlas()
+{
+	m_sampler_ptr.reset();
+	m_albedo_image_view_ptr.reset();
+	m_albedo_image_ptr.reset();
+	m_normal_image_view_ptr.reset();
+	m_normal_image_ptr.reset();
+}
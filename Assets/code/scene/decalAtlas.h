@@ -0,0 +1,29 @@
+#pragma once
+#include "stdafx.h"
+
+//贴花纹理数组：所有贴花的albedo和法线纹理各打包成一张带完整mip链的2D数组纹理，
+//每个贴花占一层，贴花通过层索引引用，不再占用材质纹理的描述符
+class DecalAtlas
+{
+public:
+	DecalAtlas(string directory, uint32_t n_decals, uint32_t layer_size = DECAL_ATLAS_LAYER_SIZE);
+	uint32_t get_layer_num();
+	vec2 get_size(uint32_t layer);//原始纹理尺寸，用于按比例确定贴花大小
+	DescriptorSet::CombinedImageSamplerBindingElement get_albedo_binding();
+	DescriptorSet::CombinedImageSamplerBindingElement get_normal_binding();
+
+	~DecalAtlas();
+
+private:
+	uint32_t m_layer_size;
+	uint32_t m_n_mipmaps;
+	vector<vec2> m_sizes;
+	ImageUniquePtr m_albedo_image_ptr;
+	ImageViewUniquePtr m_albedo_image_view_ptr;
+	ImageUniquePtr m_normal_image_ptr;
+	ImageViewUniquePtr m_normal_image_view_ptr;
+	SamplerUniquePtr m_sampler_ptr;
+
+	void create_array(const vector<string>& paths, ImageUniquePtr& image_ptr, ImageViewUniquePtr& image_view_ptr, const char* name);
+	void init_sampler();
+};
@@ -0,0 +1,404 @@
+#include "stdafx.h"
+#include "decalBounds.h"
+#include <intrin.h>
+#include <random>
+#include <chrono>
+
+#pragma region 各指令集的基本运算
+namespace
+{
+	struct ScalarOps
+	{
+		typedef float Reg;
+		typedef bool Mask;
+		static const uint32_t WIDTH = 1;
+
+		static Reg load(const float* p) { return *p; }
+		static Reg set(float v) { return v; }
+		static Reg add(Reg a, Reg b) { return a + b; }
+		static Reg sub(Reg a, Reg b) { return a - b; }
+		static Reg mul(Reg a, Reg b) { return a * b; }
+		static Reg abs(Reg a) { return fabsf(a); }
+		static Mask no_mask() { return false; }
+		static Mask greater(Reg a, Reg b) { return a > b; }
+		static Mask or_mask(Mask a, Mask b) { return a || b; }
+		static uint32_t bits(Mask m) { return m ? 1 : 0; }
+	};
+
+	struct SseOps
+	{
+		typedef __m128 Reg;
+		typedef __m128 Mask;
+		static const uint32_t WIDTH = 4;
+
+		static Reg load(const float* p) { return _mm_loadu_ps(p); }
+		static Reg set(float v) { return _mm_set1_ps(v); }
+		static Reg add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+		static Reg sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+		static Reg mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+		static Reg abs(Reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static Mask no_mask() { return _mm_setzero_ps(); }
+		static Mask greater(Reg a, Reg b) { return _mm_cmpgt_ps(a, b); }
+		static Mask or_mask(Mask a, Mask b) { return _mm_or_ps(a, b); }
+		static uint32_t bits(Mask m) { return uint32_t(_mm_movemask_ps(m)); }
+	};
+
+	//只用到AVX的浮点指令，MSVC无需/arch:AVX即可生成，调用前须确认CPU支持
+	struct AvxOps
+	{
+		typedef __m256 Reg;
+		typedef __m256 Mask;
+		static const uint32_t WIDTH = 8;
+
+		static Reg load(const float* p) { return _mm256_loadu_ps(p); }
+		static Reg set(float v) { return _mm256_set1_ps(v); }
+		static Reg add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+		static Reg sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+		static Reg mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+		static Reg abs(Reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static Mask no_mask() { return _mm256_setzero_ps(); }
+		static Mask greater(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static Mask or_mask(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+		static uint32_t bits(Mask m) { return uint32_t(_mm256_movemask_ps(m)); }
+	};
+
+	//对所有贴花都相同的近平面包围盒
+	struct BoxConstants
+	{
+		float center[3];
+		float extents[3];
+		float orientation[9];//[列 * 3 + 行]
+	};
+}
+#pragma endregion
+
+#pragma region 分离轴测试内核
+namespace
+{
+	//与Engine::Intersects的15条分离轴一一对应，且加法、乘法顺序与glm的展开完全相同，保证结果逐位一致。
+	//glm点积中与0相乘的项被省略：有限输入下(x + 0*y)与x相等，0的符号不影响比较结果
+	template<class Ops>
+	void intersects_kernel(
+		const vector<float>* center,
+		const vector<float>* extents,
+		const vector<float>* orientation,
+		const BoxConstants& a,
+		uint32_t n_boxes,
+		uint8_t* results)
+	{
+		typedef typename Ops::Reg Reg;
+		const uint32_t width = Ops::WIDTH;
+
+		for (uint32_t first = 0; first < n_boxes; first += width)
+		{
+			Reg hB[3], dAB[3], B[3][3];
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				hB[i] = Ops::load(extents[i].data() + first);
+				dAB[i] = Ops::sub(Ops::load(center[i].data() + first), Ops::set(a.center[i]));
+			}
+			for (uint32_t i = 0; i < 9; ++i)
+			{
+				B[i / 3][i % 3] = Ops::load(orientation[i].data() + first);
+			}
+
+			//R = transpose(A) * B，t = transpose(A) * (B.Center - A.Center)
+			Reg R[3][3], AR[3][3], t[3], hA[3];
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				const float* Ai = a.orientation + i * 3;
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					R[j][i] = Ops::add(Ops::add(
+						Ops::mul(Ops::set(Ai[0]), B[j][0]),
+						Ops::mul(Ops::set(Ai[1]), B[j][1])),
+						Ops::mul(Ops::set(Ai[2]), B[j][2]));
+					AR[j][i] = Ops::abs(R[j][i]);
+				}
+				t[i] = Ops::add(Ops::add(
+					Ops::mul(Ops::set(Ai[0]), dAB[0]),
+					Ops::mul(Ops::set(Ai[1]), dAB[1])),
+					Ops::mul(Ops::set(Ai[2]), dAB[2]));
+				hA[i] = Ops::set(a.extents[i]);
+			}
+
+			typename Ops::Mask separated = Ops::no_mask();
+			auto test_axis = [&](Reg d, Reg d_A, Reg d_B)
+			{
+				separated = Ops::or_mask(separated, Ops::greater(Ops::abs(d), Ops::add(d_A, d_B)));
+			};
+			auto dot3 = [](Reg x0, Reg y0, Reg x1, Reg y1, Reg x2, Reg y2)
+			{
+				return Ops::add(Ops::add(Ops::mul(x0, y0), Ops::mul(x1, y1)), Ops::mul(x2, y2));
+			};
+			auto dot2 = [](Reg x0, Reg y0, Reg x1, Reg y1)
+			{
+				return Ops::add(Ops::mul(x0, y0), Ops::mul(x1, y1));
+			};
+			auto cross2 = [](Reg x0, Reg y0, Reg x1, Reg y1)
+			{
+				return Ops::sub(Ops::mul(x0, y0), Ops::mul(x1, y1));
+			};
+
+			//l = a(u), a(v), a(w)
+			for (uint32_t i = 0; i < 3; ++i)
+				test_axis(t[i], hA[i], dot3(hB[0], AR[0][i], hB[1], AR[1][i], hB[2], AR[2][i]));
+
+			//l = b(u), b(v), b(w)
+			for (uint32_t j = 0; j < 3; ++j)
+				test_axis(
+					dot3(t[0], R[j][0], t[1], R[j][1], t[2], R[j][2]),
+					dot3(hA[0], AR[j][0], hA[1], AR[j][1], hA[2], AR[j][2]),
+					hB[j]);
+
+			//l = a(u) x b(u), a(u) x b(v), a(u) x b(w)
+			test_axis(cross2(t[2], R[0][1], t[1], R[0][2]), dot2(hA[1], AR[0][2], hA[2], AR[0][1]), dot2(hB[1], AR[2][0], hB[2], AR[1][0]));
+			test_axis(cross2(t[2], R[1][1], t[1], R[1][2]), dot2(hA[1], AR[1][2], hA[2], AR[1][1]), dot2(hB[0], AR[2][0], hB[2], AR[0][0]));
+			test_axis(cross2(t[2], R[2][1], t[1], R[2][2]), dot2(hA[1], AR[2][2], hA[2], AR[2][1]), dot2(hB[0], AR[1][0], hB[1], AR[0][0]));
+
+			//l = a(v) x b(u), a(v) x b(v), a(v) x b(w)
+			test_axis(cross2(t[0], R[0][2], t[2], R[0][0]), dot2(hA[0], AR[0][2], hA[2], AR[0][0]), dot2(hB[1], AR[2][1], hB[2], AR[1][1]));
+			test_axis(cross2(t[0], R[1][2], t[2], R[1][0]), dot2(hA[0], AR[1][2], hA[2], AR[1][0]), dot2(hB[0], AR[2][1], hB[2], AR[0][1]));
+			test_axis(cross2(t[0], R[2][2], t[2], R[2][0]), dot2(hA[0], AR[2][2], hA[2], AR[2][0]), dot2(hB[0], AR[1][1], hB[1], AR[0][1]));
+
+			//l = a(w) x b(u), a(w) x b(v), a(w) x b(w)
+			test_axis(cross2(t[1], R[0][0], t[0], R[0][1]), dot2(hA[0], AR[0][1], hA[1], AR[0][0]), dot2(hB[1], AR[2][2], hB[2], AR[1][2]));
+			test_axis(cross2(t[1], R[1][0], t[0], R[1][1]), dot2(hA[0], AR[1][1], hA[1], AR[1][0]), dot2(hB[0], AR[2][2], hB[2], AR[0][2]));
+			test_axis(cross2(t[1], R[2][0], t[0], R[2][1]), dot2(hA[0], AR[2][1], hA[1], AR[2][0]), dot2(hB[0], AR[1][2], hB[1], AR[0][2]));
+
+			//补齐的尾部不写回
+			const uint32_t separated_bits = Ops::bits(separated);
+			const uint32_t n_lanes = std::min(width, n_boxes - first);
+			for (uint32_t lane = 0; lane < n_lanes; ++lane)
+			{
+				results[first + lane] = ((separated_bits >> lane) & 1) ? 0 : 1;
+			}
+		}
+	}
+}
+#pragma endregion
+
+DecalBounds::DecalBounds()
+	:m_size(0)
+{
+	m_max_simd_level = detect_simd_level();
+	m_simd_level = m_max_simd_level;
+}
+
+void DecalBounds::add(const BoundingOrientedBox& box)
+{
+	//每次按LANES补齐，保证SIMD整组读取不越界，补齐部分为0
+	if (m_size % LANES == 0)
+	{
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			m_center[i].resize(m_size + LANES, 0.0f);
+			m_extents[i].resize(m_size + LANES, 0.0f);
+		}
+		for (uint32_t i = 0; i < 9; ++i)
+		{
+			m_orientation[i].resize(m_size + LANES, 0.0f);
+		}
+	}
+
+	m_size++;
+	set(m_size - 1, box);
+}
+
+void DecalBounds::reserve(uint32_t n)
+{
+	const uint32_t size = (n + LANES - 1) / LANES * LANES;
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		m_center[i].reserve(size);
+		m_extents[i].reserve(size);
+	}
+	for (uint32_t i = 0; i < 9; ++i)
+	{
+		m_orientation[i].reserve(size);
+	}
+}
+
+void DecalBounds::set(uint32_t n, const BoundingOrientedBox& box)
+{
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		m_center[i][n] = box.Center[i];
+		m_extents[i][n] = box.Extents[i];
+	}
+	for (uint32_t i = 0; i < 9; ++i)
+	{
+		m_orientation[i][n] = box.Orientation[i / 3][i % 3];
+	}
+}
+
+void DecalBounds::clear()
+{
+	m_size = 0;
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		m_center[i].clear();
+		m_extents[i].clear();
+	}
+	for (uint32_t i = 0; i < 9; ++i)
+	{
+		m_orientation[i].clear();
+	}
+}
+
+BoundingOrientedBox DecalBounds::get(uint32_t n)
+{
+	BoundingOrientedBox box;
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		box.Center[i] = m_center[i][n];
+		box.Extents[i] = m_extents[i][n];
+	}
+	for (uint32_t i = 0; i < 9; ++i)
+	{
+		box.Orientation[i / 3][i % 3] = m_orientation[i][n];
+	}
+	return box;
+}
+
+uint32_t DecalBounds::get_size()
+{
+	return m_size;
+}
+
+SimdLevel DecalBounds::get_simd_level()
+{
+	return m_simd_level;
+}
+
+SimdLevel DecalBounds::get_max_simd_level()
+{
+	return m_max_simd_level;
+}
+
+void DecalBounds::set_simd_level(SimdLevel level)
+{
+	m_simd_level = std::min(level, m_max_simd_level);
+}
+
+void DecalBounds::intersects(const BoundingOrientedBox& box, uint8_t* results)
+{
+	BoxConstants a;
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		a.center[i] = box.Center[i];
+		a.extents[i] = box.Extents[i];
+	}
+	for (uint32_t i = 0; i < 9; ++i)
+	{
+		a.orientation[i] = box.Orientation[i / 3][i % 3];
+	}
+
+	switch (m_simd_level)
+	{
+	case SimdLevel::AVX:
+		intersects_kernel<AvxOps>(m_center, m_extents, m_orientation, a, m_size, results);
+		break;
+	case SimdLevel::SSE:
+		intersects_kernel<SseOps>(m_center, m_extents, m_orientation, a, m_size, results);
+		break;
+	default:
+		intersects_kernel<ScalarOps>(m_center, m_extents, m_orientation, a, m_size, results);
+		break;
+	}
+}
+
+SimdLevel DecalBounds::detect_simd_level()
+{
+	int cpu_info[4];
+	__cpuid(cpu_info, 1);
+
+	const bool has_sse = (cpu_info[3] & (1 << 25)) != 0;
+	const bool has_osxsave = (cpu_info[2] & (1 << 27)) != 0;
+	const bool has_avx = (cpu_info[2] & (1 << 28)) != 0;
+
+	//AVX还需要操作系统保存YMM寄存器状态
+	if (has_osxsave && has_avx && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		return SimdLevel::AVX;
+	}
+	if (has_sse)
+	{
+		return SimdLevel::SSE;
+	}
+	return SimdLevel::SCALAR;
+}
+
+uint32_t DecalBounds::benchmark(uint32_t n_boxes, uint32_t n_iterations)
+{
+	#pragma region 随机生成相机附近的贴花
+	mt19937 random_engine(1234);
+	uniform_real_distribution<float> random_position(-2.0f, 2.0f);
+	uniform_real_distribution<float> random_size(0.05f, 0.5f);
+	uniform_real_distribution<float> random_normal(-1.0f, 1.0f);
+
+	DecalBounds bounds;
+	for (uint32_t n = 0; n < n_boxes; ++n)
+	{
+		Decal decal;
+		decal.position = vec3(random_position(random_engine), random_position(random_engine), random_position(random_engine));
+		decal.normal = normalize(vec3(random_normal(random_engine), random_normal(random_engine), random_normal(random_engine)) + vec3(0.0f, 0.0f, 1e-3f));
+
+		BoundingOrientedBox box;
+		box.Center = decal.position;
+		box.Extents = vec3(random_size(random_engine), random_size(random_engine), random_size(random_engine));
+		box.Orientation = decal.get_orientation();
+		bounds.add(box);
+	}
+
+	//相机位于原点、朝向-z时的近平面包围盒
+	BoundingOrientedBox nearClipBox;
+	nearClipBox.Center = vec3(0.0f, 0.0f, -NEARZ);
+	nearClipBox.Extents = vec3(0.08f, 0.05f, 0.01f);
+	nearClipBox.Orientation = mat3(1.0f);
+	#pragma endregion
+
+	#pragma region 标量参考结果
+	vector<uint8_t> reference(n_boxes);
+	auto start_time = chrono::high_resolution_clock::now();
+	for (uint32_t iteration = 0; iteration < n_iterations; ++iteration)
+	{
+		for (uint32_t n = 0; n < n_boxes; ++n)
+		{
+			reference[n] = Engine::Intersects(nearClipBox, bounds.get(n)) ? 1 : 0;
+		}
+	}
+	double reference_time = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start_time).count();
+	cout << "DecalBounds benchmark: " << n_boxes << " decals, " << n_iterations << " iterations" << endl;
+	cout << "  Engine::Intersects: " << reference_time / (double(n_boxes) * n_iterations) << " ns/decal" << endl;
+	#pragma endregion
+
+	#pragma region 各SIMD级别
+	const char* level_names[] = { "scalar", "SSE", "AVX" };
+	uint32_t n_mismatches = 0;
+	vector<uint8_t> results(n_boxes);
+	for (int level = int(SimdLevel::SCALAR); level <= int(bounds.get_max_simd_level()); ++level)
+	{
+		bounds.set_simd_level(SimdLevel(level));
+
+		start_time = chrono::high_resolution_clock::now();
+		for (uint32_t iteration = 0; iteration < n_iterations; ++iteration)
+		{
+			bounds.intersects(nearClipBox, results.data());
+		}
+		double time = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start_time).count();
+
+		uint32_t level_mismatches = 0;
+		for (uint32_t n = 0; n < n_boxes; ++n)
+		{
+			level_mismatches += results[n] != reference[n] ? 1 : 0;
+		}
+		n_mismatches += level_mismatches;
+
+		cout << "  " << level_names[level] << ": " << time / (double(n_boxes) * n_iterations) << " ns/decal, "
+			<< reference_time / time << "x, " << level_mismatches << " mismatches" << endl;
+	}
+	#pragma endregion
+
+	return n_mismatches;
+}
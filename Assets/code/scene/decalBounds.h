@@ -0,0 +1,46 @@
+#pragma once
+#include "stdafx.h"
+
+//SIMD指令集级别，运行时根据CPU支持情况选择
+enum class SimdLevel
+{
+	SCALAR,
+	SSE,//4路
+	AVX,//8路
+};
+
+//贴花包围盒的SoA存储：中心、半长、方向矩阵的每个分量各占一个数组，
+//长度补齐到8的倍数，供SIMD一次对4/8个贴花做与近平面包围盒的分离轴测试
+class DecalBounds
+{
+public:
+	static const uint32_t LANES = 8;
+
+	DecalBounds();
+	void add(const BoundingOrientedBox& box);
+	void reserve(uint32_t n);//预先分配n个包围盒的空间，批量add时避免反复扩容
+	void set(uint32_t n, const BoundingOrientedBox& box);//替换已有的第n个包围盒
+	void clear();
+	BoundingOrientedBox get(uint32_t n);
+	uint32_t get_size();
+
+	SimdLevel get_simd_level();
+	SimdLevel get_max_simd_level();
+	void set_simd_level(SimdLevel level);//超过CPU支持的级别时取最高支持级别
+
+	//对全部贴花与box做OBB分离轴测试，results[i]为1表示相交；结果与Engine::Intersects逐位一致
+	void intersects(const BoundingOrientedBox& box, uint8_t* results);
+
+	//微基准：随机生成n_boxes个贴花，对比各级别耗时并校验与标量结果一致，返回不一致的数量
+	static uint32_t benchmark(uint32_t n_boxes, uint32_t n_iterations = 100);
+
+private:
+	uint32_t m_size;
+	vector<float> m_center[3];
+	vector<float> m_extents[3];
+	vector<float> m_orientation[9];//按列存放：[列 * 3 + 行]
+	SimdLevel m_simd_level;
+	SimdLevel m_max_simd_level;
+
+	static SimdLevel detect_simd_level();
+};
@@ -0,0 +1,223 @@
+#include "stdafx.h"
+#include "decalSnapshot.h"
+#include "decalStore.h"
+
+bool DecalSnapshot::save(const string& path, const Decal* decals, const DecalTransform* transforms, uint32_t n_decals)
+{
+	DecalSnapshotHeader header = {};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.record_size = sizeof(Decal);
+	header.n_decals = n_decals;
+	header.data_offset = Utils::round_up(static_cast<uint64_t>(sizeof(DecalSnapshotHeader)), static_cast<uint64_t>(DATA_ALIGNMENT));
+	header.transform_offset = Utils::round_up(header.data_offset + uint64_t(sizeof(Decal)) * n_decals, static_cast<uint64_t>(DATA_ALIGNMENT));
+	header.transform_record_size = sizeof(DecalTransform);
+
+	FILE* file = nullptr;
+	if (fopen_s(&file, path.data(), "wb") != 0 || file == nullptr)
+	{
+		return false;
+	}
+
+	const uint8_t padding[DATA_ALIGNMENT] = {};
+	bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+	result = result && fwrite(padding, 1, header.data_offset - sizeof(header), file) == header.data_offset - sizeof(header);
+
+	//Decal的对齐填充未初始化，逐字段拷贝到清零的记录中分批写出，文件内容只由贴花数据决定
+	const uint32_t n_batch_decals = 1024;
+	vector<uint8_t> batch(sizeof(Decal) * std::min(n_decals, n_batch_decals));
+	for (uint32_t first = 0; first < n_decals && result; first += n_batch_decals)
+	{
+		const uint32_t n_records = std::min(n_decals - first, n_batch_decals);
+		memset(batch.data(), 0, sizeof(Decal) * n_records);
+		for (uint32_t n = 0; n < n_records; n++)
+		{
+			const Decal& decal = decals[first + n];
+			Decal* record = reinterpret_cast<Decal*>(batch.data()) + n;
+			record->position = decal.position;
+			record->normal = decal.normal;
+			record->size = decal.size;
+			record->rotation = decal.rotation;
+			record->angle_fade = decal.angle_fade;
+			record->intensity = decal.intensity;
+			record->albedo = decal.albedo;
+			record->layer = decal.layer;
+			record->world_to_uvw = decal.world_to_uvw;
+		}
+		result = fwrite(batch.data(), sizeof(Decal), n_records, file) == n_records;
+	}
+
+	//DecalTransform只由float组成，没有填充，直接写出
+	const uint64_t transform_padding = header.transform_offset - header.data_offset - uint64_t(sizeof(Decal)) * n_decals;
+	result = result && fwrite(padding, 1, size_t(transform_padding), file) == transform_padding;
+	result = result && (n_decals == 0 || fwrite(transforms, sizeof(DecalTransform), n_decals, file) == n_decals);
+	result = fclose(file) == 0 && result;
+
+	return result;
+}
+
+DecalSnapshot::DecalSnapshot()
+	:m_file(INVALID_HANDLE_VALUE),
+	 m_mapping(nullptr),
+	 m_data(nullptr),
+	 m_read_data(nullptr),
+	 m_data_size(0)
+{
+}
+
+bool DecalSnapshot::open(const string& path)
+{
+	close();
+	if (!open_mapped(path) && !open_read(path))
+	{
+		return false;
+	}
+
+	if (!validate())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool DecalSnapshot::open_mapped(const string& path)
+{
+	m_file = CreateFileA(path.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(m_file, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	m_data_size = static_cast<size_t>(file_size.QuadPart);
+
+	return true;
+}
+
+bool DecalSnapshot::open_read(const string& path)
+{
+	if (!Anvil::IO::read_file(path, false, &m_read_data, &m_data_size))
+	{
+		m_read_data = nullptr;
+		m_data_size = 0;
+		return false;
+	}
+
+	m_data = m_read_data;
+	return true;
+}
+
+bool DecalSnapshot::validate()
+{
+	if (m_data_size < sizeof(DecalSnapshotHeader))
+	{
+		return false;
+	}
+
+	const DecalSnapshotHeader* header = reinterpret_cast<const DecalSnapshotHeader*>(m_data);
+	if (header->magic != MAGIC)
+	{
+		return false;
+	}
+	//旧版本的记录布局与当前Decal不同，不做转换，明确拒绝
+	if (header->version != VERSION || header->record_size != sizeof(Decal) || header->transform_record_size != sizeof(DecalTransform))
+	{
+		cout << "DecalSnapshot: version " << header->version << " with " << header->record_size << "-byte records is not supported (expected version "
+			<< VERSION << ", " << sizeof(Decal) << " bytes)" << endl;
+		return false;
+	}
+
+	//记录需按Decal的对齐要求存放，映射视图按页对齐，read_file的结果由new分配，偏移对齐即可
+	if (header->data_offset < sizeof(DecalSnapshotHeader) || header->data_offset > m_data_size || header->data_offset % alignof(Decal) != 0)
+	{
+		return false;
+	}
+
+	//先确认偏移在文件内，再用剩余字节数比较，data_offset + n_decals * sizeof(Decal)可能溢出
+	if (header->n_decals > (m_data_size - header->data_offset) / sizeof(Decal))
+	{
+		return false;
+	}
+
+	//变换数组位于贴花数组之后，同样先比较偏移再比较剩余字节数
+	if (header->transform_offset < header->data_offset + uint64_t(header->n_decals) * sizeof(Decal) ||
+		header->transform_offset > m_data_size ||
+		header->transform_offset % alignof(DecalTransform) != 0)
+	{
+		return false;
+	}
+	return header->n_decals <= (m_data_size - header->transform_offset) / sizeof(DecalTransform);
+}
+
+void DecalSnapshot::close()
+{
+	if (m_read_data != nullptr)
+	{
+		delete[] m_read_data;
+		m_read_data = nullptr;
+	}
+	else if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	m_data = nullptr;
+	m_data_size = 0;
+
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+}
+
+const Decal* DecalSnapshot::get_decals()
+{
+	const DecalSnapshotHeader* header = reinterpret_cast<const DecalSnapshotHeader*>(m_data);
+	return reinterpret_cast<const Decal*>(m_data + header->data_offset);
+}
+
+const DecalTransform* DecalSnapshot::get_transforms()
+{
+	const DecalSnapshotHeader* header = reinterpret_cast<const DecalSnapshotHeader*>(m_data);
+	return reinterpret_cast<const DecalTransform*>(m_data + header->transform_offset);
+}
+
+uint32_t DecalSnapshot::get_size()
+{
+	return m_data != nullptr ? reinterpret_cast<const DecalSnapshotHeader*>(m_data)->n_decals : 0;
+}
+
+bool DecalSnapshot::is_mapped()
+{
+	return m_data != nullptr && m_read_data == nullptr;
+}
+
+DecalSnapshot::~DecalSnapshot()
+{
+	close();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "stdafx.h"
+
+struct DecalTransform;
+
+//贴花快照文件头：文件为小端序(x86/x64本机字节序)，文件头后紧跟按DATA_ALIGNMENT对齐的Decal数组，
+//每条记录与GPU贴花缓冲的std430布局完全一致；其后是同样对齐的DecalTransform数组，即放置时缓存的派生数据。
+//加载时两段都整段拷贝，不逐个解析，也不重新计算变换
+struct DecalSnapshotHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;//sizeof(Decal)，布局改变后旧文件被拒绝
+	uint32_t n_decals;
+	uint64_t data_offset;//Decal数组相对文件开头的偏移
+	uint64_t transform_offset;//DecalTransform数组相对文件开头的偏移
+	uint32_t transform_record_size;//sizeof(DecalTransform)
+	uint8_t reserved[28];
+};
+static_assert(sizeof(DecalSnapshotHeader) == 64, "DecalSnapshotHeader must stay 64 bytes");
+
+//贴花快照：保存时一次写出全部贴花；读取时优先内存映射文件，失败时退回Anvil::IO::read_file整读
+class DecalSnapshot
+{
+public:
+	static const uint32_t MAGIC = 0x4C434544;//"DECL"
+	//1：初始布局；2：Decal增加world_to_uvw，记录变长；3：增加DecalTransform数组。旧版本的文件不再能读取
+	static const uint32_t VERSION = 3;
+	static const uint32_t DATA_ALIGNMENT = 64;
+
+	static bool save(const string& path, const Decal* decals, const DecalTransform* transforms, uint32_t n_decals);
+
+	DecalSnapshot();
+	bool open(const string& path);
+	void close();
+	const Decal* get_decals();//指向映射的文件内容，close之前有效
+	const DecalTransform* get_transforms();
+	uint32_t get_size();
+	bool is_mapped();//false表示使用了read_file的后备路径
+
+	~DecalSnapshot();
+
+private:
+	HANDLE m_file;
+	HANDLE m_mapping;
+	const char* m_data;//映射视图或read_file的结果
+	char* m_read_data;//read_file分配的内存，映射时为nullptr
+	size_t m_data_size;
+
+	bool open_mapped(const string& path);
+	bool open_read(const string& path);
+	bool validate();
+};
@@ -0,0 +1,502 @@
+#include "stdafx.h"
+#include "decalStore.h"
+#include <algorithm>
+#include <random>
+#include <chrono>
+
+DecalStore::DecalStore(uint32_t chunk_size, uint32_t max_decals, EvictionPolicy policy)
+	:m_chunk_size(chunk_size),
+	 m_capacity(0),
+	 m_max_decals(max_decals),
+	 m_n_placed(0),
+	 m_generation(0),
+	 m_frame(0),
+	 m_camera_pos(0.0f),
+	 m_policy(policy),
+	 m_buffer_size(0),
+	 m_farthest_heap_frame(UINT64_MAX)
+{
+	m_stats.live = 0;
+	m_stats.visible = 0;
+	m_stats.evicted = 0;
+	m_stats.total_evicted = 0;
+
+	//先分配一块，保证描述符集初始化时缓冲已存在
+	reserve(m_chunk_size, nullptr);
+}
+
+bool DecalStore::add(const Decal& decal, Queue* queue_ptr)
+{
+	m_generation++;
+	const DecalTransform transform = build_transform(decal);
+	//世界空间 -> UVW的3x4矩阵随贴花一起上传，deferred.comp不再逐像素重建
+	Decal placed = decal;
+	placed.world_to_uvw = mat3x4(transpose(transform.world_to_decal));
+
+	BoundingOrientedBox box;
+	box.Center = decal.position;
+	box.Extents = decal.size;
+	box.Orientation = transform.orientation;
+
+	if (m_decals.size() >= m_max_decals)
+	{
+		//达到上限，按淘汰策略选出一个贴花，新贴花原地替换它，其余槽位不动；
+		//该槽位仍被未完成的帧读取，不从主机端直接写入，记录下来由调用方在下一次提交的指令中写入
+		const uint32_t n = select_victim();
+		m_decals[n] = placed;
+		m_transforms[n] = transform;
+		m_placed_order[n] = m_n_placed++;
+		m_last_visible_frame[n] = m_frame;//刚放置的贴花视为可见，避免马上被淘汰
+		m_bounds.set(n, box);
+		if (m_policy != EvictionPolicy::FARTHEST)
+		{
+			m_victim_order.insert(get_victim_key(n));
+		}
+		m_stats.evicted++;
+		m_stats.total_evicted++;
+
+		m_pending_writes.push_back(n);
+		return false;
+	}
+
+	bool grown = false;
+	m_decals.push_back(placed);
+	m_transforms.push_back(transform);
+	m_placed_order.push_back(m_n_placed++);
+	m_last_visible_frame.push_back(m_frame);
+	m_bounds.add(box);
+	if (m_policy != EvictionPolicy::FARTHEST)
+	{
+		m_victim_order.insert(get_victim_key(static_cast<uint32_t>(m_decals.size() - 1)));
+	}
+	m_stats.live = static_cast<uint32_t>(m_decals.size());
+
+	if (m_decals.size() > m_capacity)
+	{
+		//容量不足，整块增长后重新上传全部贴花
+		reserve(m_capacity + m_chunk_size, queue_ptr);
+		grown = true;
+	}
+	else
+	{
+		//只写入新贴花所在的槽位
+		write(static_cast<uint32_t>(m_decals.size() - 1), queue_ptr);
+	}
+
+	return grown;
+}
+
+bool DecalStore::will_grow()
+{
+	return m_decals.size() < m_max_decals && m_decals.size() >= m_capacity;
+}
+
+bool DecalStore::save(const string& path)
+{
+	return DecalSnapshot::save(path, m_decals.data(), m_transforms.data(), static_cast<uint32_t>(m_decals.size()));
+}
+
+bool DecalStore::load(const string& path, Queue* queue_ptr)
+{
+	DecalSnapshot snapshot;
+	if (!snapshot.open(path))
+	{
+		return false;
+	}
+
+	//上限由cluster位掩码的预算决定，超出上限的快照整个拒绝，当前贴花保持不变
+	const uint32_t n_decals = snapshot.get_size();
+	if (n_decals > m_max_decals)
+	{
+		cout << "DecalStore: snapshot " << path << " holds " << n_decals << " decals, more than the supported maximum of " << m_max_decals << endl;
+		return false;
+	}
+
+	//记录与GPU布局一致，整段拷贝后由reserve一次写入新缓冲；变换也随快照保存，不再逐个计算
+	m_decals.assign(snapshot.get_decals(), snapshot.get_decals() + n_decals);
+	m_transforms.assign(snapshot.get_transforms(), snapshot.get_transforms() + n_decals);
+	snapshot.close();
+	const uint32_t capacity = std::max(m_chunk_size, (n_decals + m_chunk_size - 1) / m_chunk_size * m_chunk_size);
+
+	//加载仍是O(N)的CPU工作：除两次整段拷贝外，还要按加载顺序填写放置序号与包围盒SoA，
+	//包围盒直接取缓存的方向矩阵，不做三角函数运算
+	m_placed_order.resize(n_decals);
+	m_last_visible_frame.assign(n_decals, m_frame);
+	m_bounds.clear();
+	m_bounds.reserve(n_decals);
+	for (uint32_t n = 0; n < n_decals; n++)
+	{
+		m_placed_order[n] = n;
+
+		BoundingOrientedBox box;
+		box.Center = m_decals[n].position;
+		box.Extents = m_decals[n].size;
+		box.Orientation = m_transforms[n].orientation;
+		m_bounds.add(box);
+	}
+	m_n_placed = n_decals;
+	m_stats.live = n_decals;
+	m_generation++;
+	rebuild_victim_order();
+
+	reserve(capacity, queue_ptr);
+	return true;
+}
+
+void DecalStore::write(uint32_t n, Queue* queue_ptr)
+{
+	m_buffer_ptr->write(
+		sizeof(Decal) * n, /* start_offset */
+		sizeof(Decal),
+		&m_decals[n],
+		queue_ptr);
+}
+
+uint32_t DecalStore::select_victim()
+{
+	if (m_policy == EvictionPolicy::FARTHEST)
+	{
+		//相机每帧移动，距离顺序只在本帧内有效；一帧内连续淘汰时只建一次堆，
+		//本帧新放置的贴花不入堆，不会被同一帧的后续放置替换
+		if (m_farthest_heap_frame != m_frame || m_farthest_heap.empty())
+		{
+			m_farthest_heap.resize(m_decals.size());
+			for (uint32_t n = 0; n < m_decals.size(); n++)
+			{
+				const vec3 d = m_decals[n].position - m_camera_pos;
+				m_farthest_heap[n] = make_pair(dot(d, d), n);
+			}
+			make_heap(m_farthest_heap.begin(), m_farthest_heap.end());
+			m_farthest_heap_frame = m_frame;
+		}
+		pop_heap(m_farthest_heap.begin(), m_farthest_heap.end());
+		const uint32_t victim = m_farthest_heap.back().second;
+		m_farthest_heap.pop_back();
+		return victim;
+	}
+
+	//最早放置的，或最久未可见的(相同时取更早放置的)，都是有序集合的首元素
+	const uint32_t victim = std::get<2>(*m_victim_order.begin());
+	m_victim_order.erase(m_victim_order.begin());
+	return victim;
+}
+
+tuple<uint64_t, uint64_t, uint32_t> DecalStore::get_victim_key(uint32_t n)
+{
+	const uint64_t last_visible = m_policy == EvictionPolicy::LEAST_RECENTLY_VISIBLE ? m_last_visible_frame[n] : 0;
+	return make_tuple(last_visible, m_placed_order[n], n);
+}
+
+void DecalStore::rebuild_victim_order()
+{
+	m_victim_order.clear();
+	m_farthest_heap.clear();
+	m_farthest_heap_frame = UINT64_MAX;
+	if (m_policy == EvictionPolicy::FARTHEST)
+	{
+		return;
+	}
+	for (uint32_t n = 0; n < m_decals.size(); n++)
+	{
+		m_victim_order.insert(get_victim_key(n));
+	}
+}
+
+void DecalStore::update_visibility(const mat4& view_proj, const vec3& camera_pos, uint64_t frame)
+{
+	m_frame = frame;
+	m_camera_pos = camera_pos;
+	m_stats.live = static_cast<uint32_t>(m_decals.size());
+	m_stats.visible = 0;
+	m_stats.evicted = 0;
+	if (m_policy != EvictionPolicy::LEAST_RECENTLY_VISIBLE)
+	{
+		return;
+	}
+
+	//从view_proj提取6个裁剪平面(Gribb-Hartmann)，vulkan深度范围为[0,1]，近平面只取第三行
+	vec4 planes[6];
+	const mat4 m = transpose(view_proj);//m[i]为view_proj的第i行
+	planes[0] = m[3] + m[0];
+	planes[1] = m[3] - m[0];
+	planes[2] = m[3] + m[1];
+	planes[3] = m[3] - m[1];
+	planes[4] = m[2];
+	planes[5] = m[3] - m[2];
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		planes[i] /= length(vec3(planes[i]));
+	}
+
+	//以贴花盒的外接球做测试，半径为半长向量的长度
+	for (uint32_t n = 0; n < m_decals.size(); n++)
+	{
+		const vec3& center = m_decals[n].position;
+		const float radius = length(m_decals[n].size);
+		bool visible = true;
+		for (uint32_t i = 0; i < 6 && visible; i++)
+		{
+			visible = dot(vec3(planes[i]), center) + planes[i].w > -radius;
+		}
+
+		if (visible)
+		{
+			//可见帧变化时在淘汰顺序中移到对应位置，已可见的贴花每帧只移动一次
+			if (m_last_visible_frame[n] != frame)
+			{
+				m_victim_order.erase(get_victim_key(n));
+				m_last_visible_frame[n] = frame;
+				m_victim_order.insert(get_victim_key(n));
+			}
+			m_stats.visible++;
+		}
+	}
+}
+
+EvictionPolicy DecalStore::get_eviction_policy()
+{
+	return m_policy;
+}
+
+void DecalStore::set_eviction_policy(EvictionPolicy policy)
+{
+	if (policy == m_policy)
+	{
+		return;
+	}
+	m_policy = policy;
+	rebuild_victim_order();
+}
+
+const char* DecalStore::get_eviction_policy_name(EvictionPolicy policy)
+{
+	switch (policy)
+	{
+	case EvictionPolicy::OLDEST:
+		return "oldest";
+	case EvictionPolicy::LEAST_RECENTLY_VISIBLE:
+		return "least recently visible";
+	case EvictionPolicy::FARTHEST:
+		return "farthest";
+	default:
+		return "unknown";
+	}
+}
+
+const DecalStoreStats& DecalStore::get_stats()
+{
+	return m_stats;
+}
+
+void DecalStore::reserve(uint32_t capacity, Queue* queue_ptr)
+{
+	auto allocator_ptr = MemoryAllocator::create_oneshot(Engine::Instance()->getDevice());
+
+	m_capacity = capacity;
+	m_buffer_size = sizeof(Decal) * m_capacity;
+
+	auto create_info_ptr = BufferCreateInfo::create_no_alloc(
+		Engine::Instance()->getDevice(),
+		m_buffer_size,
+		QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
+		SharingMode::EXCLUSIVE,
+		BufferCreateFlagBits::NONE,
+		BufferUsageFlagBits::STORAGE_BUFFER_BIT | BufferUsageFlagBits::TRANSFER_DST_BIT);
+	m_buffer_ptr = Buffer::create(move(create_info_ptr));
+	m_buffer_ptr->set_name_formatted("Decal storage buffer (capacity %d)", m_capacity);
+
+	//主机可见：放置贴花时直接写入新槽位，不经过暂存缓冲和队列提交
+	allocator_ptr->add_buffer(
+		m_buffer_ptr.get(),
+		MemoryFeatureFlagBits::MAPPABLE_BIT | MemoryFeatureFlagBits::HOST_COHERENT_BIT); /* in_required_memory_features */
+
+	//新缓冲一次写入全部贴花，之前未写入的淘汰槽位也包含在内
+	m_pending_writes.clear();
+	if (!m_decals.empty())
+	{
+		m_buffer_ptr->write(
+			0, /* start_offset */
+			sizeof(Decal) * m_decals.size(),
+			m_decals.data(),
+			queue_ptr);
+	}
+}
+
+DecalTransform DecalStore::build_transform(const Decal& decal)
+{
+	const vec3 boxVerts[8] = { vec3(-1,  1, -1), vec3(1,  1, -1), vec3(-1,  1, 1), vec3(1,  1, 1),
+	                           vec3(-1, -1, -1), vec3(1, -1, -1), vec3(-1, -1, 1), vec3(1, -1, 1) };
+
+	DecalTransform transform;
+	transform.orientation = decal.get_orientation();
+
+	//贴花空间 -> 世界空间：缩放、绕z轴旋转、朝向、平移，与cluster.vert一致
+	const float c = cos(decal.rotation);
+	const float s = sin(decal.rotation);
+	const mat3 rotation(c, -s, 0,
+	                    s, c, 0,
+	                    0, 0, 1);
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		transform.corners[i] = transform.orientation * (rotation * (boxVerts[i] * decal.size)) + decal.position;
+	}
+
+	//世界空间 -> 贴花UVW空间，与deferred.comp中逐像素的计算一致
+	const vec3 inv_size = vec3(1.0f / decal.size.x, -1.0f / decal.size.y, 1.0f / decal.size.z);//y轴翻转
+	const mat3 world_to_local = transpose(rotation) * transpose(transform.orientation);
+	const mat3 world_to_uvw(inv_size * world_to_local[0], inv_size * world_to_local[1], inv_size * world_to_local[2]);
+	transform.world_to_decal = mat4(world_to_uvw);
+	transform.world_to_decal[3] = vec4(-(world_to_uvw * decal.position), 1.0f);
+
+	return transform;
+}
+
+uint32_t DecalStore::benchmark(uint32_t n_decals, uint32_t n_iterations)
+{
+	const string source_path = "decal_store_benchmark.bin";
+	const string round_trip_path = "decal_store_benchmark_round_trip.bin";
+	BaseDevice* device_ptr = Engine::Instance()->getDevice();
+	Queue* queue_ptr = device_ptr->get_universal_queue(0);
+	const uint32_t max_decals = std::max<uint32_t>(N_DECALS_PER_CHUNK, (n_decals + N_DECALS_PER_CHUNK - 1) / N_DECALS_PER_CHUNK * N_DECALS_PER_CHUNK);
+
+	#pragma region 随机生成贴花，按放置时的方式填写派生数据后写出快照
+	mt19937 random_engine(1234);
+	uniform_real_distribution<float> random_float(-2.0f, 2.0f);
+	vector<Decal> decals(n_decals);
+	vector<DecalTransform> transforms(n_decals);
+	memset(decals.data(), 0, sizeof(Decal) * n_decals);//填充位也清零，便于逐字节比较
+	for (uint32_t n = 0; n < n_decals; ++n)
+	{
+		decals[n].position = vec3(random_float(random_engine), random_float(random_engine), random_float(random_engine));
+		decals[n].normal = normalize(vec3(random_float(random_engine), random_float(random_engine), random_float(random_engine)) + vec3(0.0f, 0.0f, 1e-3f));
+		decals[n].size = abs(vec3(random_float(random_engine), random_float(random_engine), random_float(random_engine))) + vec3(1e-2f);
+		decals[n].rotation = random_float(random_engine);
+		decals[n].angle_fade = random_float(random_engine);
+		decals[n].intensity = random_float(random_engine);
+		decals[n].albedo = random_float(random_engine);
+		decals[n].layer = n % N_DECALS;
+		transforms[n] = build_transform(decals[n]);
+		decals[n].world_to_uvw = mat3x4(transpose(transforms[n].world_to_decal));
+	}
+
+	if (!DecalSnapshot::save(source_path, decals.data(), transforms.data(), n_decals))
+	{
+		cout << "DecalStore benchmark: failed to write " << source_path << endl;
+		return 1;
+	}
+	cout << "DecalStore benchmark: " << n_decals << " decals, " << n_iterations << " iterations" << endl;
+	#pragma endregion
+
+	#pragma region 加载：打开快照、整段拷贝、填写包围盒、重新创建并写入GPU缓冲，计时到设备空闲
+	DecalStore store(N_DECALS_PER_CHUNK, max_decals);
+	bool ok = true;
+	double load_time = 0.0;
+	for (uint32_t iteration = 0; iteration < n_iterations && ok; ++iteration)
+	{
+		auto start_time = chrono::high_resolution_clock::now();
+		ok = store.load(source_path, queue_ptr);
+		Vulkan::vkDeviceWaitIdle(device_ptr->get_device_vk());
+		load_time += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+	}
+	cout << "  load: " << load_time / std::max(n_iterations, 1u) << " ms" << (ok ? "" : ", failed") << endl;
+	#pragma endregion
+
+	#pragma region 往返：save写出后载入另一个仓库
+	auto start_time = chrono::high_resolution_clock::now();
+	ok = ok && store.save(round_trip_path);
+	const double save_time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+	cout << "  save: " << save_time << " ms" << (ok ? "" : ", failed") << endl;
+
+	DecalStore round_trip(N_DECALS_PER_CHUNK, max_decals);
+	ok = ok && round_trip.load(round_trip_path, queue_ptr) && round_trip.get_size() == n_decals;
+	#pragma endregion
+
+	#pragma region 校验：CPU端贴花与变换、GPU缓冲内容都与生成的数据逐字节一致
+	uint32_t n_mismatches = ok ? 0 : 1;
+	if (ok && n_decals > 0)
+	{
+		vector<Decal> uploaded(n_decals);
+		round_trip.get_buffer()->read(0, sizeof(Decal) * n_decals, uploaded.data(), queue_ptr);
+		for (uint32_t n = 0; n < n_decals; ++n)
+		{
+			if (memcmp(&round_trip.get(n), &decals[n], sizeof(Decal)) != 0 ||
+				memcmp(&round_trip.get_transform(n), &transforms[n], sizeof(DecalTransform)) != 0 ||
+				memcmp(&uploaded[n], &decals[n], sizeof(Decal)) != 0)
+			{
+				n_mismatches++;
+			}
+		}
+	}
+	cout << "  round trip: " << n_mismatches << " mismatches" << endl;
+	#pragma endregion
+
+	remove(source_path.data());
+	remove(round_trip_path.data());
+	return n_mismatches;
+}
+
+const Decal& DecalStore::get(uint32_t n)
+{
+	return m_decals[n];
+}
+
+const DecalTransform& DecalStore::get_transform(uint32_t n)
+{
+	return m_transforms[n];
+}
+
+uint32_t DecalStore::get_size()
+{
+	return static_cast<uint32_t>(m_decals.size());
+}
+
+uint32_t DecalStore::get_capacity()
+{
+	return m_capacity;
+}
+
+uint32_t DecalStore::get_max_decals()
+{
+	return m_max_decals;
+}
+
+void DecalStore::set_max_decals(uint32_t max_decals)
+{
+	//已放置的贴花不会因上限降低而丢失
+	m_max_decals = std::max(m_capacity, max_decals / m_chunk_size * m_chunk_size);
+}
+
+Buffer* DecalStore::get_buffer()
+{
+	return m_buffer_ptr.get();
+}
+
+VkDeviceSize DecalStore::get_buffer_size()
+{
+	return m_buffer_size;
+}
+
+DecalBounds* DecalStore::get_bounds()
+{
+	return &m_bounds;
+}
+
+uint64_t DecalStore::get_generation()
+{
+	return m_generation;
+}
+
+const vector<uint32_t>& DecalStore::get_pending_writes()
+{
+	return m_pending_writes;
+}
+
+void DecalStore::clear_pending_writes()
+{
+	m_pending_writes.clear();
+}
+
+DecalStore::~DecalStore()
+{
+	m_buffer_ptr.reset();
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "stdafx.h"
+#include <set>
+#include <tuple>
+#include "decalBounds.h"
+#include "decalSnapshot.h"
+
+//贴花放置后不再移动，放置时一次算好的变换数据，每帧只需做与视角相关的投影
+struct DecalTransform
+{
+	vec3 corners[8];//世界空间的8个角点
+	mat3 orientation;//贴花空间 -> 世界空间
+	mat4 world_to_decal;//世界空间 -> 贴花UVW空间([-1,1]^3，y轴已翻转，与deferred.comp一致)
+};
+
+//贴花数量达到上限后，新贴花替换掉哪一个
+enum class EvictionPolicy
+{
+	OLDEST = 0,//最早放置的
+	LEAST_RECENTLY_VISIBLE,//最久未出现在视野中的
+	FARTHEST,//离相机最远的
+	COUNT
+};
+
+struct DecalStoreStats
+{
+	uint32_t live;//已放置的贴花数
+	uint32_t visible;//本帧视锥内的贴花数，只在LEAST_RECENTLY_VISIBLE策略下统计
+	uint32_t evicted;//本帧被替换的贴花数
+	uint64_t total_evicted;
+};
+
+//贴花仓库：CPU端保存所有已放置的贴花，GPU端对应一块std430 storage缓冲，容量按块增长，
+//达到max_decals后按淘汰策略原地替换，被淘汰的槽位立即复用，缓冲中的贴花始终连续
+class DecalStore
+{
+public:
+	DecalStore(uint32_t chunk_size = N_DECALS_PER_CHUNK, uint32_t max_decals = N_MAX_DECALS, EvictionPolicy policy = DECAL_EVICTION_POLICY);
+	bool add(const Decal& decal, Queue* queue_ptr);//返回true表示容量增长，GPU缓冲已重新创建
+	bool will_grow();//下一次add是否会使容量增长
+	bool save(const string& path);
+	bool load(const string& path, Queue* queue_ptr);//替换全部贴花，容量按快照重新分配，GPU缓冲总是重新创建；贴花数超过上限时拒绝
+	const Decal& get(uint32_t n);
+	const DecalTransform& get_transform(uint32_t n);
+	uint32_t get_size();
+	uint32_t get_capacity();
+	uint32_t get_max_decals();
+	void set_max_decals(uint32_t max_decals);//按块向下取整，不低于已分配的容量
+	Buffer* get_buffer();
+	VkDeviceSize get_buffer_size();
+	DecalBounds* get_bounds();
+	uint64_t get_generation();//贴花集合每次变化(放置、替换、加载)后加一
+	const vector<uint32_t>& get_pending_writes();//被淘汰后原地替换、尚未写入GPU缓冲的槽位，由调用方在指令缓冲中写入
+	void clear_pending_writes();
+
+	//每帧调用一次，开始新一帧的统计；只有LEAST_RECENTLY_VISIBLE策略需要可见性，
+	//此时才做逐贴花的视锥剔除，其余策略不遍历贴花
+	void update_visibility(const mat4& view_proj, const vec3& camera_pos, uint64_t frame);
+	EvictionPolicy get_eviction_policy();
+	void set_eviction_policy(EvictionPolicy policy);
+	static const char* get_eviction_policy_name(EvictionPolicy policy);
+	const DecalStoreStats& get_stats();
+	static DecalTransform build_transform(const Decal& decal);//世界矩阵与8个角点，ClusterReference也用它还原贴花盒
+
+	//微基准：写出n_decals个随机贴花的快照，计时DecalStore::load(含GPU缓冲的创建与写入)与save，
+	//再经save/load往返一次，逐字节校验CPU端贴花、变换与GPU缓冲内容，返回不一致的数量；需要Engine已创建设备
+	static uint32_t benchmark(uint32_t n_decals, uint32_t n_iterations = 10);
+
+	~DecalStore();
+
+private:
+	uint32_t m_chunk_size;
+	uint32_t m_capacity;
+	uint32_t m_max_decals;
+	vector<Decal> m_decals;
+	vector<DecalTransform> m_transforms;
+	vector<uint64_t> m_placed_order;//放置序号，越小越早
+	vector<uint64_t> m_last_visible_frame;
+	uint64_t m_n_placed;
+	uint64_t m_generation;
+	uint64_t m_frame;
+	vec3 m_camera_pos;
+	EvictionPolicy m_policy;
+	DecalStoreStats m_stats;
+	vector<uint32_t> m_pending_writes;
+	BufferUniquePtr m_buffer_ptr;
+	VkDeviceSize m_buffer_size;
+	DecalBounds m_bounds;//与m_decals一一对应的包围盒SoA，供近平面相交测试
+	//OLDEST与LEAST_RECENTLY_VISIBLE策略的淘汰顺序，首元素即下一个被淘汰的槽位，键为(最近可见帧, 放置序号, 槽位)
+	set<tuple<uint64_t, uint64_t, uint32_t>> m_victim_order;
+	//FARTHEST策略按帧建立的(距离平方, 槽位)大顶堆，本帧第一次淘汰时建立，之后每次淘汰只出堆
+	vector<pair<float, uint32_t>> m_farthest_heap;
+	uint64_t m_farthest_heap_frame;
+
+	void reserve(uint32_t capacity, Queue* queue_ptr);
+	uint32_t select_victim();
+	tuple<uint64_t, uint64_t, uint32_t> get_victim_key(uint32_t n);
+	void rebuild_victim_order();
+	void write(uint32_t n, Queue* queue_ptr);
+};
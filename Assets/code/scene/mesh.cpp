@@ -10,7 +10,7 @@ void Mesh::load_mesh(const aiMesh* mesh, int i)
 {
 	auto allocator_ptr = MemoryAllocator::create_oneshot(Engine::Instance()->getDevice());
 
-	#pragma region ȡ
+	#pragma region 获取顶点数据
 	vector<Vertex> vertices;
 	for (int i = 0; i < mesh->mNumVertices; i++)
 	{
@@ -47,7 +47,7 @@ void Mesh::load_mesh(const aiMesh* mesh, int i)
 	}
 	#pragma endregion
 
-	#pragma region 㻺
+	#pragma region 创建顶点缓冲
 	VkDeviceSize vertex_buffer_size = sizeof(vertices[0]) * vertices.size();
 	auto vertex_buffer_create_info_ptr = BufferCreateInfo::create_no_alloc(
 		Engine::Instance()->getDevice(),
@@ -64,7 +64,7 @@ void Mesh::load_mesh(const aiMesh* mesh, int i)
 		MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
 	#pragma endregion
 
-	#pragma region ȡ
+	#pragma region 获取索引数据
 	vector<uint32_t> indices;
 	for (int i = 0; i < mesh->mNumFaces; i++)
 	{
@@ -77,7 +77,7 @@ void Mesh::load_mesh(const aiMesh* mesh, int i)
 	m_index_size = indices.size();
 	#pragma endregion
 
-	#pragma region 
+	#pragma region 创建索引缓冲
 	VkDeviceSize index_buffer_size = sizeof(indices[0]) * indices.size();
 	auto index_buffer_create_info_ptr = BufferCreateInfo::create_no_alloc(
 		Engine::Instance()->getDevice(),
@@ -94,7 +94,7 @@ void Mesh::load_mesh(const aiMesh* mesh, int i)
 		MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
 	#pragma endregion
 
-	#pragma region д뻺
+	#pragma region 写入缓冲数据
 	m_vertex_buffer_ptr->write(
 		0, /* start_offset */
 		vertex_buffer_size,
@@ -12,7 +12,7 @@ Model::~Model()
 
 void Model::load_model(string const& path)
 {
-	//ļжȡ
+	//从文件中读取数据
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path, 0);
 	uint32 flags = 
@@ -34,19 +34,10 @@ void Model::load_model(string const& path)
 	}
 	m_directory = path.substr(0, path.find_last_of('/'));
 
-	//
-	string decal_path("Assets/decals");
-	char decal_str[128];
-	for (unsigned int i = 0; i < N_DECALS; i++)
-	{
-		sprintf_s(decal_str, "BrickDamageDecal%02d.png", i + 1);
-		m_textures.push_back(make_shared<Texture>(decal_str, decal_path, m_textures.size()));
-
-		sprintf_s(decal_str, "BrickDamageDecal%02d_NM.png", i + 1);
-		m_textures.push_back(make_shared<Texture>(decal_str, decal_path, m_textures.size()));
-	}
+	//加载贴花：打包为纹理数组，贴花用层索引引用，材质纹理的描述符索引从0开始
+	m_decal_atlas = make_shared<DecalAtlas>("Assets/decals", N_DECALS);
 
-	//ز
+	//加载材质
 	for (unsigned int i = 0; i < scene->mNumMaterials; i++)
 	{
 		m_materials.push_back(make_shared<Material>(i));
@@ -59,7 +50,7 @@ void Model::load_model(string const& path)
 
 
 
-	//
+	//加载网格
 	for (int i = 0; i < scene->mNumMeshes; i++)
 	{
 		m_meshes.push_back(make_shared<Mesh>(scene->mMeshes[i], i));
@@ -70,9 +61,9 @@ void Model::load_model(string const& path)
 
 shared_ptr<Texture> Model::load_texture_for_material(aiMaterial* mat, aiTextureType type, unsigned int id)
 {
-	//ȡͼļ·
+	//获取该贴图的文件路径
 	aiString str;
-	if (type == aiTextureType_SHININESS)//ģԭassimp޷ȡ
+	if (type == aiTextureType_SHININESS)//模型原因，assimp无法读取？
 	{
 		static const char* SponzaRoughnessMaps[] = {
 			"Sponza_Thorn_roughness.png",
@@ -126,7 +117,7 @@ shared_ptr<Texture> Model::load_texture_for_material(aiMaterial* mat, aiTextureT
 		}
 	}
 
-	//ǷѾأѼȶļ·
+	//检查该纹理是否已经加载（与已加载纹理比对文件路径）
 	for (int i = 0; i < m_textures.size(); i++)
 	{
 		if (strcmp(m_textures[i]->get_path(), str.C_Str()) == 0)
@@ -135,7 +126,7 @@ shared_ptr<Texture> Model::load_texture_for_material(aiMaterial* mat, aiTextureT
 		}
 	}
 	
-	//δأȴ
+	//未加载，先创建该纹理
 	m_textures.push_back(make_shared<Texture>(str.C_Str(), this->m_directory, m_textures.size()));
 	return m_textures.back();
 }
@@ -185,7 +176,7 @@ void Model::draw(PrimaryCommandBuffer* cmd_buffer_ptr)
 	}
 }
 
-vec2 Model::get_texture_size(uint n)
+DecalAtlas* Model::get_decal_atlas()
 {
-	return m_textures[n]->getSize();
+	return m_decal_atlas.get();
 }
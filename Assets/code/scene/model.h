@@ -2,6 +2,7 @@
 #include "stdafx.h"
 #include "mesh.h"
 #include "texture.h"
+#include "decalAtlas.h"
 
 class Model
 {
@@ -13,15 +14,16 @@ public:
 	void init_texture_indices();
 	vector<TextureIndicesUniform>* get_texture_indices();
 	void draw(PrimaryCommandBuffer* cmd_buffer_ptr);
-	vec2 get_texture_size(uint n);
+	DecalAtlas* get_decal_atlas();
 
 	~Model();
 
 private:
-	string m_directory;//ģļ·
-	vector<shared_ptr<Mesh>> m_meshes;//񣨰㡢ָ룩
-	vector<shared_ptr<Material>> m_materials;//вʣָ룩
-	vector<shared_ptr<Texture>> m_textures;//
+	string m_directory;//模型文件路径
+	vector<shared_ptr<Mesh>> m_meshes;//所有网格（包含顶点、索引、材质指针）数据
+	vector<shared_ptr<Material>> m_materials;//所有材质（包含纹理指针）数据
+	vector<shared_ptr<Texture>> m_textures;//所有材质纹理
+	shared_ptr<DecalAtlas> m_decal_atlas;//贴花纹理数组
 	vector<TextureIndicesUniform> m_texture_indices_uniform_data;
 
 	void load_model(string const& path);
@@ -16,7 +16,7 @@ void Texture::load_texture(string path)
 {
 	auto allocator_ptr = MemoryAllocator::create_oneshot(Engine::Instance()->getDevice());
 
-	#pragma region ļȡͼ
+	#pragma region 从文件获取纹理图像数据
 	int texChannels;
 	stbi_uc* pixels = stbi_load(path.data(), &m_width, &m_height, &texChannels, STBI_rgb_alpha);
 	/*m_mipLevels = static_cast<uint32_t>(
@@ -27,7 +27,7 @@ void Texture::load_texture(string path)
 	}
 	#pragma endregion
 
-	#pragma region mipmapݣѹرգ
+	#pragma region 生成mipmap数据（已关闭）
 	/*vector<Anvil::MipmapRawData> mipmapRawDatas(m_mipLevels);
 	vector<stbi_uc*> mipPixels(m_mipLevels);
 	int32_t mipWidth = texWidth;
@@ -68,7 +68,7 @@ void Texture::load_texture(string path)
 	}*/
 	#pragma endregion
 
-	#pragma region ͼ
+	#pragma region 创建纹理图像
 	vector<Anvil::MipmapRawData> mipmapRawDatas(1);
 	mipmapRawDatas[0] = MipmapRawData::create_2D_from_uchar_ptr(
 		ImageAspectFlagBits::COLOR_BIT,
@@ -103,7 +103,7 @@ void Texture::load_texture(string path)
 		MemoryFeatureFlagBits::NONE);
 	#pragma endregion
 
-	#pragma region ͼͼ
+	#pragma region 创建纹理图像视图
 	auto image_view_create_info_ptr = ImageViewCreateInfo::create_2D(
 		Engine::Instance()->getDevice(),
 		m_texture_image_ptr.get(),
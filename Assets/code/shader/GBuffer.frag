@@ -22,7 +22,7 @@ layout(location = 4) out uint outMaterialID;
 
 vec4 QuatFrom3x3(mat3 m)
 {
-	//̽Ԫ 
+	//探测四元数中最大的项 
 	float fourWSquaredMinusl = m[0][0]+m[1][1]+m[2][2];
 	float fourXSquaredMinusl = m[0][0]-m[1][1]-m[2][2];
 	float fourYSquaredMinusl = m[1][1]-m[0][0]-m[2][2];
@@ -43,11 +43,11 @@ vec4 QuatFrom3x3(mat3 m)
 		biggestIndex =3;
 	} 
 
-	//ƽͳ 
+	//计算平方根和除法 
 	float biggestVal = sqrt(fourBiggestSqureMinus1+1.0f)*0.5f;
 	float mult = 0.25f/biggestVal;
 
-	//Ԫֵ
+	//计算四元数的值
 	vec4 q;
 	switch(biggestIndex){
 		case 0:
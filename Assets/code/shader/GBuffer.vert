@@ -21,18 +21,18 @@ layout(location = 3) out vec2 outTexCoord;
 
 void main() 
 {
-	// üռλ
+	// 裁剪空间位置
 	gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPosition, 1.0);
 
-	// ռ䷨
+	// 世界空间法线
 	outWorldNormal = normalize(mvp.model * vec4(inNormal, 0.0f)).xyz;
 
-	// ռ
+	// 世界空间切线
 	outWorldTangent = normalize(mvp.model * vec4(inTangent, 0.0f)).xyz;
 	
-	// ռ丱
+	// 世界空间副切线
 	outWorldBitangent = normalize(mvp.model * vec4(inBitangent, 0.0f)).xyz;
 
-	// 
+	// 纹理坐标
 	outTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -1,16 +1,21 @@
 #version 450
+#ifdef USE_SUBGROUP_ATOMICS
+#extension GL_KHR_shader_subgroup_ballot : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
 
-layout( constant_id = 0 ) const int MAX_CLUSTER_NUM = 64;
-layout( constant_id = 1 ) const float NEAR_CLIP = 0.1;
-layout( constant_id = 2 ) const float FAR_CLIP = 35.0;
-layout( constant_id = 3 ) const uint NUM_X_TILES = 64;
-layout( constant_id = 4 ) const uint NUM_Y_TILES = 64;
-layout( constant_id = 5 ) const uint NUM_Z_TILES = 16;
-layout( constant_id = 6 ) const uint ELEMENTS_PER_CLUSTER = 2;
-layout( constant_id = 7 ) const uint TILE_SIZE = 16;
 layout( constant_id = 8 ) const uint MODE = 0;
 
-//const int MAX_CLUSTER_NUM = 64;
+//cluster相关着色器共用的特化常量，由Engine::add_cluster_specialization_constants统一设置
+layout( constant_id = 16 ) const float NEAR_CLIP = 0.1;
+layout( constant_id = 17 ) const float FAR_CLIP = 35.0;
+layout( constant_id = 18 ) const uint NUM_X_TILES = 64;
+layout( constant_id = 19 ) const uint NUM_Y_TILES = 64;
+layout( constant_id = 20 ) const uint NUM_Z_TILES = 16;
+layout( constant_id = 21 ) const uint ELEMENTS_PER_CLUSTER = 2;
+layout( constant_id = 22 ) const uint TILE_SIZE = 16;
+layout( constant_id = 23 ) const uint Z_SLICING = 1;//0 线性，1 指数
+
 //const float NEAR_CLIP = 0.1;
 //const float FAR_CLIP = 35.0;
 //const uint NUM_X_TILES = 64;
@@ -19,18 +24,54 @@ layout( constant_id = 8 ) const uint MODE = 0;
 //const uint ELEMENTS_PER_CLUSTER = 2;
 //const uint MODE = 0;
 
-layout(set = 2, binding = 1) buffer BoundUniform
+layout(std430, set = 2, binding = 1) readonly buffer BoundUniform
 {
-	uvec2 zBounds[MAX_CLUSTER_NUM];
+	uvec2 zBounds[];
 }boundUniform;
 
-layout(set = 3, binding = 0) buffer Cluster
+layout(std430, set = 3, binding = 0) buffer Cluster
 {
-	uint data[ELEMENTS_PER_CLUSTER * NUM_X_TILES * NUM_Y_TILES * NUM_Z_TILES];
+	uint data[];
 }cluster;
 
 layout(location = 0) flat in uint inDecalIndex;
 
+//-------------------------------------------------------------------------------------------------
+// Maps a positive view-space depth to [0,1] slice space, same as ClusterConstants::get_normalized_slice_depth
+//-------------------------------------------------------------------------------------------------
+float NormalizedSliceDepth(float viewDepth)
+{
+	if(Z_SLICING == 1)
+	{
+		return clamp(log(max(viewDepth, NEAR_CLIP) / NEAR_CLIP) / log(FAR_CLIP / NEAR_CLIP), 0.0f, 1.0f);
+	}
+	return clamp((viewDepth - NEAR_CLIP) / (FAR_CLIP - NEAR_CLIP), 0.0f, 1.0f);
+}
+
+uint ZSlice(float viewDepth)
+{
+	return min(uint(NormalizedSliceDepth(viewDepth) * NUM_Z_TILES), NUM_Z_TILES - 1);
+}
+
+#ifdef USE_SUBGROUP_ATOMICS
+//同一子组内相邻片元大多落在同一个tile，先按地址分组合并掩码，每组只由一个片元发出原子操作
+void SubgroupAtomicOr(uint address, uint mask)
+{
+	while(true)
+	{
+		if(address == subgroupBroadcastFirst(address))
+		{
+			uint mergedMask = subgroupOr(mask);
+			if(subgroupElect())
+			{
+				atomicOr(cluster.data[address], mergedMask);
+			}
+			break;
+		}
+	}
+}
+#endif
+
 void main()
 {
 	float zw = gl_FragCoord.z;
@@ -38,16 +79,20 @@ void main()
 	float zwDY = dFdy(zw);
 	float tileMinZW = zw - abs(0.5f * zwDX) - abs(0.5f * zwDY);
 	float tileMaxZW = zw + abs(0.5f * zwDX) + abs(0.5f * zwDY);
+#ifdef CONSERVATIVE_TILE_RASTER
+	//视口即tile网格，导数是相邻tile之间的差值，上面的范围正好覆盖整个tile；
+	//保守光栅化时片元中心可能落在三角形外，深度由平面外推，需截断到深度范围内
+	tileMinZW = max(tileMinZW, 0.0f);
+	tileMaxZW = min(tileMaxZW, 1.0f);
+#endif
 
 	float invClipRange = 1.0f / (FAR_CLIP - NEAR_CLIP);
 	float proj33 = -FAR_CLIP * invClipRange;
 	float proj43 = -NEAR_CLIP * FAR_CLIP * invClipRange;
 	float tileMinDepth = proj43 / (-tileMinZW - proj33);
 	float tileMaxDepth = proj43 / (-tileMaxZW - proj33);
-	tileMinDepth = clamp((-tileMinDepth - NEAR_CLIP) * invClipRange, 0.0f, 1.0f);
-	tileMaxDepth = clamp((-tileMaxDepth - NEAR_CLIP) * invClipRange, 0.0f, 1.0f);
-	uint minZTile = uint(tileMinDepth * NUM_Z_TILES);
-	uint maxZTile = uint(tileMaxDepth * NUM_Z_TILES);
+	uint minZTile = ZSlice(-tileMinDepth);
+	uint maxZTile = ZSlice(-tileMaxDepth);
 
 	uint zTileStart = 0;
 	uint zTileEnd = 0;
@@ -69,9 +114,21 @@ void main()
 		break;
 	};
 
+#ifdef USE_SUBGROUP_ATOMICS
+	//辅助调用的原子操作无效，若被选为代表会丢掉合并后的掩码，求完导数后直接退出
+	if(gl_HelperInvocation)
+	{
+		return;
+	}
+#endif
+
 	uint elemIdx = inDecalIndex / 32;
 	uint mask = 1 << (inDecalIndex % 32);
+#ifdef CONSERVATIVE_TILE_RASTER
+	uvec2 tilePosXY = uvec2(gl_FragCoord.xy);
+#else
 	uvec2 tilePosXY = uvec2(gl_FragCoord.xy / TILE_SIZE);
+#endif
 
 	for(uint zTile = zTileStart; zTile <= zTileEnd; zTile++)
 	{
@@ -79,6 +136,10 @@ void main()
 		uint clusterIndex = (tileCoords.z * NUM_X_TILES * NUM_Y_TILES) + (tileCoords.y * NUM_X_TILES) + tileCoords.x;
 		uint address = clusterIndex * ELEMENTS_PER_CLUSTER + elemIdx;
 		if(MODE == 2 && (cluster.data[address] & mask) != 0)break;
+#ifdef USE_SUBGROUP_ATOMICS
+		SubgroupAtomicOr(address, mask);
+#else
 		atomicOr(cluster.data[address], mask);
+#endif
 	}
 }
\ No newline at end of file
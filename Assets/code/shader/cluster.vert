@@ -9,11 +9,10 @@ struct Decal
 	float angle_fade;
 	float intensity;
 	float albedo;
-	uint albedoTexIdx;
-	uint normalTexIdx;
+	uint layer;
+	mat3x4 worldToUVW;//世界空间 -> 贴花UVW空间，行向量形式：uvw = vec4(positionWS, 1.0f) * worldToUVW
 };
 
-layout( constant_id = 0 ) const int MAX_CLUSTER_NUM = 64;
 layout( constant_id = 1 ) const int MODE = 0;
 
 layout(set = 0, binding = 0) uniform MVP 
@@ -23,15 +22,15 @@ layout(set = 0, binding = 0) uniform MVP
 	mat4 proj;
 } mvp;
 
-layout(set = 1, binding = 0) uniform DecalUniform
+layout(std430, set = 1, binding = 0) readonly buffer DecalUniform
 {
-	Decal decals[MAX_CLUSTER_NUM];
+	Decal decals[];
 }decalUniform;
 
-layout(set = 2, binding = 0) buffer IndexUniform
+layout(std430, set = 2, binding = 0) readonly buffer IndexUniform
 {
-	uint decalIndices[MAX_CLUSTER_NUM];
 	uint numIntersectingDecals;
+	uint decalIndices[];
 }indexUniform;
 
 layout(location = 0) in vec3 vertexPostion;
@@ -49,8 +48,7 @@ void main()
 	{
 		outDecalIndex = indexUniform.decalIndices[gl_InstanceIndex + indexUniform.numIntersectingDecals];
 	}
-	
-	outDecalIndex = indexUniform.decalIndices[gl_InstanceIndex];
+
 	Decal decal = decalUniform.decals[outDecalIndex];
 
 
@@ -26,6 +26,7 @@ using namespace std;
 #include "misc/render_pass_create_info.h"
 #include "misc/rendering_surface_create_info.h"
 #include "misc/semaphore_create_info.h"
+#include "misc/fence_create_info.h"
 #include "misc/swapchain_create_info.h"
 #include "wrappers/buffer.h"
 #include "wrappers/command_buffer.h"
@@ -34,6 +35,7 @@ using namespace std;
 #include "wrappers/descriptor_set_layout.h"
 #include "wrappers/device.h"
 #include "wrappers/event.h"
+#include "wrappers/fence.h"
 #include "wrappers/graphics_pipeline_manager.h"
 #include "wrappers/compute_pipeline_manager.h"
 #include "wrappers/framebuffer.h"
@@ -52,9 +54,9 @@ using namespace Anvil;
 
 //surport
 #define GLM_ENABLE_EXPERIMENTAL
-#define GLM_FORCE_RADIANS//ͳһʹû
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE//ʹvulkanȷΧ(0,1)ĬʹõOpenGLΧ(-1,1)
-#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES//ǿĬ϶
+#define GLM_FORCE_RADIANS//统一使用弧度
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE//使用vulkan深度范围(0,1)，默认使用的是OpenGL范围(-1,1)。
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES//强制默认对齐
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtx/hash.hpp"
@@ -72,7 +74,7 @@ struct Vertex
     alignas(16) vec3 tangent;
     alignas(16) vec3 bitangent;
 
-    //ɫδӶȡ
+    //属性描述：顶点着色器如何从顶点数据中提取顶点属性
     static array<VertexInputAttribute, 5> getVertexInputAttribute()
     {
         array<VertexInputAttribute, 5> vertexInputAttributes = {};
@@ -105,7 +107,7 @@ struct Vertex
         return vertexInputAttributes;
     }
 
-    //ظֵ
+    //重载赋值运算符
     bool operator==(const Vertex& other) const
     {
         return
@@ -120,7 +122,7 @@ struct VertexOnlyPos
 {
     vec3 pos;
 
-    //ɫδӶȡ
+    //属性描述：顶点着色器如何从顶点数据中提取顶点属性
     static array<VertexInputAttribute, 1> getVertexInputAttribute()
     {
         array<VertexInputAttribute, 1> vertexInputAttributes = {};
@@ -147,8 +149,7 @@ struct CursorDecal
     alignas(4) float angle_fade;
     alignas(4) float intensity;
     alignas(4) float albedo;
-    alignas(4) uint32_t albedoTexIdx;
-    alignas(4) uint32_t normalTexIdx;
+    alignas(4) uint32_t layer;//贴花纹理数组的层索引
 };
 struct Decal
 {
@@ -159,8 +160,8 @@ struct Decal
     alignas(4) float angle_fade;
     alignas(4) float intensity;
     alignas(4) float albedo;
-    alignas(4) uint32_t albedoTexIdx;
-    alignas(4) uint32_t normalTexIdx;
+    alignas(4) uint32_t layer;//贴花纹理数组的层索引
+    alignas(16) mat3x4 world_to_uvw;//世界空间 -> 贴花UVW空间的3x4矩阵(按列存放各行)，由DecalStore在放置时填写
 
     Decal(vec3 position, vec3 normal, CursorDecal& cursorDecal)
     {
@@ -171,11 +172,20 @@ struct Decal
         angle_fade = cursorDecal.angle_fade;
         intensity = cursorDecal.intensity;
         albedo = cursorDecal.albedo;
-        albedoTexIdx = cursorDecal.albedoTexIdx;
-        normalTexIdx = cursorDecal.normalTexIdx;
+        layer = cursorDecal.layer;
     }
 
     Decal() = default;
+
+    //贴花盒的方向(贴花空间 -> 世界空间)，z轴指向法线反方向
+    mat3 get_orientation() const
+    {
+        vec3 forward = -normal;
+        vec3 up = abs(dot(forward, vec3(0.0f, 1.0f, 0.0f))) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(0.0f, 0.0f, 1.0f);
+        vec3 right = normalize(cross(up, forward));
+        up = cross(forward, right);
+        return mat3(right, up, forward);
+    }
 };
 struct BoundingOrientedBox
 {
@@ -186,7 +196,31 @@ struct BoundingOrientedBox
 
 //core
 #define N_SWAPCHAIN_IMAGES (3)
-#define N_MAX_STORED_DECALS (64)
-#define NUM_Z_TILES (16)
-#define Tile_Size (16)
+#define N_DECALS_PER_CHUNK (256)//贴花缓冲每次增长的容量，需为32的倍数
+#define CLUSTER_STORAGE_HEAP_FRACTION (4)//cluster位掩码缓冲最多占用最大显存堆的几分之一，同时不超过maxStorageBufferRange
+//贴花数量的编译期上限，需为N_DECALS_PER_CHUNK的倍数，达到后按淘汰策略替换旧贴花；
+//实际上限为它与Engine::get_max_cluster_decals(当前tile划分、全屏分辨率下cluster位掩码能覆盖的贴花数)中较小的一个
+#define N_MAX_DECALS (131072)
+#define DECAL_EVICTION_POLICY (EvictionPolicy::OLDEST)
+#define DECAL_ATLAS_LAYER_SIZE (1024)//贴花纹理数组每层的边长
+#define NUM_Z_TILES (16)//启动时的z分片数，运行时可由Engine::set_cluster_config修改
+#define Tile_Size (16)//启动时的tile边长(像素)，运行时可由Engine::set_cluster_config修改
+#define CLUSTER_AUTOTUNE_WARMUP_FRAMES (30)//自动调优切换配置后先跑的帧数，不计入耗时
+#define CLUSTER_AUTOTUNE_FRAMES (240)//自动调优每组配置计时的帧数，即固定相机路径的长度
+#define RENDER_SCALE (1.0f)//渲染分辨率相对交换链的缩放：不为1时在渲染分辨率下完成GBuffer、cluster和着色，再缩放拷贝到交换链
+#define CLUSTER_BINNING (ClusterBinning::RASTER)//默认的cluster分组方式，可用命令行--cluster-binning覆盖
+#define CLUSTER_INDEX_LIST_AVERAGE (16)//压缩索引表按每个cluster平均容纳的贴花数分配，放不下的cluster在deferred中退回扫描位掩码
+#define Z_SLICING (ZSlicing::EXPONENTIAL)//cluster的z分片方式，CPU的z范围和所有cluster着色器共用
+#define TILE_DEPTH_BOUNDS (true)//计算着色器分组时先统计每个tile的GBuffer深度范围，只测试范围内的z分片
+#define CONSERVATIVE_CLUSTER_RASTER (true)//设备支持VK_EXT_conservative_rasterization时，光栅化分组在tile分辨率下保守光栅化，每个tile只有一个片元
+#define SUBGROUP_CLUSTER_ATOMICS (true)//设备支持子组ballot与算术操作时，cluster.frag在子组内合并相同地址的原子操作
+#define CLUSTER_OCCUPANCY (ClusterOccupancy::OFF)//cluster占用统计：OFF 关闭，STATS 统计直方图并异步读回，HEATMAP 同时在画面上叠加热力图；运行时按R切换
+#define DEFERRED_DECAL_CACHE (true)//deferred以tile为工作组，先把工作组内cluster引用的贴花装入共享内存再着色
+#define DEFERRED_MAX_CACHED_DECALS (64)//与deferred.comp中的MAX_CACHED_DECALS一致，用于估算共享内存用量
+#define SCALARIZED_DECAL_LOOP (true)//设备支持计算着色器中的子组算术操作时，deferred在子组内合并cluster位掩码后统一遍历贴花
+#define TILE_CLASSIFICATION (true)//deferred之前把tile分为天空、无贴花、有贴花三类，每类间接dispatch各自特化的着色器
+#define MAX_LIGHTS (256)//点光源与聚光灯数量上限，需为32的倍数，与着色器中的MAX_LIGHTS一致
+#define NUM_LIGHTS (128)//启动时在场景中随机放置的灯光数，可用命令行--lights覆盖
+#define GPU_DECAL_CULLING (true)//true：贴花剔除与分组在计算着色器中完成；false：CPU计算后上传，用于对照验证
 #include "core/engine.h"
+#include "scene/clusterReference.h"
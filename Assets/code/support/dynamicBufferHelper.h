@@ -12,38 +12,73 @@ const uint64_t ALIGNMENT = 256;
 template<typename T> class DynamicBufferHelper
 {
 private:
+	BaseDevice*               m_device_ptr;
+	string                    m_name;
+	bool                      m_is_uniform;
+	BufferUsageFlags          m_extra_usage;
+	uint32_t                  m_n_elements;
 	BufferUniquePtr           m_buffer_ptr;
 	VkDeviceSize              m_size_per_swapchain_image;
 	VkDeviceSize              m_size_total;
 
-public:
-	DynamicBufferHelper(BaseDevice* device, string name, bool isUniform = true)
+	void create_buffer(uint32_t n_elements)
 	{
-		auto allocator_ptr = MemoryAllocator::create_oneshot(device);
+		auto allocator_ptr = MemoryAllocator::create_oneshot(m_device_ptr);
 
-		m_size_per_swapchain_image = Utils::round_up(sizeof(T), ALIGNMENT);
+		m_n_elements = n_elements;
+		m_size_per_swapchain_image = Utils::round_up(sizeof(T) * m_n_elements, ALIGNMENT);
 		m_size_total = N_SWAPCHAIN_IMAGES * m_size_per_swapchain_image;
 
+		BufferUsageFlags usage = m_extra_usage;
+		usage |= m_is_uniform ? BufferUsageFlagBits::UNIFORM_BUFFER_BIT : BufferUsageFlagBits::STORAGE_BUFFER_BIT;
+
 		auto create_info_ptr = BufferCreateInfo::create_no_alloc(
-			device,
+			m_device_ptr,
 			m_size_total,
 			QueueFamilyFlagBits::GRAPHICS_BIT,
 			SharingMode::EXCLUSIVE,
 			BufferCreateFlagBits::NONE,
-			isUniform ? BufferUsageFlagBits::UNIFORM_BUFFER_BIT : BufferUsageFlagBits::STORAGE_BUFFER_BIT);
+			usage);
 		m_buffer_ptr = Buffer::create(move(create_info_ptr));
-		m_buffer_ptr->set_name(name + (isUniform ? " unfiorm " : " storage ") + "buffer");
+		m_buffer_ptr->set_name(m_name + (m_is_uniform ? " unfiorm " : " storage ") + "buffer");
 
 		allocator_ptr->add_buffer(
 			m_buffer_ptr.get(),
 			MemoryFeatureFlagBits::NONE); /* in_required_memory_features */
 	}
 
-	void update(Queue* queue_ptr, T* data, int n)
+public:
+	//n_elements：每张交换链图像对应的T的个数，用于长度可变的storage缓冲
+	//extra_usage：额外的用途，如GPU写入的间接绘制参数需要INDIRECT_BUFFER_BIT
+	DynamicBufferHelper(BaseDevice* device, string name, bool isUniform = true, uint32_t n_elements = 1,
+		BufferUsageFlags extra_usage = BufferUsageFlagBits::NONE)
+		:m_device_ptr(device), m_name(name), m_is_uniform(isUniform), m_extra_usage(extra_usage)
+	{
+		create_buffer(n_elements);
+	}
+
+	//容量不足时重新创建缓冲，旧数据不保留；调用前需确保GPU已不再使用旧缓冲
+	bool resize(uint32_t n_elements)
 	{
+		if (n_elements <= m_n_elements)
+		{
+			return false;
+		}
+
+		create_buffer(n_elements);
+		return true;
+	}
+
+	void update(Queue* queue_ptr, T* data, int n, uint32_t n_elements = 1, uint32_t first_element = 0)
+	{
+		if (n_elements == 0)
+		{
+			return;
+		}
+
 		m_buffer_ptr->write(
-			n * m_size_per_swapchain_image, /* start_offset */
-			sizeof(T),
+			n * m_size_per_swapchain_image + first_element * sizeof(T), /* start_offset */
+			sizeof(T) * n_elements,
 			data,
 			queue_ptr);
 	}
@@ -0,0 +1,87 @@
+#pragma once
+#include "wrappers/query_pool.h"
+#include "wrappers/command_buffer.h"
+using namespace Anvil;
+
+//整帧GPU耗时：每张交换链图像一对时间戳，指令缓冲开头和结尾各写一个。
+//该图像的栅栏等待结束后读取它上一次提交的结果，不会阻塞；tag用于区分结果属于哪一次配置
+class GpuTimer
+{
+private:
+	static const uint64_t NOT_PENDING = UINT64_MAX;
+
+	QueryPoolUniquePtr        m_query_pool_ptr;
+	float                     m_timestamp_period;//每个时间戳计数对应的纳秒数，为0表示设备不支持
+	uint64_t                  m_pending_tags[N_SWAPCHAIN_IMAGES];
+
+public:
+	GpuTimer(BaseDevice* device)
+	{
+		m_timestamp_period = device->get_physical_device_properties().core_vk1_0_properties_ptr->limits.timestamp_period;
+		m_query_pool_ptr = QueryPool::create_non_ps_query_pool(
+			device,
+			VK_QUERY_TYPE_TIMESTAMP,
+			2 * N_SWAPCHAIN_IMAGES);
+
+		for (uint32_t n = 0; n < N_SWAPCHAIN_IMAGES; n++)
+		{
+			m_pending_tags[n] = NOT_PENDING;
+		}
+	}
+
+	bool is_supported()
+	{
+		return m_timestamp_period > 0.0f;
+	}
+
+	//在第n张交换链图像的指令缓冲最开头调用
+	void record_begin(PrimaryCommandBuffer* cmd_buffer_ptr, uint32_t n)
+	{
+		cmd_buffer_ptr->record_reset_query_pool(m_query_pool_ptr.get(), 2 * n, 2);
+		cmd_buffer_ptr->record_write_timestamp(PipelineStageFlagBits::TOP_OF_PIPE_BIT, m_query_pool_ptr.get(), 2 * n);
+	}
+
+	//在第n张交换链图像的指令缓冲最末尾调用
+	void record_end(PrimaryCommandBuffer* cmd_buffer_ptr, uint32_t n)
+	{
+		cmd_buffer_ptr->record_write_timestamp(PipelineStageFlagBits::BOTTOM_OF_PIPE_BIT, m_query_pool_ptr.get(), 2 * n + 1);
+	}
+
+	void on_submit(uint32_t n, uint64_t tag)
+	{
+		m_pending_tags[n] = tag;
+	}
+
+	//第n张图像的栅栏触发后调用，取回它上一次提交的耗时(毫秒)；没有待读取的结果时返回false
+	bool collect(uint32_t n, float* out_ms, uint64_t* out_tag)
+	{
+		if (m_pending_tags[n] == NOT_PENDING || !is_supported())
+		{
+			return false;
+		}
+
+		uint64_t timestamps[2];
+		bool all_results_retrieved = false;
+		m_query_pool_ptr->get_query_pool_results(
+			2 * n,
+			2,
+			QueryResultFlagBits::_64_BIT,
+			timestamps,
+			&all_results_retrieved);
+
+		*out_tag = m_pending_tags[n];
+		m_pending_tags[n] = NOT_PENDING;
+		if (!all_results_retrieved)
+		{
+			return false;
+		}
+
+		*out_ms = float(double(timestamps[1] - timestamps[0]) * m_timestamp_period * 1e-6);
+		return true;
+	}
+
+	~GpuTimer()
+	{
+		m_query_pool_ptr.reset();
+	}
+};
@@ -58,5 +58,5 @@ public:
 	}
 
 private:
-	bool m_key_down[256]; /**< 256״̬ */
+	bool m_key_down[256]; /**< 保存256个按键的状态 */
 };
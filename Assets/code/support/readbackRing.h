@@ -0,0 +1,142 @@
+#pragma once
+#include "misc/buffer_create_info.h"
+#include "misc/memory_allocator.h"
+#include "wrappers/fence.h"
+#include "dynamicBufferHelper.h"
+using namespace Anvil;
+
+#include <string>
+using namespace std;
+
+//小块数据从GPU读回CPU的环形缓冲：每张交换链图像一个主机可见、常驻映射的槽位，
+//指令缓冲中把结果拷贝到对应槽位，提交时登记该帧的栅栏，CPU只读取栅栏已触发的槽位，从不阻塞
+template<typename T> class ReadbackRing
+{
+private:
+	static const uint64_t NOT_PENDING = UINT64_MAX;
+
+	string                    m_name;
+	BufferUniquePtr           m_buffer_ptr;
+	VkDeviceSize              m_size_per_swapchain_image;
+	uint8_t*                  m_mapped_ptr;
+
+	Fence*                    m_fences[N_SWAPCHAIN_IMAGES];
+	uint64_t                  m_pending_frames[N_SWAPCHAIN_IMAGES];//槽位中结果所属的帧序号，NOT_PENDING表示没有待读取的结果
+
+	T                         m_latest;
+	uint64_t                  m_latest_frame;
+	bool                      m_has_result;
+
+public:
+	ReadbackRing(BaseDevice* device, string name)
+		:m_name(name), m_mapped_ptr(nullptr), m_latest_frame(0), m_has_result(false)
+	{
+		auto allocator_ptr = MemoryAllocator::create_oneshot(device);
+
+		m_size_per_swapchain_image = Utils::round_up(sizeof(T), ALIGNMENT);
+
+		auto create_info_ptr = BufferCreateInfo::create_no_alloc(
+			device,
+			N_SWAPCHAIN_IMAGES * m_size_per_swapchain_image,
+			QueueFamilyFlagBits::GRAPHICS_BIT | QueueFamilyFlagBits::COMPUTE_BIT,
+			SharingMode::EXCLUSIVE,
+			BufferCreateFlagBits::NONE,
+			BufferUsageFlagBits::TRANSFER_DST_BIT);
+		m_buffer_ptr = Buffer::create(move(create_info_ptr));
+		m_buffer_ptr->set_name(m_name + " readback buffer");
+
+		allocator_ptr->add_buffer(
+			m_buffer_ptr.get(),
+			MemoryFeatureFlagBits::MAPPABLE_BIT | MemoryFeatureFlagBits::HOST_COHERENT_BIT); /* in_required_memory_features */
+
+		void* mapped_ptr = nullptr;
+		m_buffer_ptr->get_memory_block(0)->map(0, N_SWAPCHAIN_IMAGES * m_size_per_swapchain_image, &mapped_ptr);
+		m_mapped_ptr = static_cast<uint8_t*>(mapped_ptr);
+
+		for (uint32_t n = 0; n < N_SWAPCHAIN_IMAGES; n++)
+		{
+			m_fences[n] = nullptr;
+			m_pending_frames[n] = NOT_PENDING;
+		}
+	}
+
+	//在指令缓冲中把src_buffer的结果拷贝到第n个槽位，并使其对主机可见；src_buffer需带TRANSFER_SRC_BIT
+	void record_copy(PrimaryCommandBuffer* cmd_buffer_ptr, Queue* queue_ptr, Buffer* src_buffer_ptr, VkDeviceSize src_offset, uint32_t n)
+	{
+		BufferCopy region;
+		region.src_offset = src_offset;
+		region.dst_offset = n * m_size_per_swapchain_image;
+		region.size = sizeof(T);
+
+		cmd_buffer_ptr->record_copy_buffer(
+			src_buffer_ptr,
+			m_buffer_ptr.get(),
+			1, /* in_region_count */
+			&region);
+
+		BufferBarrier buffer_barrier(
+			AccessFlagBits::TRANSFER_WRITE_BIT,                  /* in_source_access_mask      */
+			AccessFlagBits::HOST_READ_BIT,                       /* in_destination_access_mask */
+			queue_ptr->get_queue_family_index(),                 /* in_src_queue_family_index  */
+			queue_ptr->get_queue_family_index(),                 /* in_dst_queue_family_index  */
+			m_buffer_ptr.get(),
+			n * m_size_per_swapchain_image,                      /* in_offset                  */
+			m_size_per_swapchain_image);
+
+		cmd_buffer_ptr->record_pipeline_barrier(
+			PipelineStageFlagBits::TRANSFER_BIT,
+			PipelineStageFlagBits::HOST_BIT,
+			DependencyFlagBits::NONE,
+			0,               /* in_memory_barrier_count        */
+			nullptr,         /* in_memory_barriers_ptr         */
+			1,               /* in_buffer_memory_barrier_count */
+			&buffer_barrier,
+			0,               /* in_image_memory_barrier_count  */
+			nullptr);        /* in_image_memory_barriers_ptr   */
+	}
+
+	//提交第n张交换链图像的指令缓冲后调用，fence_ptr为该次提交使用的栅栏
+	void on_submit(uint32_t n, Fence* fence_ptr, uint64_t frame)
+	{
+		m_fences[n] = fence_ptr;
+		m_pending_frames[n] = frame;
+	}
+
+	//不阻塞地取回已完成的最新结果；从未有结果完成时返回false。out_age为结果距current_frame的帧数
+	bool poll(uint64_t current_frame, T* out, uint64_t* out_age = nullptr)
+	{
+		for (uint32_t n = 0; n < N_SWAPCHAIN_IMAGES; n++)
+		{
+			if (m_pending_frames[n] == NOT_PENDING || !m_fences[n]->is_set())
+			{
+				continue;
+			}
+
+			if (!m_has_result || m_pending_frames[n] > m_latest_frame)
+			{
+				memcpy(&m_latest, m_mapped_ptr + n * m_size_per_swapchain_image, sizeof(T));
+				m_latest_frame = m_pending_frames[n];
+				m_has_result = true;
+			}
+			m_pending_frames[n] = NOT_PENDING;
+		}
+
+		if (!m_has_result)
+		{
+			return false;
+		}
+
+		*out = m_latest;
+		if (out_age != nullptr)
+		{
+			*out_age = current_frame - m_latest_frame;
+		}
+		return true;
+	}
+
+	~ReadbackRing()
+	{
+		m_buffer_ptr->get_memory_block(0)->unmap();
+		m_buffer_ptr.reset();
+	}
+};
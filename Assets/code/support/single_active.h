@@ -1,18 +1,18 @@
 #pragma once
 #include <memory>
 
-//ȫַģࣨͬһֻһܼ
+//全局访问模板类（同一个类只有一个对象能激活）
 template<class T> class SingleActive
 {
 	public:
-		static void ResetActive();//ȡ
-		virtual void SetAsActive();//
-		bool IsActive();//Ƿ񼤻
+		static void ResetActive();//取消激活
+		virtual void SetAsActive();//激活
+		bool IsActive();//是否激活
 		
-		static std::unique_ptr<T> &Active();//صȫַ
+		static std::unique_ptr<T> &Active();//返回单例，可以在全局访问
 
 	protected:
-		static std::unique_ptr<T> current;//ָ
+		static std::unique_ptr<T> current;//指针
 		~SingleActive();
 };
 
@@ -22,7 +22,7 @@ std::unique_ptr<T> SingleActive<T>::current = nullptr;
 template<class T>
 SingleActive<T>::~SingleActive()
 {
-	//öΪͷָĿȨⲿɾĪҪ
+	//如果该对象为激活对象，释放指针的控制权；已由外部删除，莫要多管闲事
 	if (static_cast<T *>(this) == current.get())
 	{
 		current.release();